@@ -0,0 +1,574 @@
+#ifndef BitMap_Stream_H_
+#define BitMap_Stream_H_
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "SDKUtil.hpp"
+#include "SDKBitMap.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BITMAP_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(__SSSE3__) || defined(__AVX2__)
+#define BITMAP_SSSE3
+#include <tmmintrin.h>
+#endif
+
+#define BITMAP_WRITE_BYTES (4 << 20)    /**< Largest single fwrite of BitMapStripWriter */
+
+using namespace appsdk;
+
+/**
+* Seek to an absolute file position, also beyond 2GB
+*/
+static int
+bitMapSeek(FILE* fd, unsigned long long position)
+{
+#if defined(_WIN32)
+	return _fseeki64(fd, (__int64)position, SEEK_SET);
+#else
+	return fseeko(fd, (off_t)position, SEEK_SET);
+#endif
+}
+
+/**
+* BitMapStripReader
+* Reads an uncompressed 8, 24 or 32 bit BMP a few rows at a time.
+* Rows are returned in file order, like SDKBitMap::getPixels().
+*/
+
+class BitMapStripReader : public BitMapHeader, public BitMapInfoHeader
+{
+        FILE* fd_;                      /**< Open BMP file */
+        ColorPalette* colors_;          /**< Palette of 8 bit images */
+        unsigned char* row_;            /**< One file row, including padding */
+        size_t rowBytes_;               /**< Bytes per file row */
+        int nextRow_;                   /**< Row the file position points at */
+
+    public:
+
+        BitMapStripReader()
+            : fd_(NULL),
+              colors_(NULL),
+              row_(NULL),
+              rowBytes_(0),
+              nextRow_(0)
+        {}
+
+        ~BitMapStripReader()
+        {
+            close();
+        }
+
+        /**
+        * Open a BMP file and read its headers
+        * @param filename path of the bitmap
+        * @return true if the file is a supported bitmap
+        */
+        bool open(const char* filename);
+
+        /**
+        * Read and convert rows to uchar4 (x = R, y = G, z = B, w = A)
+        * @param firstRow first file row to read
+        * @param rows number of rows
+        * @param dst destination, rows * dstWidth pixels
+        * @param dstWidth pixels per destination row; wider rows are cropped
+        * @return true on success
+        */
+        bool readRows(int firstRow, int rows, uchar4* dst, int dstWidth);
+
+        /**
+        * Close the file and release the row buffer
+        */
+        void close();
+
+        int getWidth() const { return width; }
+
+        int getHeight() const { return height; }
+};
+
+bool
+BitMapStripReader::open(const char* filename)
+{
+	close();
+
+	fd_ = fopen(filename, "rb");
+	if (fd_ == NULL)
+	{
+		return false;
+	}
+
+	if (fread((BitMapHeader*)this, sizeof(BitMapHeader), 1, fd_) != 1 || id != bitMapID ||
+		fread((BitMapInfoHeader*)this, sizeof(BitMapInfoHeader), 1, fd_) != 1)
+	{
+		close();
+		return false;
+	}
+
+	// No support for compressed, top-down or palette-less low depth images
+	if (compression || width <= 0 || height <= 0 ||
+		(bitsPerPixel != 8 && bitsPerPixel != 24 && bitsPerPixel != 32))
+	{
+		close();
+		return false;
+	}
+
+	if (bitsPerPixel == 8)
+	{
+		colors_ = new ColorPalette[256];
+		if (bitMapSeek(fd_, sizeof(BitMapHeader) + sizeInfo) != 0 ||
+			fread(colors_, sizeof(ColorPalette), 256, fd_) != 256)
+		{
+			close();
+			return false;
+		}
+	}
+
+	rowBytes_ = (((size_t)width * bitsPerPixel / 8) + 3) & ~(size_t)3;
+	row_ = new unsigned char[rowBytes_];
+	nextRow_ = -1;
+
+	return true;
+}
+
+bool
+BitMapStripReader::readRows(int firstRow, int rows, uchar4* dst, int dstWidth)
+{
+	if (fd_ == NULL || firstRow < 0 || rows < 0 || firstRow + rows > height)
+	{
+		return false;
+	}
+
+	// Strips overlap by their halo, so seek back only when needed
+	if (firstRow != nextRow_ &&
+		bitMapSeek(fd_, (unsigned long long)(unsigned int)offset + (unsigned long long)firstRow * rowBytes_) != 0)
+	{
+		return false;
+	}
+
+	int copyWidth = dstWidth < width ? dstWidth : width;
+	for (int y = 0; y < rows; y++)
+	{
+		if (fread(row_, rowBytes_, 1, fd_) != 1)
+		{
+			nextRow_ = -1;
+			return false;
+		}
+
+		uchar4* out = dst + (size_t)y * dstWidth;
+		const unsigned char* in = row_;
+		if (bitsPerPixel == 24)
+		{
+			for (int x = 0; x < copyWidth; x++, in += 3)
+			{
+				out[x].x = in[2];
+				out[x].y = in[1];
+				out[x].z = in[0];
+				out[x].w = 0xff;
+			}
+		}
+		else if (bitsPerPixel == 32)
+		{
+			for (int x = 0; x < copyWidth; x++, in += 4)
+			{
+				out[x].x = in[2];
+				out[x].y = in[1];
+				out[x].z = in[0];
+				out[x].w = in[3];
+			}
+		}
+		else
+		{
+			// Palette entries are stored as B, G, R, reserved
+			for (int x = 0; x < copyWidth; x++)
+			{
+				const ColorPalette& c = colors_[in[x]];
+				out[x].x = c.z;
+				out[x].y = c.y;
+				out[x].z = c.x;
+				out[x].w = 0xff;
+			}
+		}
+		for (int x = copyWidth; x < dstWidth; x++)
+		{
+			memset(&out[x], 0, sizeof(uchar4));
+		}
+	}
+	nextRow_ = firstRow + rows;
+
+	return true;
+}
+
+void
+BitMapStripReader::close()
+{
+	if (fd_ != NULL)
+	{
+		fclose(fd_);
+		fd_ = NULL;
+	}
+	delete[] colors_;
+	colors_ = NULL;
+	delete[] row_;
+	row_ = NULL;
+}
+
+/**
+* Pack binary pixels 8 to a byte, the first pixel in the most significant bit
+* (BMP and PBM order); bits past count in the last byte are cleared
+* @param in source pixels, set where x is not 0
+* @param out destination, (count + 7) / 8 bytes
+* @param count number of pixels
+*/
+static void
+bitMapPackBits(const uchar4* in, unsigned char* out, int count)
+{
+	int x = 0;
+	for (; x + 8 <= count; x += 8)
+	{
+		*out++ = (unsigned char)((in[x].x ? 0x80 : 0) | (in[x + 1].x ? 0x40 : 0) |
+			(in[x + 2].x ? 0x20 : 0) | (in[x + 3].x ? 0x10 : 0) | (in[x + 4].x ? 0x08 : 0) |
+			(in[x + 5].x ? 0x04 : 0) | (in[x + 6].x ? 0x02 : 0) | (in[x + 7].x ? 0x01 : 0));
+	}
+	if (x < count)
+	{
+		unsigned char bits = 0;
+		for (int b = 0; x < count; x++, b++)
+		{
+			bits |= in[x].x ? (unsigned char)(0x80 >> b) : 0;
+		}
+		*out = bits;
+	}
+}
+
+/**
+* Expand bits packed by bitMapPackBits or edge_pack to an edge map
+* @param in source, (count + 7) / 8 bytes
+* @param out destination pixels, 255 in every channel where the bit is set and 0 elsewhere
+* @param count number of pixels
+*/
+static void
+bitMapUnpackBits(const unsigned char* in, uchar4* out, int count)
+{
+	for (int x = 0; x < count; x++)
+	{
+		unsigned char v = (in[x >> 3] >> (7 - (x & 7))) & 1 ? 0xff : 0;
+		out[x].x = out[x].y = out[x].z = out[x].w = v;
+	}
+}
+
+/**
+* Pack one row of uchar4 pixels into BMP order
+* @param in source pixels (x = R, y = G, z = B)
+* @param out destination bytes, 3 per pixel for 24 bit, 1 (x) for 8 bit and
+* a bit (x not 0) for 1 bit
+* @param count number of pixels
+* @param bitsPerPixel 24, 8 or 1
+*/
+static void
+bitMapPackRow(const uchar4* in, unsigned char* out, int count, int bitsPerPixel)
+{
+	const unsigned char* src = (const unsigned char*)in;
+	int x = 0;
+
+	if (bitsPerPixel == 1)
+	{
+		bitMapPackBits(in, out, count);
+		return;
+	}
+
+	if (bitsPerPixel == 8)
+	{
+#if defined(BITMAP_SSE2)
+		const __m128i mask = _mm_set1_epi32(0xff);
+		for (; x + 16 <= count; x += 16)
+		{
+			__m128i p0 = _mm_and_si128(_mm_loadu_si128((const __m128i*)(src + 4 * x)), mask);
+			__m128i p1 = _mm_and_si128(_mm_loadu_si128((const __m128i*)(src + 4 * x + 16)), mask);
+			__m128i p2 = _mm_and_si128(_mm_loadu_si128((const __m128i*)(src + 4 * x + 32)), mask);
+			__m128i p3 = _mm_and_si128(_mm_loadu_si128((const __m128i*)(src + 4 * x + 48)), mask);
+			_mm_storeu_si128((__m128i*)(out + x),
+				_mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_packs_epi32(p2, p3)));
+		}
+#endif
+		for (; x < count; x++)
+		{
+			out[x] = src[4 * x];
+		}
+		return;
+	}
+
+#if defined(BITMAP_SSSE3)
+	// 4 pixels give 12 bytes; the 4 spare bytes of each store are overwritten next time
+	const __m128i bgr = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	for (; x + 6 <= count; x += 4)
+	{
+		__m128i px = _mm_loadu_si128((const __m128i*)(src + 4 * x));
+		_mm_storeu_si128((__m128i*)(out + 3 * x), _mm_shuffle_epi8(px, bgr));
+	}
+#elif defined(BITMAP_SSE2)
+	// Swap R and B in each 32 bit lane, close the gap after every second pixel
+	// with a 64 bit shift and store the two 6 byte halves; the 2 spare bytes
+	// of each store are overwritten next
+	const __m128i green = _mm_set1_epi32(0xff00);
+	const __m128i blue = _mm_set1_epi32(0xff);
+	const __m128i red = _mm_set1_epi32(0xff0000);
+	const __m128i even = _mm_set_epi32(0, -1, 0, -1);
+	for (; x + 6 <= count; x += 4)
+	{
+		__m128i px = _mm_loadu_si128((const __m128i*)(src + 4 * x));
+		__m128i bgr = _mm_or_si128(_mm_and_si128(px, green),
+			_mm_or_si128(_mm_and_si128(_mm_srli_epi32(px, 16), blue),
+				_mm_and_si128(_mm_slli_epi32(px, 16), red)));
+		bgr = _mm_or_si128(_mm_and_si128(bgr, even), _mm_srli_epi64(_mm_andnot_si128(even, bgr), 8));
+		_mm_storel_epi64((__m128i*)(out + 3 * x), bgr);
+		_mm_storel_epi64((__m128i*)(out + 3 * x + 6), _mm_srli_si128(bgr, 8));
+	}
+#endif
+	for (; x < count; x++)
+	{
+		out[3 * x] = src[4 * x + 2];
+		out[3 * x + 1] = src[4 * x + 1];
+		out[3 * x + 2] = src[4 * x];
+	}
+}
+
+/**
+* BitMapStripWriter
+* Writes a 24 bit, 8 bit greyscale or 1 bit black and white BMP sequentially,
+* a few rows at a time.
+* Rows are packed into a reusable buffer and written with one fwrite per
+* BITMAP_WRITE_BYTES.
+*/
+
+class BitMapStripWriter
+{
+        FILE* fd_;                      /**< Open BMP file */
+        unsigned char* buffer_;         /**< Packed file rows, including padding */
+        int bufferRows_;                /**< Rows buffer_ holds */
+        size_t rowBytes_;               /**< Bytes per file row */
+        int width_;                     /**< Image width */
+        int height_;                    /**< Image height */
+        int bitsPerPixel_;              /**< 24, 8 for a greyscale palette image or 1 for black and white */
+        int rowsWritten_;               /**< Rows written so far */
+
+    public:
+
+        BitMapStripWriter()
+            : fd_(NULL),
+              buffer_(NULL),
+              bufferRows_(0),
+              rowBytes_(0),
+              width_(0),
+              height_(0),
+              bitsPerPixel_(24),
+              rowsWritten_(0)
+        {}
+
+        ~BitMapStripWriter()
+        {
+            close();
+        }
+
+        /**
+        * Create the file and write the headers
+        * @param filename path of the bitmap
+        * @param width image width
+        * @param height image height
+        * @param bitsPerPixel 24, 8 to keep only x as a greyscale palette index, or 1 to
+        * keep only whether x is set
+        * @param topDown rows are given top to bottom (negative height in the header)
+        * @return true on success
+        */
+        bool open(const char* filename, int width, int height, int bitsPerPixel = 24,
+            bool topDown = false);
+
+        /**
+        * Append rows in file order
+        * @param src source, rows * srcWidth pixels
+        * @param rows number of rows
+        * @param srcWidth pixels per source row; missing columns are written black
+        * @return true on success
+        */
+        bool writeRows(const uchar4* src, int rows, int srcWidth);
+
+        /**
+        * Append rows of a 1 bit image that are packed already, in file order
+        * @param src source, rows * srcRowBytes bytes packed like bitMapPackBits
+        * @param rows number of rows
+        * @param srcRowBytes bytes from one source row to the next; missing bytes are written black
+        * @return true on success
+        */
+        bool writePackedRows(const unsigned char* src, int rows, size_t srcRowBytes);
+
+        /**
+        * Close the file
+        * @return true if every row was written
+        */
+        bool close();
+};
+
+bool
+BitMapStripWriter::open(const char* filename, int width, int height, int bitsPerPixel,
+	bool topDown)
+{
+	close();
+
+	if (width <= 0 || height <= 0 || (bitsPerPixel != 24 && bitsPerPixel != 8 && bitsPerPixel != 1))
+	{
+		return false;
+	}
+
+	fd_ = fopen(filename, "wb");
+	if (fd_ == NULL)
+	{
+		return false;
+	}
+
+	width_ = width;
+	height_ = height;
+	bitsPerPixel_ = bitsPerPixel;
+	rowsWritten_ = 0;
+	rowBytes_ = (((size_t)width * bitsPerPixel + 31) / 32) * 4;
+
+	size_t rows = BITMAP_WRITE_BYTES / rowBytes_;
+	bufferRows_ = rows == 0 ? 1 : (rows > (size_t)height ? height : (int)rows);
+	buffer_ = new unsigned char[bufferRows_ * rowBytes_];
+	memset(buffer_, 0, bufferRows_ * rowBytes_);
+
+	int paletteEntries = bitsPerPixel == 8 ? 256 : (bitsPerPixel == 1 ? 2 : 0);
+
+	BitMapHeader header;
+	header.id = bitMapID;
+	header.offset = (int)(sizeof(BitMapHeader) + sizeof(BitMapInfoHeader) +
+		paletteEntries * sizeof(ColorPalette));
+	header.reserved1 = 0x0000;
+	header.reserved2 = 0x0000;
+	header.size = (int)(header.offset + rowBytes_ * height);
+
+	BitMapInfoHeader info;
+	info.sizeInfo = sizeof(BitMapInfoHeader);
+	info.width = width;
+	info.height = topDown ? -height : height;
+	info.planes = 1;
+	info.bitsPerPixel = (short)bitsPerPixel;
+	info.compression = 0;
+	info.imageSize = (unsigned)(rowBytes_ * height);
+	info.xPelsPerMeter = 0;
+	info.yPelsPerMeter = 0;
+	info.clrUsed = paletteEntries;
+	info.clrImportant = 0;
+
+	if (fwrite(&header, sizeof(BitMapHeader), 1, fd_) != 1 ||
+		fwrite(&info, sizeof(BitMapInfoHeader), 1, fd_) != 1)
+	{
+		close();
+		return false;
+	}
+
+	if (paletteEntries != 0)
+	{
+		// Grey ramp; the 1 bit palette is black and white
+		ColorPalette palette[256];
+		for (int i = 0; i < paletteEntries; i++)
+		{
+			palette[i].x = palette[i].y = palette[i].z = (unsigned char)(i * 255 / (paletteEntries - 1));
+			palette[i].w = 0;
+		}
+		if (fwrite(palette, sizeof(ColorPalette), paletteEntries, fd_) != (size_t)paletteEntries)
+		{
+			close();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool
+BitMapStripWriter::writeRows(const uchar4* src, int rows, int srcWidth)
+{
+	if (fd_ == NULL || rows < 0 || rowsWritten_ + rows > height_)
+	{
+		return false;
+	}
+
+	int copyWidth = srcWidth < width_ ? srcWidth : width_;
+	size_t copyBytes = ((size_t)copyWidth * bitsPerPixel_ + 7) / 8;
+	for (int y0 = 0; y0 < rows; y0 += bufferRows_)
+	{
+		int n = rows - y0 < bufferRows_ ? rows - y0 : bufferRows_;
+		for (int y = 0; y < n; y++)
+		{
+			unsigned char* out = buffer_ + y * rowBytes_;
+			bitMapPackRow(src + (size_t)(y0 + y) * srcWidth, out, copyWidth, bitsPerPixel_);
+			// Columns past srcWidth and the row padding are zero
+			memset(out + copyBytes, 0, rowBytes_ - copyBytes);
+		}
+		if (fwrite(buffer_, rowBytes_ * n, 1, fd_) != 1)
+		{
+			return false;
+		}
+	}
+	rowsWritten_ += rows;
+
+	return true;
+}
+
+bool
+BitMapStripWriter::writePackedRows(const unsigned char* src, int rows, size_t srcRowBytes)
+{
+	if (fd_ == NULL || bitsPerPixel_ != 1 || rows < 0 || rowsWritten_ + rows > height_)
+	{
+		return false;
+	}
+
+	size_t copyBytes = srcRowBytes < rowBytes_ ? srcRowBytes : rowBytes_;
+	if (srcRowBytes == rowBytes_)
+	{
+		// Rows already have the file layout (edge_pack pads them to 32 bits)
+		if (rows != 0 && fwrite(src, rowBytes_ * rows, 1, fd_) != 1)
+		{
+			return false;
+		}
+		rowsWritten_ += rows;
+		return true;
+	}
+
+	for (int y0 = 0; y0 < rows; y0 += bufferRows_)
+	{
+		int n = rows - y0 < bufferRows_ ? rows - y0 : bufferRows_;
+		for (int y = 0; y < n; y++)
+		{
+			unsigned char* out = buffer_ + y * rowBytes_;
+			memcpy(out, src + (size_t)(y0 + y) * srcRowBytes, copyBytes);
+			memset(out + copyBytes, 0, rowBytes_ - copyBytes);
+		}
+		if (fwrite(buffer_, rowBytes_ * n, 1, fd_) != 1)
+		{
+			return false;
+		}
+	}
+	rowsWritten_ += rows;
+
+	return true;
+}
+
+bool
+BitMapStripWriter::close()
+{
+	bool complete = rowsWritten_ == height_;
+	if (fd_ != NULL)
+	{
+		complete = (fclose(fd_) == 0) && complete;
+		fd_ = NULL;
+	}
+	delete[] buffer_;
+	buffer_ = NULL;
+	return complete;
+}
+
+#endif // BitMap_Stream_H_
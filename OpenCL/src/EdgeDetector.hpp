@@ -4,8 +4,16 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#include <algorithm>
+#include <vector>
+#include <random>
 #include "OpenCLUtil.hpp"
 #include "SDKBitMap.hpp"
+#include "NativeEdgeDetector.hpp"
+#include "BitMapStream.hpp"
+#include "MappedBitMap.hpp"
+#include "PlanarImage.hpp"
+#include "VideoStream.hpp"
 
 using namespace appsdk;
 
@@ -14,6 +22,13 @@ using namespace appsdk;
 #define MAX_KERNEL "kernels/Max_Kernels.cl"
 #define HYSTERESIS_KERNEL "kernels/Hysteresis_Kernels.cl"
 #define SOBEL_FILTER_KERNEL "kernels/SobelFilter_Kernels.cl"
+#define COMPACT_KERNEL "kernels/Compact_Kernels.cl"
+#define FLAT_TILE_KERNEL "kernels/FlatTile_Kernels.cl"
+
+// Files the stage kernels include; the directory is passed with -I
+#define KERNEL_INCLUDE_DIR "kernels"
+#define STAGE_COMMON_HEADER "kernels/Stage_Common.h"
+#define SOBEL_FIXED_HEADER "kernels/Sobel_Fixed.h"
 
 //#define INPUT_IMAGE "tiger.bmp"
 #define INPUT_IMAGE "Input_Image.bmp"
@@ -21,6 +36,136 @@ using namespace appsdk;
 
 #define GROUP_SIZE 16
 
+// Rows per strip of --stream when --tile-rows is not given
+#define STREAM_STRIP_ROWS 256
+
+// Rows each strip needs above and below: gaussian, sobel and max read one row each
+#define TILE_HALO 3
+
+// Full resolution tile side gated by the coarsest level of --pyramid-fuse
+#define PYRAMID_TILE 32
+
+// Largest work-group of the --edge-list compaction kernels (a power of two)
+#define COMPACT_GROUP_SIZE 256
+
+// Work-group side of sobel_max_filter (FUSED_GROUP_X and FUSED_GROUP_Y of its kernel)
+#define FUSED_GROUP_SIZE 16
+
+// Tile side of --flat-threshold; width and height are whole numbers of tiles
+#define FLAT_TILE GROUP_SIZE
+
+// Largest work-group of tile_range (a power of two)
+#define FLAT_GROUP_SIZE 64
+
+// Largest --flat-threshold that cannot drop an edge (a range of r keeps the magnitude below 2.83 r)
+#define FLAT_EXACT_THRESHOLD 15
+
+// The same with --fast-magnitude l1, which keeps it below 4 r
+#define FLAT_EXACT_THRESHOLD_L1 11
+
+/**
+* StripContext
+* Queue and buffers a run of full width rows is processed with
+*/
+
+struct StripContext
+{
+    cl_command_queue queue;             /**< Queue the stages are enqueued on */
+    cl_mem nextBuffer;                  /**< Input, gaussian and max output */
+    cl_mem prevBuffer;                  /**< Greyscale, sobel and hysteresis output */
+    cl_mem thetaBuffer;                 /**< Sobel direction, or magnitude and direction with --intermediate packed */
+    cl_mem inputBuffer;                 /**< Upload target: nextBuffer, or packed 24/8 bit pixels */
+    size_t rows;                        /**< Rows in the strip */
+    size_t firstColumn;                 /**< Image column the strip starts at */
+    size_t columns;                     /**< Columns in the strip, a multiple of GROUP_SIZE */
+    cl_mem tileList;                    /**< Tiles gaussian to hysteresis run over (--flat-threshold), NULL = all */
+    size_t tileCount;                   /**< Entries of tileList */
+};
+
+/**
+* ImageRegion
+* Rectangle of the processed area, in pixels
+*/
+
+struct ImageRegion
+{
+    cl_uint x;                          /**< First column */
+    cl_uint y;                          /**< First row */
+    cl_uint width;                      /**< Columns */
+    cl_uint height;                     /**< Rows */
+};
+
+/**
+* PyramidLevel
+* One level of --pyramid; level 0 is the full resolution image
+*/
+
+struct PyramidLevel
+{
+    cl_uint width;                      /**< Columns, a multiple of GROUP_SIZE */
+    cl_uint height;                     /**< Rows */
+    StripContext strip;                 /**< Device buffers of the level (OpenCL) */
+    NativeEdgeDetector* native;         /**< Detector of the level (native) */
+    cl_uchar* luma;                     /**< Decimated gaussian the level starts from (native) */
+    cl_uchar4* edges;                   /**< Edge map of the level */
+};
+
+/**
+* SweepPrefix
+* One gaussian of --sweep-sigma and the max output it leads to, which every
+* threshold pair of the sweep starts from
+*/
+
+struct SweepPrefix
+{
+    std::string name;                   /**< The sigma as given, for the output names */
+    float side;                         /**< Outer gaussian weight, 0.25 for the 1-2-1 filter */
+    cl_mem nmsBuffer;                   /**< Max output on the device (OpenCL) */
+    cl_uchar* nmsPlane;                 /**< Max output (native) */
+};
+
+/**
+* SweepThresholds
+* One low/high pair of --sweep-thresholds
+*/
+
+struct SweepThresholds
+{
+    cl_uint low;                        /**< <= low is not an edge */
+    cl_uint high;                       /**< >= high is an edge */
+};
+
+/**
+* EdgeOutput
+* Results a caller can ask for with requestOutput(), besides the edge map
+*/
+
+enum EdgeOutput
+{
+    EDGE_OUTPUT_SMOOTHED,               /**< Gaussian output */
+    EDGE_OUTPUT_MAGNITUDE,              /**< Sobel magnitude */
+    EDGE_OUTPUT_DIRECTION,              /**< Sobel direction, see getDirectionScale() */
+    EDGE_OUTPUT_NMS,                    /**< Max (non-maximum suppression) output */
+    EDGE_OUTPUT_EDGES,                  /**< Hysteresis output, the edge map */
+    EDGE_OUTPUT_COUNT
+};
+
+// Names of the EdgeOutput values in --outputs and in the output file names
+static const char* const EDGE_OUTPUT_NAMES[EDGE_OUTPUT_COUNT] =
+{
+    "smoothed", "magnitude", "direction", "nms", "edges"
+};
+
+// Per stage tolerance (max abs error) of --verify and --canary
+#define VERIFY_TOL_GREY 1
+#define VERIFY_TOL_GAUSSIAN 1
+#define VERIFY_TOL_SOBEL 1
+#define VERIFY_TOL_THETA 0
+#define VERIFY_TOL_MAX 1
+#define VERIFY_TOL_HYST 0
+// Fraction of pixels allowed outside tolerance (atan2/sqrt rounding at bucket edges)
+#define VERIFY_MISMATCH_RATE 0.001
+
 /**
 * EdgeDetector
 * Class implements OpenCL Sobel Filter sample
@@ -52,8 +197,97 @@ class EdgeDetector
 		cl_kernel kernelSobel;
 		cl_kernel kernelMax;
 		cl_kernel kernelHyst;
+        cl_kernel kernelDecimate;           /**< gaussian_decimate, for --pyramid */
+        cl_kernel kernelSobelMax;           /**< sobel_max_filter or sobel_max_code_filter, for --fused */
+        cl_kernel kernelGausBorder;         /**< gaussian_border, for --border */
+        cl_kernel kernelSobelBorder;        /**< sobel_border, for --border */
+        cl_kernel kernelMaxBorder;          /**< max_border, for --border */
+        cl_program programCompact;          /**< Compaction program, for --edge-list and --packed-output */
+        cl_kernel kernelCount;              /**< edge_count */
+        cl_kernel kernelScan;               /**< edge_scan */
+        cl_kernel kernelScatter;            /**< edge_scatter */
+        cl_mem groupCountBuffer;            /**< Edges per work-group, then their offsets and the total */
+        cl_mem pointBuffer;                 /**< Edge records on the device */
+        size_t compactGroupSize;            /**< Work-group size of the compaction kernels */
+        cl_kernel kernelPack;               /**< edge_pack */
+        cl_mem packedBuffer;                /**< Edge map packed 1 bit per pixel on the device */
+        cl_program programFlat;             /**< Tile classification program, for --flat-threshold */
+        cl_kernel kernelTileRange;          /**< tile_range */
+        cl_kernel kernelTileLists;          /**< tile_lists */
+        cl_kernel kernelTileZero;           /**< tile_zero */
+        cl_mem tileRangeBuffer;             /**< Luminance range of each tile */
+        cl_mem tileCountBuffer;             /**< Entries of runTileBuffer and flatTileBuffer */
+        cl_mem runTileBuffer;               /**< Tiles the stages run over */
+        cl_mem flatTileBuffer;              /**< Tiles written as zero */
+        size_t flatGroupSize;               /**< Work-group size of tile_range */
+        cl_uint tileCounts[2];              /**< Tiles run and tiles written as zero in the last frame */
 		//cl_kernel kernel;
         SDKBitMap inputBitmap;   /**< Bitmap class object */
+        MappedBitMap* mappedInput;          /**< File mapping inputImageData points into, if any */
+        PlanarImage* planarInput;           /**< PGM, PPM or raw image inputImageData points into, if any */
+        cl_uint imagePitch;                 /**< Pixels from one row of inputImageData and outputImageData to the next */
+        bool inputTopDown;                  /**< Input rows are top to bottom (not BMP order) */
+        std::string inputFile;              /**< Cmd Line Option- input image, BMP, PGM, PPM or raw */
+        std::string outputFile;             /**< Cmd Line Option- output image, BMP, PGM, PPM or raw */
+        int rawWidth;                       /**< Cmd Line Option- width of raw input */
+        int rawHeight;                      /**< Cmd Line Option- height of raw input */
+        int rawStride;                      /**< Cmd Line Option- bytes per raw input row, 0 = width */
+        std::string videoFormat;            /**< Cmd Line Option- y4m, i420 or nv12 from stdin to stdout */
+        int incrementalRows;                /**< Cmd Line Option- rows per tile compared between video frames, 0 = off */
+        std::string regionList;             /**< Cmd Line Option- x,y,w,h regions separated by ':' */
+        std::vector<ImageRegion> regions;   /**< Regions to process, empty for the whole image */
+        int pyramidLevels;                  /**< Cmd Line Option- levels including full resolution, 0 = off */
+        bool pyramidFuse;                   /**< Cmd Line Option- coarsest level gates the full resolution tiles */
+        std::vector<PyramidLevel> pyramid;  /**< Levels, finest first */
+        std::vector<ImageRegion> gatedRegions; /**< Full resolution tiles the last fused run processed */
+        double gatedFraction;               /**< Share of the image in gatedRegions */
+        bool edgeListMode;                  /**< Cmd Line Option- read back a list of edge pixels, not the edge map */
+        cl_ushort4* edgePoints;             /**< x, y, direction and 0 of each edge pixel, raster order */
+        cl_uint edgeCount;                  /**< Entries of edgePoints */
+        bool packedOutput;                  /**< Cmd Line Option- read back the edge map packed 1 bit per pixel */
+        cl_uchar* packedEdges;              /**< Edge map, 1 bit per pixel, first pixel in the top bit of each byte */
+        std::string arithmetic;             /**< Cmd Line Option- auto, float or fixed kernel arithmetic */
+        std::string directionMode;          /**< Cmd Line Option- atan2 (sobel_filter) or tangent (sobel_direction) */
+        bool tangentDirection;              /**< sobel_direction and Max_code_filter replace sobel_filter and Max_filter */
+        bool fusedNms;                      /**< Cmd Line Option- one kernel for sobel and max, no magnitude or theta in global memory */
+        std::string intermediateLayout;     /**< Cmd Line Option- split (uchar4 magnitude, uchar theta) or packed sobel output */
+        bool packedGradient;                /**< Sobel writes magnitude << 2 | direction code as one ushort to thetaBuffer */
+        size_t thetaBytes;                  /**< Bytes per pixel of thetaBuffer */
+        size_t imageBufferBytes;            /**< Bytes allocated for nextBuffer and prevBuffer */
+        size_t thetaBufferBytes;            /**< Bytes allocated for thetaBuffer */
+        bool fixedFilters;                  /**< gaussian_filter and sobel_filter in integers */
+        bool exactLuma;                     /**< greyscale_filter in integers */
+        bool halfFilters;                   /**< gaussian_filter and sobel_filter in half precision (cl_khr_fp16) */
+        std::string arithmeticFlags;        /**< Build options selecting the arithmetic of the kernels */
+        bool fastMath;                      /**< Cmd Line Option- relaxed float math and a cheaper sobel magnitude */
+        std::string fastMagnitude;          /**< Cmd Line Option- sqrt (native_sqrt) or l1 (|Gx| + |Gy|) magnitude of --fast-math */
+        std::string mathFlags;              /**< Build options of --fast-math, given to every program */
+        std::string borderName;             /**< Cmd Line Option- legacy, clamp, mirror, zero or skip */
+        NativeBorderMode borderMode;        /**< Reads outside the image of gaussian, sobel and max */
+        bool specialize;                    /**< Cmd Line Option- build the kernels for the size of the image */
+        std::string geometryFlags;          /**< -D WIDTH and -D HEIGHT of specialized kernels, empty = generic */
+        std::string programCache;           /**< Cmd Line Option- directory of built program binaries, empty = off */
+        int flatThreshold;                  /**< Cmd Line Option- largest luminance range of a skipped tile, -1 = off */
+        size_t skippedTiles;                /**< Tiles skipped over all frames */
+        int flatFrames;                     /**< Frames classified into tiles */
+        std::string sweepSigmaList;         /**< Cmd Line Option- gaussian sigmas of --sweep, 0 = 1-2-1 */
+        std::string sweepThresholdList;     /**< Cmd Line Option- low/high pairs of --sweep */
+        std::vector<SweepPrefix> sweepPrefixes; /**< Parsed sigmas and their max outputs */
+        std::vector<SweepThresholds> sweepThresholds; /**< Parsed threshold pairs */
+        std::vector<cl_mem> sweepOutputBuffers; /**< Hysteresis output of each pair on the device */
+        std::vector<cl_uchar4*> sweepOutputs; /**< Edge map of each pair of the current sigma */
+        cl_kernel kernelGausWeighted;       /**< gaussian_weighted, for --sweep-sigma */
+        cl_kernel kernelHystThreshold;      /**< Hyst_threshold_filter, for --sweep-thresholds */
+        std::string outputList;             /**< Cmd Line Option- outputs to keep, names of EDGE_OUTPUT_NAMES */
+        bool outputRequested[EDGE_OUTPUT_COUNT]; /**< Outputs asked for by --outputs or requestOutput() */
+        cl_mem outputBuffers[EDGE_OUTPUT_COUNT]; /**< Copy of each requested intermediate on the device */
+        cl_uchar* mappedOutputs[EDGE_OUTPUT_COUNT]; /**< outputBuffers mapped for the host until the next run */
+        size_t packedRowBytes;              /**< Bytes per row of packedEdges, a multiple of 4 */
+        cl_uchar* previousInput;            /**< Input rows of the previous video frame */
+        NativeInputFormat inputFormat;      /**< Layout of inputImageData */
+        cl_uint inputPixelBytes;            /**< Bytes per pixel of inputImageData */
+        cl_uchar4 inputPalette[256];        /**< R, G, B, A palette of 8 bit input */
+        cl_mem paletteBuffer;               /**< inputPalette on the device */
         uchar4* pixelData;       /**< Pointer to image data */
         cl_uint pixelSize;                  /**< Size of a pixel in BMP format> */
         cl_uint width;                      /**< Width of image */
@@ -73,6 +307,20 @@ class EdgeDetector
 
         SDKTimer    *sampleTimer;      /**< SDKTimer object */
 
+        NativeEdgeDetector nativeDetector;  /**< Host backend used for --device native */
+        int threads;                        /**< Native backend threads, 0 for all cores */
+        NativeEdgeDetector nativeReference; /**< Reference for --verify and --canary */
+        bool referenceReady;                /**< nativeReference has been set up */
+        int canaryPeriod;                   /**< Verify one in canaryPeriod timed frames, 0 = off */
+        int canaryStart;                    /**< First frame checked, random in [0, canaryPeriod) */
+        int canaryFrames;                   /**< Frames checked by the canary */
+        int canaryFailures;                 /**< Canary frames outside tolerance */
+        int forcedTileRows;                 /**< Cmd Line Option- strip height, 0 = from device limits */
+        size_t tileRows;                    /**< Rows owned by each strip, 0 = whole image at once */
+        StripContext tiles[2];              /**< Queues and buffers of the two strips in flight */
+        bool streaming;                     /**< Cmd Line Option- process the BMP strip by strip */
+        bool greyOutput;                    /**< Cmd Line Option- write an 8 bit greyscale BMP */
+
 
     public:
 
@@ -111,9 +359,93 @@ class EdgeDetector
             sampleTimer = new SDKTimer();
             pixelSize = sizeof(uchar4);
             pixelData = NULL;
+            mappedInput = NULL;
+            planarInput = NULL;
+            imagePitch = 0;
+            inputTopDown = false;
+            rawWidth = 0;
+            rawHeight = 0;
+            rawStride = 0;
+            incrementalRows = 0;
+            previousInput = NULL;
+            pyramidLevels = 0;
+            pyramidFuse = false;
+            gatedFraction = 0;
+            kernelDecimate = NULL;
+            kernelSobelMax = NULL;
+            kernelGausBorder = NULL;
+            kernelSobelBorder = NULL;
+            kernelMaxBorder = NULL;
+            programCompact = NULL;
+            kernelCount = NULL;
+            kernelScan = NULL;
+            kernelScatter = NULL;
+            groupCountBuffer = NULL;
+            pointBuffer = NULL;
+            compactGroupSize = 0;
+            edgeListMode = false;
+            edgePoints = NULL;
+            edgeCount = 0;
+            kernelPack = NULL;
+            packedBuffer = NULL;
+            packedOutput = false;
+            packedEdges = NULL;
+            packedRowBytes = 0;
+            programFlat = NULL;
+            kernelTileRange = NULL;
+            kernelTileLists = NULL;
+            kernelTileZero = NULL;
+            tileRangeBuffer = NULL;
+            tileCountBuffer = NULL;
+            runTileBuffer = NULL;
+            flatTileBuffer = NULL;
+            flatGroupSize = 0;
+            tileCounts[0] = tileCounts[1] = 0;
+            flatThreshold = -1;
+            skippedTiles = 0;
+            flatFrames = 0;
+            kernelGausWeighted = NULL;
+            kernelHystThreshold = NULL;
+            for (int o = 0; o < EDGE_OUTPUT_COUNT; o++)
+            {
+                outputRequested[o] = false;
+                outputBuffers[o] = NULL;
+                mappedOutputs[o] = NULL;
+            }
+            arithmetic = "auto";
+            directionMode = "atan2";
+            tangentDirection = false;
+            fusedNms = false;
+            intermediateLayout = "split";
+            packedGradient = false;
+            thetaBytes = sizeof(cl_uchar);
+            imageBufferBytes = 0;
+            thetaBufferBytes = 0;
+            fixedFilters = false;
+            exactLuma = false;
+            halfFilters = false;
+            fastMath = false;
+            borderName = "legacy";
+            borderMode = NATIVE_BORDER_LEGACY;
+            fastMagnitude = "sqrt";
+            specialize = false;
+            programCache = "";
+            inputFormat = NATIVE_INPUT_RGBA;
+            inputPixelBytes = sizeof(cl_uchar4);
+            paletteBuffer = NULL;
             blockSizeX = GROUP_SIZE;
             blockSizeY = 1;
             iterations = 1;
+            threads = 0;
+            referenceReady = false;
+            canaryPeriod = 0;
+            canaryStart = 0;
+            canaryFrames = 0;
+            canaryFailures = 0;
+            forcedTileRows = 0;
+            tileRows = 0;
+            streaming = false;
+            greyOutput = false;
 			
         }
 
@@ -144,904 +476,4652 @@ class EdgeDetector
         int runCLKernels();
 
         /**
-        * Reference CPU implementation of Binomial Option
-        * for performance comparison
+        * Run one pass of the pipeline on the selected backend
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
         */
-        void EdgeDetectorCPUReference();
+        int runKernels();
 
         /**
-        * Override from SDKSample. Print sample stats.
+        * Restrict processing to a region of the image; call before setup().
+        * Output pixels outside every region are not computed.
+        * @param region rectangle in pixels from the top left of the picture,
+        * clipped to the processed area
         */
-        void printStats();
+        void addRegion(const ImageRegion& region) { regions.push_back(region); }
+
+        void clearRegions() { regions.clear(); }
 
         /**
-        * Override from SDKSample. Initialize
-        * command line parser, add custom options
+        * Add the --roi regions and clip all regions to the processed area
         * @return SDK_SUCCESS on success and SDK_FAILURE on failure
         */
-        int initialize();
+        int setupRegions();
 
         /**
-         * Override from SDKSample, Generate binary image of given kernel
-         * and exit application
+        * Resolve --arithmetic for the selected device: auto runs the bit-exact
+        * integer gaussian and sobel on CPU devices and the half precision ones on
+        * other devices with cl_khr_fp16, fixed also the integer greyscale.
+        * Also checks --direction and --intermediate
+        * @param cpuDevice the device is a CPU (or native)
+        * @param halfDevice the device has cl_khr_fp16
         * @return SDK_SUCCESS on success and SDK_FAILURE on failure
-         */
-        int genBinaryImage();
+        */
+        int setupArithmetic(bool cpuDevice, bool halfDevice);
 
         /**
-        * Override from SDKSample, adjust width and height
-        * of execution domain, perform all sample setup
+        * Build one of the stage programs, through the --program-cache directory if set.
+        * Cached binaries are keyed by the kernel source, the build options (which carry
+        * the image size of specialized kernels) and the device and driver.
+        * @param program built program
+        * @param buildData kernel file and build options
         * @return SDK_SUCCESS on success and SDK_FAILURE on failure
         */
-        int setup();
+        int buildStageProgram(cl_program& program, const buildProgramData& buildData);
 
         /**
-        * Override from SDKSample
-        * Run OpenCL Sobel Filter
+        * Run the pipeline over each region and the halo it depends on
+        * @param list regions in processed (buffer) rows
         * @return SDK_SUCCESS on success and SDK_FAILURE on failure
         */
-        int run();
+        int runRegions(const std::vector<ImageRegion>& list);
 
         /**
-        * Override from SDKSample
-        * Cleanup memory allocations
+        * Clear a reference image outside some regions, which the output
+        * must leave zero
+        * @param reference width * height pixels
+        * @param list regions whose reference pixels are kept
+        */
+        void maskToRegions(cl_uchar4* reference, const std::vector<ImageRegion>& list);
+
+        /**
+        * Allocate the levels of --pyramid below full resolution
         * @return SDK_SUCCESS on success and SDK_FAILURE on failure
         */
-        int cleanup();
+        int setupPyramid();
 
         /**
-        * Override from SDKSample
-        * Verify against reference implementation
+        * Build the pyramid and detect edges on every level, or with
+        * --pyramid-fuse only on the full resolution tiles the coarsest level gates
         * @return SDK_SUCCESS on success and SDK_FAILURE on failure
         */
-        int verifyResults();
+        int runPyramid();
 
+        /**
+        * Full resolution tiles near an edge of the coarsest level, into gatedRegions
+        */
+        void gatePyramid();
 
+        /**
+        * Release the levels below full resolution
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int cleanupPyramid();
 
-		int GreyScale();
+        /**
+        * Build Compact_Kernels.cl once for --edge-list and --packed-output
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int buildCompactProgram();
 
-		int Gaussian();
+        /**
+        * Build the compaction kernels and buffers of --edge-list
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int setupEdgeList();
 
-		int Sobel();
+        /**
+        * Build the packing kernel and buffers of --packed-output
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int setupPackedOutput();
 
-		int Hysteresis();
+        /**
+        * Pack the edge map of a whole image strip on the device and read back only the bits
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int readPackedEdges(const StripContext& strip);
 
-		int Max();
+        /**
+        * Pack outputImageData into packedEdges on the host (native device)
+        */
+        void packEdges();
 
-		//inline cl_mem& NextBuff() { return buffers_[buffer_index_]; }
+        /**
+        * Redraw outputImageData from packedEdges, for writing and verification
+        */
+        void unpackEdges();
 
-		//inline cl_mem& PrevBuff() { return buffers_[buffer_index_ ^ 1]; }
+        /**
+        * Release the packing kernel and buffers
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int cleanupPackedOutput();
 
-		//inline void AdvanceBuff() { buffer_index_ ^= 1; }
-};
+        /**
+        * Build the tile classification kernels and buffers of --flat-threshold
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int setupFlatTiles();
 
-int
-EdgeDetector::readInputImage(std::string inputImageName)
-{
+        /**
+        * Classify the tiles from the greyscale in strip.prevBuffer and point the strip
+        * at the tiles the later stages run over; reads back only the two tile counts
+        * @param strip whole image strip, its tileList and tileCount are set
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int classifyTiles(StripContext& strip);
 
-	// load input bitmap image
-	inputBitmap.load(inputImageName.c_str());
+        /**
+        * Write the flat tiles of the hysteresis output as zero
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int zeroFlatTiles(const StripContext& strip);
 
-	// error if image did not load
-	if (!inputBitmap.isLoaded())
-	{
-		std::cout << "Failed to load input image!";
-		return SDK_FAILURE;
-	}
+        /**
+        * Release the tile classification kernels and buffers
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int cleanupFlatTiles();
 
+        /**
+        * Parse the sweep lists and set up a max output per sigma and an edge map per pair
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int setupSweep();
 
-	// get width and height of input image
-	height_original = inputBitmap.getHeight();
-	width_original = inputBitmap.getWidth();
-	height = ((height_original) / GROUP_SIZE) * GROUP_SIZE;
-	width = ((width_original) / GROUP_SIZE) * GROUP_SIZE;
-	// allocate memory for input & output image data
-	inputImageData = (cl_uchar4*)malloc(width_original * height_original * sizeof(cl_uchar4));
-	CHECK_ALLOCATION(inputImageData, "Failed to allocate memory! (inputImageData)");
+        /**
+        * Enqueue gaussian_weighted with the outer weight of a sigma
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int GaussianWeighted(const StripContext& strip, float side);
 
-	outputImageData = (cl_uchar4*)malloc(width_original * height_original * sizeof(cl_uchar4));
+        /**
+        * Release the sweep kernels and buffers
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int cleanupSweep();
 
-	pixelData = inputBitmap.getPixels();
-	if (pixelData == NULL)
-	{
-		std::cout << "Failed to read pixel Data!";
-		return SDK_FAILURE;
-	}
+        /**
+        * Add the --outputs names to the requested outputs and allocate a device
+        * copy of each requested intermediate
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int setupOutputs();
 
-	// Copy pixel data into inputImageData
-	memcpy(inputImageData, pixelData, width_original * height_original * pixelSize);
-	// allocate memory for verification output
-	verificationOutput = (cl_uchar*)malloc(width_original * height_original * pixelSize);
-	CHECK_ALLOCATION(verificationOutput,
-		"verificationOutput heap allocation failed!");
+        /**
+        * Enqueue a copy of the stage output in buffer to the requested output
+        * @param output intermediate the buffer holds
+        * @param buffer stage output on the device
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int keepOutput(EdgeOutput output, cl_mem buffer);
 
-	// initialize the data to NULL
-	memset(verificationOutput, 0, width_original * height_original * pixelSize);
+        /**
+        * Read the edge map of a whole image strip and map every requested
+        * intermediate, all without blocking, then wait for them at once
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int mapOutputs(const StripContext& strip);
 
-	return SDK_SUCCESS;
-}
+        /**
+        * Give the mapped outputs back to the device before they are written again
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int unmapOutputs();
 
-int
-EdgeDetector::readInputImage(SDKBitMap inputImage)
-{
+        /**
+        * Write each requested intermediate next to the edge map as <name>_<output>
+        * @param outputImageName name of the edge map file
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int writeOutputs(std::string outputImageName);
 
-	// load input bitmap image
-	inputBitmap = inputImage;
+        /**
+        * Unmap and release the output copies
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int cleanupOutputs();
 
-	// error if image did not load
-	if (!inputBitmap.isLoaded())
-	{
-		std::cout << "Failed to load input image!";
-		return SDK_FAILURE;
-	}
+        /**
+        * Compact the edge map of a whole image strip on the device and read
+        * back only the number of edges and their records
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int readEdgeList(const StripContext& strip);
 
+        /**
+        * Redraw outputImageData from the edge list, for writing and verification
+        */
+        void expandEdgeList();
 
-	// get width and height of input image
-	height_original = inputBitmap.getHeight();
-	width_original = inputBitmap.getWidth();
-	height = ((height_original) / GROUP_SIZE) * GROUP_SIZE;
-	width = ((width_original) / GROUP_SIZE) * GROUP_SIZE;
-	// allocate memory for input & output image data
-	inputImageData = (cl_uchar4*)malloc(width_original * height_original * sizeof(cl_uchar4));
-	CHECK_ALLOCATION(inputImageData, "Failed to allocate memory! (inputImageData)");
+        /**
+        * Write the edge list as text, one x,y,direction line per edge with
+        * rows counted from the top of the picture
+        * @param outputImageName name of the output file
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int writeEdgeList(std::string outputImageName);
 
-	outputImageData = (cl_uchar4*)malloc(width_original * height_original * sizeof(cl_uchar4));
+        /**
+        * Release the compaction kernels and buffers
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int cleanupEdgeList();
 
-	pixelData = inputBitmap.getPixels();
-	if (pixelData == NULL)
-	{
-		std::cout << "Failed to read pixel Data!";
-		return SDK_FAILURE;
-	}
+        /**
+        * Write packedEdges as a 1 bit BMP or a PBM, chosen by extension
+        * @param outputImageName name of the output file
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int writePackedImage(std::string outputImageName);
 
-	// Copy pixel data into inputImageData
-	memcpy(inputImageData, pixelData, width_original * height_original * pixelSize);
-	// allocate memory for verification output
-	verificationOutput = (cl_uchar*)malloc(width_original * height_original * pixelSize);
-	CHECK_ALLOCATION(verificationOutput,
-		"verificationOutput heap allocation failed!");
+        /**
+        * Write an edge map as BMP, PGM, PBM, PPM or raw, chosen by extension
+        * @param outputImageName name of the output file
+        * @param pixels imageHeight rows of rowPitch pixels
+        * @param rowPitch pixels per source row; missing columns are written black
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int writeImage(std::string outputImageName, const cl_uchar4* pixels, cl_uint imageWidth,
+            cl_uint imageHeight, cl_uint rowPitch);
 
-	// initialize the data to NULL
-	memset(verificationOutput, 0, width_original * height_original * pixelSize);
+        /**
+        * Detect edges of a BMP strip by strip, holding only a few strips in
+        * memory; does setup() and run() for the strip geometry
+        * @param inputImageName name of the input file
+        * @param outputImageName name of the output file
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int runStream(std::string inputImageName, std::string outputImageName);
 
-	return SDK_SUCCESS;
+        bool isStreaming() const { return streaming; }
 
-}
+        /**
+        * Detect edges of every frame of a video read from stdin and write
+        * them to stdout in the same layout; does setup() once for all frames
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int runVideo();
 
-int
-EdgeDetector::readInputImage(uchar4* inputPixels, cl_uint o_heigth, cl_uint o_weidth)
-{
+        bool isVideo() const { return !videoFormat.empty(); }
 
+        /**
+        * Detect edges for every gaussian sigma and threshold pair of the sweep.
+        * Each sigma runs greyscale to max once, keeping the max output; every
+        * pair reruns only hysteresis from it. Writes <name>_sigma<s>_<low>-<high>
+        * next to the output name and prints the timing of both phases.
+        * @param outputImageName name of the output file
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int runSweep(std::string outputImageName);
 
-	// get width and height of input image
-	height_original = o_heigth;
+        bool isSweep() const { return !sweepSigmaList.empty() || !sweepThresholdList.empty(); }
+
+        /**
+        * Keep an intermediate of every run for the caller; call before setup().
+        * The gaussian, magnitude, direction and max outputs are copied aside on
+        * the device and mapped together with the edge map read, so a run still
+        * waits for the device once.
+        * @param output result to keep
+        */
+        void requestOutput(EdgeOutput output) { outputRequested[output] = true; }
+
+        /**
+        * An intermediate is requested besides the edge map
+        */
+        bool hasOutputs() const
+        {
+            return outputRequested[EDGE_OUTPUT_SMOOTHED] || outputRequested[EDGE_OUTPUT_MAGNITUDE] ||
+                outputRequested[EDGE_OUTPUT_DIRECTION] || outputRequested[EDGE_OUTPUT_NMS];
+        }
+
+        /**
+        * A requested output of the last run, width * height pixels in the layout
+        * of the edge map; valid until the next run() or cleanup()
+        * @param output requested result
+        * @param stride receives the bytes from one pixel to the next, the value
+        * being the first byte
+        * @return the first pixel, NULL if the output was not requested
+        */
+        const cl_uchar* getOutput(EdgeOutput output, cl_uint* stride) const;
+
+        /**
+        * Degrees per unit of EDGE_OUTPUT_DIRECTION: 45 for the codes of
+        * --direction tangent on a device, 1 for degrees (0, 45, 90, 135)
+        */
+        cl_uint getDirectionScale() const
+        {
+            return tangentDirection && !sdkContext->isNativeDevice() ? 45 : 1;
+        }
+
+        /**
+        * Input image path: --input, or INPUT_IMAGE next to the executable
+        */
+        std::string getInputPath() const
+        {
+            return inputFile.empty() ? getPath() + std::string(INPUT_IMAGE) : inputFile;
+        }
+
+        /**
+        * Output image path: --output, or OUTPUT_IMAGE
+        */
+        std::string getOutputPath() const
+        {
+            return outputFile.empty() ? std::string(OUTPUT_IMAGE) : outputFile;
+        }
+
+        /**
+        * Reference CPU implementation of Binomial Option
+        * for performance comparison
+        */
+        void EdgeDetectorCPUReference();
+
+        /**
+        * Override from SDKSample. Print sample stats.
+        */
+        void printStats();
+
+        /**
+        * Override from SDKSample. Initialize
+        * command line parser, add custom options
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int initialize();
+
+        /**
+         * Override from SDKSample, Generate binary image of given kernel
+         * and exit application
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+         */
+        int genBinaryImage();
+
+        /**
+        * Override from SDKSample, adjust width and height
+        * of execution domain, perform all sample setup
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int setup();
+
+        /**
+        * Override from SDKSample
+        * Run OpenCL Sobel Filter
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int run();
+
+        /**
+        * Override from SDKSample
+        * Cleanup memory allocations
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int cleanup();
+
+        /**
+        * Override from SDKSample
+        * Verify against reference implementation
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int verifyResults();
+
+        /**
+        * Set up the native reference once; scalar when the device is native itself
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int setupReference();
+
+        /**
+        * Compare one stage with the reference and print the result
+        * @param stage name printed in the report
+        * @param reference reference plane, one byte per element
+        * @param test data under test
+        * @param count number of elements
+        * @param testStride bytes per element of test
+        * @param bytesPerPixel elements per pixel, to locate the first mismatch
+        * @param tolerance largest absolute difference still accepted
+        * @param report print the result even when the stage passes
+        * @return SDK_SUCCESS if within tolerance and SDK_FAILURE otherwise
+        */
+        int checkStage(const char* stage, const cl_uchar* reference, const cl_uchar* test,
+            size_t count, cl_uint testStride, cl_uint bytesPerPixel, cl_uchar tolerance, bool report);
+
+        /**
+        * Print precision, recall and F1 of the edge pixels of an output edge map
+        * against a reference edge map
+        * @param reference reference edge map, pixelSize bytes per pixel
+        * @param test edge map under test, pixelSize bytes per pixel
+        * @param pixels number of pixels
+        */
+        void reportEdgeAccuracy(const cl_uchar* reference, const cl_uchar* test, size_t pixels);
+
+        /**
+        * Blocking read of an intermediate buffer
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int readStage(cl_mem buffer, void* data, size_t size);
+
+        /**
+        * Compare the last output with the native reference (--canary)
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int canaryCheck();
+
+        /**
+        * Run canaryCheck() if frame is sampled, with timer paused around it
+        * @param frame index of the frame just processed
+        * @param timer handle of the running frame timer
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int canarySample(int frame, int timer);
+
+
+
+		int GreyScale(const StripContext& strip);
+
+		int Gaussian(const StripContext& strip);
+
+		int Sobel(const StripContext& strip);
+
+		int Hysteresis(const StripContext& strip);
+
+		int Max(const StripContext& strip);
+
+        /**
+        * Enqueue sobel and max, or the fused kernel that does both (--fused); the
+        * non-maximum suppressed magnitude ends up in nextBuffer, or prevBuffer when fused
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int SobelMax(const StripContext& strip);
+
+        /**
+        * Enqueue gaussian_decimate from the gaussian output of a level into the next coarser one
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int Decimate(const PyramidLevel& finer, const PyramidLevel& level);
+
+        /**
+        * Whole image buffers as a single strip
+        */
+        StripContext wholeImage();
+
+        /**
+        * Enqueue one stage over all pixels of a strip, or over the pixels of its tiles
+        * when it has a tile list
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int enqueueStage(const StripContext& strip, cl_kernel kernel);
+
+        /**
+        * Enqueue a 3x3 stage under a --border mode: the kernel over the interior, with a
+        * global offset of (1, 1), and its border kernel over the ring around it
+        * @param buffers the buffer arguments of both kernels, followed in the border
+        * kernel by width, height and the mode; the caller sets any further arguments
+        * @param bufferCount entries of buffers
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int enqueueBordered(const StripContext& strip, cl_kernel kernel, cl_kernel borderKernel,
+            const cl_mem* buffers, cl_uint bufferCount);
+
+        /**
+        * Enqueue the upload of a strip's input rows to strip.inputBuffer
+        * @param strip destination strip
+        * @param firstRow image row the strip starts at
+        * @param blocking wait until the copy is done
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int uploadInput(const StripContext& strip, size_t firstRow, cl_bool blocking);
+
+        /**
+        * Pick the strip height from the device allocation and memory limits
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int chooseTileRows();
+
+        /**
+        * Process output rows in overlapping strips, alternating two queues
+        * so the transfers of one strip overlap the kernels of the other.
+        * Without tiling the whole image buffers hold a single strip.
+        * @param firstRow first output row
+        * @param endRow end of the output rows
+        * @param firstColumn first output column
+        * @param endColumn end of the output columns
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int runCLTiles(size_t firstRow, size_t endRow, size_t firstColumn, size_t endColumn);
+
+        /**
+        * Compare the input with the previous video frame tile by tile and
+        * rerun only the rows reached by changed tiles (--incremental)
+        * @param dirtyTiles set to the number of changed tiles
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int runIncremental(size_t& dirtyTiles);
+
+        /**
+        * Rerun the pipeline for changed input rows, keeping the rest of outputImageData
+        * @param y0 first changed input row
+        * @param y1 end of the changed input rows
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int updateRows(size_t y0, size_t y1);
+
+		//inline cl_mem& NextBuff() { return buffers_[buffer_index_]; }
+
+		//inline cl_mem& PrevBuff() { return buffers_[buffer_index_ ^ 1]; }
+
+		//inline void AdvanceBuff() { buffer_index_ ^= 1; }
+};
+
+int
+EdgeDetector::readInputImage(std::string inputImageName)
+{
+
+	ImageFileType fileType = imageFileType(inputImageName);
+	if (fileType != IMAGE_FILE_BMP)
+	{
+		// PGM, PPM and raw planes are uploaded as they are read: 1 or 3 bytes per pixel
+		planarInput = new PlanarImage();
+		CHECK_ALLOCATION(planarInput, "Failed to allocate memory! (planarInput)");
+
+		bool loaded = fileType == IMAGE_FILE_RAW ?
+			planarInput->loadRaw(inputImageName.c_str(), rawWidth, rawHeight, rawStride) :
+			planarInput->loadPnm(inputImageName.c_str());
+		if (!loaded)
+		{
+			std::cout << "Failed to load input image!";
+			return SDK_FAILURE;
+		}
+
+		height_original = planarInput->getHeight();
+		width_original = planarInput->getWidth();
+
+		// The stages read rows the processed width apart
+		imagePitch = (width_original / GROUP_SIZE) * GROUP_SIZE;
+		planarInput->cropColumns(imagePitch);
+		inputImageData = (cl_uchar4*)planarInput->getData();
+		inputPixelBytes = planarInput->getChannels();
+		inputFormat = inputPixelBytes == 1 ? NATIVE_INPUT_LUMA : NATIVE_INPUT_RGB;
+		inputTopDown = true;
+	}
+	else
+	{
+		// map input bitmap image
+		mappedInput = new MappedBitMap();
+		CHECK_ALLOCATION(mappedInput, "Failed to allocate memory! (mappedInput)");
+
+		// error if image did not load
+		if (!mappedInput->load(inputImageName.c_str(), true))
+		{
+			std::cout << "Failed to load input image!";
+			return SDK_FAILURE;
+		}
+
+		height_original = mappedInput->getHeight();
+		width_original = mappedInput->getWidth();
+		imagePitch = width_original;
+
+		// 32 bit and unpadded 24/8 bit bottom-up files are used in place, anything else was converted once
+		inputImageData = (cl_uchar4*)mappedInput->getData();
+		inputPixelBytes = mappedInput->getPixelBytes();
+		if (inputPixelBytes == 3)
+		{
+			inputFormat = NATIVE_INPUT_BGR;
+		}
+		else if (inputPixelBytes == 1)
+		{
+			inputFormat = NATIVE_INPUT_INDEX8;
+			const ColorPalette* palette = mappedInput->getPalette();
+			for (int i = 0; i < 256; i++)
+			{
+				inputPalette[i].s[0] = palette[i].z;
+				inputPalette[i].s[1] = palette[i].y;
+				inputPalette[i].s[2] = palette[i].x;
+				inputPalette[i].s[3] = 0xff;
+			}
+		}
+		else
+		{
+			inputFormat = mappedInput->isBGRA() ? NATIVE_INPUT_BGRA : NATIVE_INPUT_RGBA;
+		}
+		inputTopDown = false;
+	}
+
+	// get width and height of input image
+	height = ((height_original) / GROUP_SIZE) * GROUP_SIZE;
+	width = ((width_original) / GROUP_SIZE) * GROUP_SIZE;
+
+	outputImageData = (cl_uchar4*)malloc(width_original * height_original * sizeof(cl_uchar4));
+	CHECK_ALLOCATION(outputImageData, "Failed to allocate memory! (outputImageData)");
+
+	// allocate memory for verification output
+	verificationOutput = (cl_uchar*)malloc(width_original * height_original * pixelSize);
+	CHECK_ALLOCATION(verificationOutput,
+		"verificationOutput heap allocation failed!");
+
+	// initialize the data to NULL
+	memset(verificationOutput, 0, width_original * height_original * pixelSize);
+
+	return SDK_SUCCESS;
+}
+
+int
+EdgeDetector::readInputImage(SDKBitMap inputImage)
+{
+
+	// load input bitmap image
+	inputBitmap = inputImage;
+
+	// error if image did not load
+	if (!inputBitmap.isLoaded())
+	{
+		std::cout << "Failed to load input image!";
+		return SDK_FAILURE;
+	}
+
+
+	// get width and height of input image
+	height_original = inputBitmap.getHeight();
+	width_original = inputBitmap.getWidth();
+	imagePitch = width_original;
+	height = ((height_original) / GROUP_SIZE) * GROUP_SIZE;
+	width = ((width_original) / GROUP_SIZE) * GROUP_SIZE;
+	// allocate memory for input & output image data
+	inputImageData = (cl_uchar4*)malloc(width_original * height_original * sizeof(cl_uchar4));
+	CHECK_ALLOCATION(inputImageData, "Failed to allocate memory! (inputImageData)");
+
+	outputImageData = (cl_uchar4*)malloc(width_original * height_original * sizeof(cl_uchar4));
+
+	pixelData = inputBitmap.getPixels();
+	if (pixelData == NULL)
+	{
+		std::cout << "Failed to read pixel Data!";
+		return SDK_FAILURE;
+	}
+
+	// Copy pixel data into inputImageData
+	memcpy(inputImageData, pixelData, width_original * height_original * pixelSize);
+	// allocate memory for verification output
+	verificationOutput = (cl_uchar*)malloc(width_original * height_original * pixelSize);
+	CHECK_ALLOCATION(verificationOutput,
+		"verificationOutput heap allocation failed!");
+
+	// initialize the data to NULL
+	memset(verificationOutput, 0, width_original * height_original * pixelSize);
+
+	return SDK_SUCCESS;
+
+}
+
+int
+EdgeDetector::readInputImage(uchar4* inputPixels, cl_uint o_heigth, cl_uint o_weidth)
+{
+
+
+	// get width and height of input image
+	height_original = o_heigth;
 	width_original = o_weidth;
+	imagePitch = width_original;
 	height = ((height_original) / GROUP_SIZE) * GROUP_SIZE;
 	width = ((width_original) / GROUP_SIZE) * GROUP_SIZE;
 	// allocate memory for input & output image data
 	inputImageData = (cl_uchar4*)malloc(width_original * height_original * sizeof(cl_uchar4));
 	CHECK_ALLOCATION(inputImageData, "Failed to allocate memory! (inputImageData)");
 
-	outputImageData = (cl_uchar4*)malloc(width_original * height_original * sizeof(cl_uchar4));
+	outputImageData = (cl_uchar4*)malloc(width_original * height_original * sizeof(cl_uchar4));
+
+	pixelData = inputPixels;
+	if (pixelData == NULL)
+	{
+		std::cout << "Failed to read pixel Data!";
+		return SDK_FAILURE;
+	}
+
+	// Copy pixel data into inputImageData
+	memcpy(inputImageData, pixelData, width_original * height_original * pixelSize);
+	// allocate memory for verification output
+	verificationOutput = (cl_uchar*)malloc(width_original * height_original * pixelSize);
+	CHECK_ALLOCATION(verificationOutput,
+		"verificationOutput heap allocation failed!");
+
+	// initialize the data to NULL
+	memset(verificationOutput, 0, width_original * height_original * pixelSize);
+
+	return SDK_SUCCESS;
+
+}
+
+
+int
+EdgeDetector::writeOutputImage(std::string outputImageName)
+{
+	if (edgeListMode)
+	{
+		size_t dot = outputImageName.find_last_of('.');
+		std::string ext = dot == std::string::npos ? "" : outputImageName.substr(dot);
+		if (ext == ".txt" || ext == ".csv")
+		{
+			return writeEdgeList(outputImageName);
+		}
+		expandEdgeList();
+	}
+
+	if (packedOutput)
+	{
+		// 1 bit formats take the packed rows as they are; anything else gets the edge map back
+		ImageFileType fileType = imageFileType(outputImageName);
+		if (fileType == IMAGE_FILE_BMP || fileType == IMAGE_FILE_PBM)
+		{
+			return writePackedImage(outputImageName);
+		}
+		unpackEdges();
+	}
+
+	if (writeImage(outputImageName, outputImageData, width_original, height_original, imagePitch) != SDK_SUCCESS)
+	{
+		return SDK_FAILURE;
+	}
+	if (hasOutputs() && writeOutputs(outputImageName) != SDK_SUCCESS)
+	{
+		return SDK_FAILURE;
+	}
+
+	// The other levels go next to it as <name>_level<n>.<extension>
+	if (pyramidFuse)
+	{
+		return SDK_SUCCESS;
+	}
+	size_t dot = outputImageName.find_last_of('.');
+	size_t slash = outputImageName.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+	{
+		dot = outputImageName.size();
+	}
+	for (size_t l = 1; l < pyramid.size(); l++)
+	{
+		std::string levelName = outputImageName.substr(0, dot) + "_level" + toString(l, std::dec) +
+			outputImageName.substr(dot);
+		if (writeImage(levelName, pyramid[l].edges, pyramid[l].width, pyramid[l].height,
+			pyramid[l].width) != SDK_SUCCESS)
+		{
+			return SDK_FAILURE;
+		}
+	}
+
+	return SDK_SUCCESS;
+}
+
+int
+EdgeDetector::writePackedImage(std::string outputImageName)
+{
+	if (imageFileType(outputImageName) == IMAGE_FILE_PBM)
+	{
+		if (!writePackedPbm(outputImageName.c_str(), packedEdges, width_original, height_original, height,
+			packedRowBytes, !inputTopDown))
+		{
+			std::cout << "Failed to write output image!";
+			return SDK_FAILURE;
+		}
+		return SDK_SUCCESS;
+	}
+
+	// Same size as the dense output; 0 byte source rows write the rows past the processed area blank
+	BitMapStripWriter writer;
+	if (!writer.open(outputImageName.c_str(), width_original, height_original, 1, inputTopDown) ||
+		!writer.writePackedRows(packedEdges, height, packedRowBytes) ||
+		!writer.writePackedRows(packedEdges, height_original - height, 0) ||
+		!writer.close())
+	{
+		std::cout << "Failed to write output image!";
+		return SDK_FAILURE;
+	}
+
+	return SDK_SUCCESS;
+}
+
+int
+EdgeDetector::writeImage(std::string outputImageName, const cl_uchar4* pixels, cl_uint imageWidth,
+	cl_uint imageHeight, cl_uint rowPitch)
+{
+	ImageFileType fileType = imageFileType(outputImageName);
+	if (fileType != IMAGE_FILE_BMP)
+	{
+		if (!writePlanarImage(outputImageName.c_str(), fileType, (const uchar4*)pixels,
+			imageWidth, imageHeight, rowPitch, !inputTopDown))
+		{
+			std::cout << "Failed to write output image!";
+			return SDK_FAILURE;
+		}
+		return SDK_SUCCESS;
+	}
+
+	// write the output bmp file in bulk
+	BitMapStripWriter writer;
+	if (!writer.open(outputImageName.c_str(), imageWidth, imageHeight, greyOutput ? 8 : 24,
+		inputTopDown) ||
+		!writer.writeRows((const uchar4*)pixels, imageHeight, rowPitch) ||
+		!writer.close())
+	{
+		std::cout << "Failed to write output image!";
+		return SDK_FAILURE;
+	}
+
+	return SDK_SUCCESS;
+}
+
+int
+EdgeDetector::writeOutputImage(SDKBitMap* outputImage)
+{
+	// copy output image data back to original pixel data
+	memcpy(pixelData, outputImageData,
+		width_original * height_original * pixelSize);
+
+	//inputBitmap.height = height;
+	//inputBitmap.width = width;
+	// write the output bmp file
+
+	outputImage = &inputBitmap;
+
+	return SDK_SUCCESS;
+}
+
+int
+EdgeDetector::writeOutputImage(uchar4* inputPixels)
+{
+	// copy output image data back to original pixel data
+	memcpy(inputPixels, outputImageData,
+		width_original * height_original * pixelSize);
+
+	return SDK_SUCCESS;
+}
+
+int
+EdgeDetector::genBinaryImage()
+{
+	bifData binaryData;
+	binaryData.kernelName = std::string(SOBEL_FILTER_KERNEL);
+	binaryData.flagsStr = "-I \"" + getPath() + KERNEL_INCLUDE_DIR + "\"";
+	if (sdkContext->isComplierFlagsSpecified())
+	{
+		binaryData.flagsFileName = std::string(sdkContext->flags.c_str());
+	}
+
+	binaryData.binaryName = std::string(sdkContext->dumpBinary.c_str());
+	int status = generateBinaryImage(binaryData, sdkContext);
+	return status;
+}
+
+
+int
+EdgeDetector::setupCL()
+{
+	cl_int status = CL_SUCCESS;
+	cl_device_type dType;
+
+	if (sdkContext->deviceType.compare("cpu") == 0)
+	{
+		dType = CL_DEVICE_TYPE_CPU;
+	}
+	else //deviceType = "gpu"
+	{
+		dType = CL_DEVICE_TYPE_GPU;
+		if (sdkContext->isThereGPU() == false)
+		{
+			std::cout << "GPU not found. Falling back to CPU device" << std::endl;
+			dType = CL_DEVICE_TYPE_CPU;
+		}
+	}
+
+	cl_platform_id platform = sdkContext->platforms[sdkContext->chosen_platform];
+
+	// Display available devices.
+	int retValue = displayDevices(platform, dType);
+	CHECK_ERROR(retValue, SDK_SUCCESS, "displayDevices() failed");
+	std::cout << "Selected Device: " << sdkContext->deviceId << std::endl;
+
+	// If we could find our platform, use it. Otherwise use just available platform.
+	cl_context_properties cps[3] =
+	{
+		CL_CONTEXT_PLATFORM,
+		(cl_context_properties)platform,
+		0
+	};
+
+	context = clCreateContextFromType(
+		cps,
+		dType,
+		NULL,
+		NULL,
+		&status);
+	CHECK_OPENCL_ERROR(status, "clCreateContextFromType failed.");
+
+	// getting device on which to run the sample
+	status = getDevices(context, &devices, sdkContext->deviceId,
+		sdkContext->isDeviceIdEnabled());
+	CHECK_ERROR(status, SDK_SUCCESS, "getDevices() failed");
+
+	{
+		// The block is to move the declaration of prop closer to its use
+		cl_command_queue_properties prop = 0;
+		commandQueue = clCreateCommandQueue(
+			context,
+			devices[sdkContext->deviceId],
+			prop,
+			&status);
+		CHECK_OPENCL_ERROR(status, "clCreateCommandQueue failed.");
+	}
+
+	//Set device info of given cl_device_id
+	retValue = deviceInfo.setDeviceInfo(devices[sdkContext->deviceId]);
+	CHECK_ERROR(retValue, 0, "SDKDeviceInfo::setDeviceInfo() failed");
+
+	retValue = setupArithmetic((deviceInfo.dType & CL_DEVICE_TYPE_CPU) != 0,
+		deviceInfo.extensions != NULL && strstr(deviceInfo.extensions, "cl_khr_fp16") != NULL);
+	CHECK_ERROR(retValue, SDK_SUCCESS, "setupArithmetic() failed");
+
+
+	retValue = chooseTileRows();
+	CHECK_ERROR(retValue, SDK_SUCCESS, "chooseTileRows() failed");
+
+	// The ring of a strip is mostly rows of its neighbours, not the image border
+	if (borderMode != NATIVE_BORDER_LEGACY && tileRows != 0)
+	{
+		std::cout << "--border needs whole-image launches; the image is processed in strips" << std::endl;
+		return SDK_FAILURE;
+	}
+	std::string borderFlags = borderMode != NATIVE_BORDER_LEGACY ? "-D BORDER_RING " : "";
+
+	// Stage programs include Stage_Common.h from the kernels directory
+	std::string includeFlags = "-I \"" + getPath() + KERNEL_INCLUDE_DIR + "\" ";
+
+	// Tiles are classified over the whole image and the stages launched per tile
+	std::string tileFlags = "";
+	if (flatThreshold >= 0)
+	{
+		if (tileRows != 0)
+		{
+			std::cout << "--flat-threshold needs whole-image launches; the image is processed in strips"
+				<< std::endl;
+			return SDK_FAILURE;
+		}
+		char flags[32];
+		sprintf(flags, "-D TILE_LIST=%u ", FLAT_TILE);
+		tileFlags = flags;
+	}
+
+	// Only whole-image launches have the image size; strips, regions and levels launch others.
+	// Tile launches have no size at all, so --flat-threshold always builds for the image.
+	geometryFlags = "";
+	if (flatThreshold >= 0)
+	{
+		char flags[64];
+		sprintf(flags, "-D WIDTH=%u -D HEIGHT=%u ", width, height);
+		geometryFlags = flags;
+	}
+	else if (specialize)
+	{
+		if (tileRows != 0 || !regions.empty() || pyramidLevels > 1 || incrementalRows > 0)
+		{
+			std::cout << "--specialize needs whole-image launches; building generic kernels" << std::endl;
+		}
+		else
+		{
+			char flags[64];
+			sprintf(flags, "-D WIDTH=%u -D HEIGHT=%u ", width, height);
+			geometryFlags = flags;
+		}
+	}
+
+	// Create and initialize memory objects
+	if (tileRows == 0)
+	{
+		// Set Presistent memory only for AMD platform
+		cl_mem_flags inMemFlags = CL_MEM_READ_ONLY;
+
+		// Create memory object for input Image (packed 24/8 bit pixels are uploaded here)
+		inputImageBuffer = clCreateBuffer(
+			context,
+			inMemFlags,
+			width_original * height_original * inputPixelBytes,
+			0,
+			&status);
+		CHECK_OPENCL_ERROR(status, "clCreateBuffer failed. (inputImageBuffer)");
+
+		// Create memory objects for output Image
+
+		cl_mem_flags copyInput = inputPixelBytes == pixelSize ? CL_MEM_COPY_HOST_PTR : 0;
+		nextImageBuffer = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR | copyInput,
+			width_original * height_original * pixelSize, copyInput ? inputImageData : NULL, &status);
+
+		prevImageBuffer = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
+			width_original * height_original * pixelSize, 0, &status);
+
+		thetaBuffer = clCreateBuffer(context,
+			CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
+			width * height * thetaBytes, 0, &status);
+		CHECK_OPENCL_ERROR(status, "clCreateBuffer failed. (thetaBuffer)");
+
+		imageBufferBytes = 2 * (size_t)width_original * height_original * pixelSize;
+		thetaBufferBytes = (size_t)width * height * thetaBytes;
+	}
+	else
+	{
+		size_t stripRows = tileRows + 2 * TILE_HALO;
+		if (stripRows > height)
+		{
+			stripRows = height;
+		}
+
+		for (int t = 0; t < 2; t++)
+		{
+			if (t == 0)
+			{
+				tiles[t].queue = commandQueue;
+			}
+			else
+			{
+				tiles[t].queue = clCreateCommandQueue(context, devices[sdkContext->deviceId], 0, &status);
+				CHECK_OPENCL_ERROR(status, "clCreateCommandQueue failed. (strip)");
+			}
+
+			tiles[t].nextBuffer = clCreateBuffer(context, CL_MEM_READ_WRITE,
+				stripRows * width * pixelSize, NULL, &status);
+			CHECK_OPENCL_ERROR(status, "clCreateBuffer failed. (strip nextBuffer)");
+
+			tiles[t].prevBuffer = clCreateBuffer(context, CL_MEM_READ_WRITE,
+				stripRows * width * pixelSize, NULL, &status);
+			CHECK_OPENCL_ERROR(status, "clCreateBuffer failed. (strip prevBuffer)");
+
+			tiles[t].thetaBuffer = clCreateBuffer(context, CL_MEM_READ_WRITE,
+				stripRows * width * thetaBytes, NULL, &status);
+			CHECK_OPENCL_ERROR(status, "clCreateBuffer failed. (strip thetaBuffer)");
+
+			tiles[t].inputBuffer = tiles[t].nextBuffer;
+			if (inputPixelBytes != pixelSize)
+			{
+				tiles[t].inputBuffer = clCreateBuffer(context, CL_MEM_READ_ONLY,
+					stripRows * width * inputPixelBytes, NULL, &status);
+				CHECK_OPENCL_ERROR(status, "clCreateBuffer failed. (strip inputBuffer)");
+			}
+
+			tiles[t].rows = 0;
+			tiles[t].firstColumn = 0;
+			tiles[t].columns = width;
+			tiles[t].tileList = NULL;
+			tiles[t].tileCount = 0;
+
+			imageBufferBytes += 2 * stripRows * width * pixelSize;
+			thetaBufferBytes += stripRows * width * thetaBytes;
+		}
+	}
+
+	if (inputFormat == NATIVE_INPUT_INDEX8)
+	{
+		paletteBuffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+			sizeof(inputPalette), inputPalette, &status);
+		CHECK_OPENCL_ERROR(status, "clCreateBuffer failed. (paletteBuffer)");
+	}
+
+	// create a CL program using the kernel source
+	buildProgramData buildDataGrey;
+	buildDataGrey.kernelName = std::string(GREYSCALE_KERNEL);
+	buildDataGrey.devices = devices;
+	buildDataGrey.deviceId = sdkContext->deviceId;
+	buildDataGrey.flagsStr = includeFlags + arithmeticFlags + mathFlags + geometryFlags;
+	if (sdkContext->isLoadBinaryEnabled())
+	{
+		buildDataGrey.binaryName = std::string(sdkContext->loadBinary.c_str());
+	}
+
+	if (sdkContext->isComplierFlagsSpecified())
+	{
+		buildDataGrey.flagsFileName = std::string(sdkContext->flags.c_str());
+	}
+
+	retValue = buildStageProgram(programGrey, buildDataGrey);
+	CHECK_ERROR(retValue, 0, "buildStageProgram() failed");
+
+	// get a kernel object handle for a kernel with the given name
+	const char* greyKernelName = "greyscale_filter";
+	switch (inputFormat)
+	{
+	case NATIVE_INPUT_BGRA:
+		greyKernelName = "greyscale_filter_bgra";
+		break;
+	case NATIVE_INPUT_BGR:
+		greyKernelName = "greyscale_filter_bgr";
+		break;
+	case NATIVE_INPUT_RGB:
+		greyKernelName = "greyscale_filter_rgb";
+		break;
+	case NATIVE_INPUT_INDEX8:
+		greyKernelName = "greyscale_filter_index8";
+		break;
+	case NATIVE_INPUT_LUMA:
+		greyKernelName = "greyscale_filter_luma";
+		break;
+	default:
+		break;
+	}
+	kernelGrey = clCreateKernel(
+		programGrey,
+		greyKernelName,
+		&status);
+	CHECK_OPENCL_ERROR(status, "clCreateKernel failed.");
+
+	status = kernelInfo.setKernelWorkGroupInfo(kernelGrey,
+		devices[sdkContext->deviceId]);
+	CHECK_ERROR(status, SDK_SUCCESS, "kernelInfo.setKernelWorkGroupInfo() failed");
+
+
+	if ((blockSizeX * blockSizeY) > kernelInfo.kernelWorkGroupSize)
+	{
+		if (!sdkContext->quiet)
+		{
+			std::cout << "Out of Resources!" << std::endl;
+			std::cout << "Group Size specified : "
+				<< blockSizeX * blockSizeY << std::endl;
+			std::cout << "Max Group Size supported on the kernel : "
+				<< kernelWorkGroupSize << std::endl;
+			std::cout << "Falling back to " << kernelInfo.kernelWorkGroupSize << std::endl;
+		}
+
+		// Three possible cases
+		if (blockSizeX > kernelInfo.kernelWorkGroupSize)
+		{
+			blockSizeX = kernelInfo.kernelWorkGroupSize;
+			blockSizeY = 1;
+		}
+	}
+
+	buildProgramData buildDataGaus;
+	buildDataGaus.kernelName = std::string(GAUSSIAN_KERNEL);
+	buildDataGaus.devices = devices;
+	buildDataGaus.deviceId = sdkContext->deviceId;
+	buildDataGaus.flagsStr = includeFlags + arithmeticFlags + mathFlags + geometryFlags + borderFlags + tileFlags;
+	if (sdkContext->isLoadBinaryEnabled())
+	{
+		buildDataGaus.binaryName = std::string(sdkContext->loadBinary.c_str());
+	}
+
+	if (sdkContext->isComplierFlagsSpecified())
+	{
+		buildDataGaus.flagsFileName = std::string(sdkContext->flags.c_str());
+	}
+
+	retValue = buildStageProgram(programGaus, buildDataGaus);
+	CHECK_ERROR(retValue, 0, "buildStageProgram() failed");
+
+	// get a kernel object handle for a kernel with the given name
+	kernelGaus = clCreateKernel(
+		programGaus,
+		"gaussian_filter",
+		&status);
+	CHECK_OPENCL_ERROR(status, "clCreateKernel failed.");
+
+	if (borderMode != NATIVE_BORDER_LEGACY)
+	{
+		kernelGausBorder = clCreateKernel(programGaus, "gaussian_border", &status);
+		CHECK_OPENCL_ERROR(status, "clCreateKernel failed. (gaussian_border)");
+	}
+
+	status = kernelInfo.setKernelWorkGroupInfo(kernelGaus,
+		devices[sdkContext->deviceId]);
+	CHECK_ERROR(status, SDK_SUCCESS, "kernelInfo.setKernelWorkGroupInfo() failed");
+
+
+	if ((blockSizeX * blockSizeY) > kernelInfo.kernelWorkGroupSize)
+	{
+		if (!sdkContext->quiet)
+		{
+			std::cout << "Out of Resources!" << std::endl;
+			std::cout << "Group Size specified : "
+				<< blockSizeX * blockSizeY << std::endl;
+			std::cout << "Max Group Size supported on the kernel : "
+				<< kernelWorkGroupSize << std::endl;
+			std::cout << "Falling back to " << kernelInfo.kernelWorkGroupSize << std::endl;
+		}
+
+		// Three possible cases
+		if (blockSizeX > kernelInfo.kernelWorkGroupSize)
+		{
+			blockSizeX = kernelInfo.kernelWorkGroupSize;
+			blockSizeY = 1;
+		}
+	}
+
+	buildProgramData buildDataSobel;
+	buildDataSobel.kernelName = std::string(SOBEL_FILTER_KERNEL);
+	buildDataSobel.devices = devices;
+	buildDataSobel.deviceId = sdkContext->deviceId;
+	buildDataSobel.flagsStr = includeFlags + arithmeticFlags + mathFlags + geometryFlags + borderFlags + tileFlags;
+	if (sdkContext->isLoadBinaryEnabled())
+	{
+		buildDataSobel.binaryName = std::string(sdkContext->loadBinary.c_str());
+	}
+
+	if (sdkContext->isComplierFlagsSpecified())
+	{
+		buildDataSobel.flagsFileName = std::string(sdkContext->flags.c_str());
+	}
+
+	retValue = buildStageProgram(programSobel, buildDataSobel);
+	CHECK_ERROR(retValue, 0, "buildStageProgram() failed");
+
+	// get a kernel object handle for a kernel with the given name
+	const char* sobelName = tangentDirection ? "sobel_direction" : "sobel_filter";
+	if (packedGradient)
+	{
+		sobelName = tangentDirection ? "sobel_packed_code_filter" : "sobel_packed_filter";
+	}
+	kernelSobel = clCreateKernel(
+		programSobel,
+		sobelName,
+		&status);
+	CHECK_OPENCL_ERROR(status, "clCreateKernel failed.");
+
+	if (borderMode != NATIVE_BORDER_LEGACY)
+	{
+		kernelSobelBorder = clCreateKernel(programSobel, "sobel_border", &status);
+		CHECK_OPENCL_ERROR(status, "clCreateKernel failed. (sobel_border)");
+	}
+
+	if (fusedNms)
+	{
+		kernelSobelMax = clCreateKernel(
+			programSobel,
+			tangentDirection ? "sobel_max_code_filter" : "sobel_max_filter",
+			&status);
+		CHECK_OPENCL_ERROR(status, "clCreateKernel failed. (sobel_max_filter)");
+
+		status = kernelInfo.setKernelWorkGroupInfo(kernelSobelMax,
+			devices[sdkContext->deviceId]);
+		CHECK_ERROR(status, SDK_SUCCESS, "kernelInfo.setKernelWorkGroupInfo() failed");
+
+		// The tile is sized for a whole FUSED_GROUP_SIZE square work-group
+		if (kernelInfo.kernelWorkGroupSize < FUSED_GROUP_SIZE * FUSED_GROUP_SIZE)
+		{
+			std::cout << "sobel_max_filter needs work-groups of " << FUSED_GROUP_SIZE * FUSED_GROUP_SIZE
+				<< "; running sobel and max separately" << std::endl;
+			status = clReleaseKernel(kernelSobelMax);
+			CHECK_OPENCL_ERROR(status, "clReleaseKernel failed.");
+			kernelSobelMax = NULL;
+			fusedNms = false;
+		}
+	}
+
+	status = kernelInfo.setKernelWorkGroupInfo(kernelSobel,
+		devices[sdkContext->deviceId]);
+	CHECK_ERROR(status, SDK_SUCCESS, "kernelInfo.setKernelWorkGroupInfo() failed");
+
+
+	if ((blockSizeX * blockSizeY) > kernelInfo.kernelWorkGroupSize)
+	{
+		if (!sdkContext->quiet)
+		{
+			std::cout << "Out of Resources!" << std::endl;
+			std::cout << "Group Size specified : "
+				<< blockSizeX * blockSizeY << std::endl;
+			std::cout << "Max Group Size supported on the kernel : "
+				<< kernelWorkGroupSize << std::endl;
+			std::cout << "Falling back to " << kernelInfo.kernelWorkGroupSize << std::endl;
+		}
+
+		// Three possible cases
+		if (blockSizeX > kernelInfo.kernelWorkGroupSize)
+		{
+			blockSizeX = kernelInfo.kernelWorkGroupSize;
+			blockSizeY = 1;
+		}
+	}
+
+	buildProgramData buildDataMax;
+	buildDataMax.kernelName = std::string(MAX_KERNEL);
+	buildDataMax.devices = devices;
+	buildDataMax.deviceId = sdkContext->deviceId;
+	buildDataMax.flagsStr = includeFlags + mathFlags + geometryFlags + borderFlags + tileFlags;
+	if (sdkContext->isLoadBinaryEnabled())
+	{
+		buildDataMax.binaryName = std::string(sdkContext->loadBinary.c_str());
+	}
+
+	if (sdkContext->isComplierFlagsSpecified())
+	{
+		buildDataMax.flagsFileName = std::string(sdkContext->flags.c_str());
+	}
+
+	retValue = buildStageProgram(programMax, buildDataMax);
+	CHECK_ERROR(retValue, 0, "buildStageProgram() failed");
+
+	// get a kernel object handle for a kernel with the given name
+	const char* maxName = tangentDirection ? "Max_code_filter" : "Max_filter";
+	if (packedGradient)
+	{
+		maxName = "Max_packed_filter";
+	}
+	kernelMax = clCreateKernel(
+		programMax,
+		maxName,
+		&status);
+	CHECK_OPENCL_ERROR(status, "clCreateKernel failed.");
+
+	if (borderMode != NATIVE_BORDER_LEGACY)
+	{
+		kernelMaxBorder = clCreateKernel(programMax, "max_border", &status);
+		CHECK_OPENCL_ERROR(status, "clCreateKernel failed. (max_border)");
+	}
+
+	status = kernelInfo.setKernelWorkGroupInfo(kernelMax,
+		devices[sdkContext->deviceId]);
+	CHECK_ERROR(status, SDK_SUCCESS, "kernelInfo.setKernelWorkGroupInfo() failed");
+
+
+	if ((blockSizeX * blockSizeY) > kernelInfo.kernelWorkGroupSize)
+	{
+		if (!sdkContext->quiet)
+		{
+			std::cout << "Out of Resources!" << std::endl;
+			std::cout << "Group Size specified : "
+				<< blockSizeX * blockSizeY << std::endl;
+			std::cout << "Max Group Size supported on the kernel : "
+				<< kernelWorkGroupSize << std::endl;
+			std::cout << "Falling back to " << kernelInfo.kernelWorkGroupSize << std::endl;
+		}
+
+		// Three possible cases
+		if (blockSizeX > kernelInfo.kernelWorkGroupSize)
+		{
+			blockSizeX = kernelInfo.kernelWorkGroupSize;
+			blockSizeY = 1;
+		}
+	}
+
+
+	buildProgramData buildDataHyst;
+	buildDataHyst.kernelName = std::string(HYSTERESIS_KERNEL);
+	buildDataHyst.devices = devices;
+	buildDataHyst.deviceId = sdkContext->deviceId;
+	buildDataHyst.flagsStr = includeFlags + mathFlags + geometryFlags + tileFlags;
+	if (sdkContext->isLoadBinaryEnabled())
+	{
+		buildDataHyst.binaryName = std::string(sdkContext->loadBinary.c_str());
+	}
+
+	if (sdkContext->isComplierFlagsSpecified())
+	{
+		buildDataHyst.flagsFileName = std::string(sdkContext->flags.c_str());
+	}
+
+	retValue = buildStageProgram(programHyst, buildDataHyst);
+	CHECK_ERROR(retValue, 0, "buildStageProgram() failed");
+
+	// get a kernel object handle for a kernel with the given name
+	kernelHyst = clCreateKernel(
+		programHyst,
+		"Hyst_filter",
+		&status);
+	CHECK_OPENCL_ERROR(status, "clCreateKernel failed.");
+
+	status = kernelInfo.setKernelWorkGroupInfo(kernelHyst,
+		devices[sdkContext->deviceId]);
+	CHECK_ERROR(status, SDK_SUCCESS, "kernelInfo.setKernelWorkGroupInfo() failed");
+
+
+	if ((blockSizeX * blockSizeY) > kernelInfo.kernelWorkGroupSize)
+	{
+		if (!sdkContext->quiet)
+		{
+			std::cout << "Out of Resources!" << std::endl;
+			std::cout << "Group Size specified : "
+				<< blockSizeX * blockSizeY << std::endl;
+			std::cout << "Hyst Group Size supported on the kernel : "
+				<< kernelWorkGroupSize << std::endl;
+			std::cout << "Falling back to " << kernelInfo.kernelWorkGroupSize << std::endl;
+		}
+
+		// Three possible cases
+		if (blockSizeX > kernelInfo.kernelWorkGroupSize)
+		{
+			blockSizeX = kernelInfo.kernelWorkGroupSize;
+			blockSizeY = 1;
+		}
+	}
+	return SDK_SUCCESS;
+}
+
+
+StripContext
+EdgeDetector::wholeImage()
+{
+	StripContext strip;
+	strip.queue = commandQueue;
+	strip.nextBuffer = nextImageBuffer;
+	strip.prevBuffer = prevImageBuffer;
+	strip.thetaBuffer = thetaBuffer;
+	strip.inputBuffer = inputPixelBytes == pixelSize ? nextImageBuffer : inputImageBuffer;
+	strip.rows = height;
+	strip.firstColumn = 0;
+	strip.columns = width;
+	strip.tileList = NULL;
+	strip.tileCount = 0;
+	return strip;
+}
+
+int
+EdgeDetector::enqueueStage(const StripContext& strip, cl_kernel kernel)
+{
+	// Enqueue a kernel run call.
+	size_t globalThreads[] = { strip.columns, strip.rows };
+	size_t localThreads[] = { blockSizeX, blockSizeY };
+	cl_int status;
+
+	if (strip.tileList != NULL)
+	{
+		// The tiles follow one another down y; the tile list is the last kernel argument
+		if (strip.tileCount == 0)
+		{
+			return SDK_SUCCESS;
+		}
+		cl_uint args = 0;
+		status = clGetKernelInfo(kernel, CL_KERNEL_NUM_ARGS, sizeof(cl_uint), &args, NULL);
+		CHECK_OPENCL_ERROR(status, "clGetKernelInfo failed. (CL_KERNEL_NUM_ARGS)");
+		status = clSetKernelArg(kernel, args - 1, sizeof(cl_mem), &strip.tileList);
+		CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (tileList)");
+		globalThreads[0] = FLAT_TILE;
+		globalThreads[1] = FLAT_TILE * strip.tileCount;
+	}
+
+	status = clEnqueueNDRangeKernel(
+		strip.queue,
+		kernel,
+		2,
+		NULL,
+		globalThreads,
+		localThreads,
+		0,
+		NULL,
+		NULL);
+	CHECK_OPENCL_ERROR(status, "clEnqueueNDRangeKernel failed.");
+
+	return SDK_SUCCESS;
+}
+
+int
+EdgeDetector::enqueueBordered(const StripContext& strip, cl_kernel kernel, cl_kernel borderKernel,
+	const cl_mem* buffers, cl_uint bufferCount)
+{
+	cl_int status;
+	cl_uint columns = (cl_uint)strip.columns;
+	cl_uint rows = (cl_uint)strip.rows;
+	cl_uint mode = (cl_uint)borderMode;
+
+	// The interior has its whole window in the image, so the kernel needs no border checks.
+	// Its size is not a multiple of the work-group size; the runtime picks one.
+	if (columns > 2 && rows > 2)
+	{
+		size_t offset[] = { 1, 1 };
+		size_t globalThreads[] = { columns - 2, rows - 2 };
+		status = clEnqueueNDRangeKernel(strip.queue, kernel, 2, offset, globalThreads, NULL, 0, NULL, NULL);
+		CHECK_OPENCL_ERROR(status, "clEnqueueNDRangeKernel failed. (interior)");
+	}
+
+	for (cl_uint i = 0; i < bufferCount; i++)
+	{
+		status = clSetKernelArg(borderKernel, i, sizeof(cl_mem), &buffers[i]);
+		CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (border buffer)");
+	}
+	status = clSetKernelArg(borderKernel, bufferCount, sizeof(cl_uint), &columns);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (width)");
+	status = clSetKernelArg(borderKernel, bufferCount + 1, sizeof(cl_uint), &rows);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (height)");
+	status = clSetKernelArg(borderKernel, bufferCount + 2, sizeof(cl_uint), &mode);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (mode)");
+
+	// Top and bottom rows and both ends of the rows between
+	size_t ringThreads[] = { rows > 1 ? 2 * (size_t)columns + 2 * (size_t)(rows - 2) : columns };
+	status = clEnqueueNDRangeKernel(strip.queue, borderKernel, 1, NULL, ringThreads, NULL, 0, NULL, NULL);
+	CHECK_OPENCL_ERROR(status, "clEnqueueNDRangeKernel failed. (border)");
+
+	return SDK_SUCCESS;
+}
+
+int EdgeDetector::GreyScale(const StripContext& strip)
+{
+	cl_int status;
+	cl_uint arg = 0;
+
+	// Set appropriate arguments to the kernel
+
+	// packed pixels and palette
+	if (inputPixelBytes != pixelSize)
+	{
+		status = clSetKernelArg(
+			kernelGrey,
+			arg++,
+			sizeof(cl_mem),
+			&strip.inputBuffer);
+		CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (inputBuffer)")
+
+		if (inputFormat == NATIVE_INPUT_INDEX8)
+		{
+			status = clSetKernelArg(
+				kernelGrey,
+				arg++,
+				sizeof(cl_mem),
+				&paletteBuffer);
+			CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (paletteBuffer)")
+		}
+	}
+
+	// input buffer image
+	status = clSetKernelArg(
+		kernelGrey,
+		arg++,
+		sizeof(cl_mem),
+		&strip.nextBuffer);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (nextImageBuffer)")
+
+	// outBuffer imager
+	status = clSetKernelArg(
+		kernelGrey,
+		arg++,
+		sizeof(cl_mem),
+		&strip.prevBuffer);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (prevImageBuffer");
+
+	return enqueueStage(strip, kernelGrey);
+}
+
+int EdgeDetector::Gaussian(const StripContext& strip)
+{
+	cl_int status;
+
+	// Set appropriate arguments to the kernel
+
+	// input buffer image
+	status = clSetKernelArg(
+		kernelGaus,
+		0,
+		sizeof(cl_mem),
+		&strip.prevBuffer);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (PrevBuff())")
+
+	// outBuffer imager
+	status = clSetKernelArg(
+		kernelGaus,
+		1,
+		sizeof(cl_mem),
+		&strip.nextBuffer);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (outputImageBuffer)");
+
+	if (borderMode != NATIVE_BORDER_LEGACY)
+	{
+		cl_mem buffers[] = { strip.prevBuffer, strip.nextBuffer };
+		return enqueueBordered(strip, kernelGaus, kernelGausBorder, buffers, 2);
+	}
+	return enqueueStage(strip, kernelGaus);
+}
+
+int EdgeDetector::Sobel(const StripContext& strip)
+{
+	cl_int status;
+
+	// Set appropriate arguments to the kernel
+
+	// input buffer image
+	status = clSetKernelArg(
+		kernelSobel,
+		0,
+		sizeof(cl_mem),
+		&strip.nextBuffer);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (inputImageBuffer)")
+
+	// outBuffer imager
+	status = clSetKernelArg(
+		kernelSobel,
+		1,
+		sizeof(cl_mem),
+		&strip.prevBuffer);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (outputImageBuffer)");
+
+	status = clSetKernelArg(
+		kernelSobel,
+		2,
+		sizeof(cl_mem),
+		&strip.thetaBuffer);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (thetaBuffer)");
+
+	if (borderMode != NATIVE_BORDER_LEGACY)
+	{
+		// sobel_direction writes direction codes, sobel_filter degrees
+		cl_uint codes = tangentDirection ? 1 : 0;
+		status = clSetKernelArg(kernelSobelBorder, 6, sizeof(cl_uint), &codes);
+		CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (codes)");
+		cl_mem buffers[] = { strip.nextBuffer, strip.prevBuffer, strip.thetaBuffer };
+		return enqueueBordered(strip, kernelSobel, kernelSobelBorder, buffers, 3);
+	}
+	return enqueueStage(strip, kernelSobel);
+}
+
+int EdgeDetector::Max(const StripContext& strip)
+{
+	cl_int status;
+
+	// Set appropriate arguments to the kernel
+
+	if (packedGradient)
+	{
+		// Magnitude and direction both come from thetaBuffer
+		status = clSetKernelArg(kernelMax, 0, sizeof(cl_mem), &strip.thetaBuffer);
+		CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (gradient)");
+		status = clSetKernelArg(kernelMax, 1, sizeof(cl_mem), &strip.nextBuffer);
+		CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (outputImageBuffer)");
+		return enqueueStage(strip, kernelMax);
+	}
+
+	// input buffer image
+	status = clSetKernelArg(
+		kernelMax,
+		0,
+		sizeof(cl_mem),
+		&strip.prevBuffer);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (inputImageBuffer)")
+
+	// outBuffer imager
+	status = clSetKernelArg(
+		kernelMax,
+		1,
+		sizeof(cl_mem),
+		&strip.nextBuffer);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (outputImageBuffer)");
+
+	status = clSetKernelArg(
+		kernelMax,
+		2,
+		sizeof(cl_mem),
+		&strip.thetaBuffer);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (thetaBuffer)");
+
+	if (borderMode != NATIVE_BORDER_LEGACY)
+	{
+		cl_uint codes = tangentDirection ? 1 : 0;
+		status = clSetKernelArg(kernelMaxBorder, 6, sizeof(cl_uint), &codes);
+		CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (codes)");
+		cl_mem buffers[] = { strip.prevBuffer, strip.nextBuffer, strip.thetaBuffer };
+		return enqueueBordered(strip, kernelMax, kernelMaxBorder, buffers, 3);
+	}
+	return enqueueStage(strip, kernelMax);
+}
+
+int EdgeDetector::SobelMax(const StripContext& strip)
+{
+	if (!fusedNms)
+	{
+		return Sobel(strip) != SDK_SUCCESS ? SDK_FAILURE : Max(strip);
+	}
+
+	cl_int status;
+	cl_uint columns = (cl_uint)strip.columns;
+	cl_uint rows = (cl_uint)strip.rows;
+
+	// gaussian output in, max output to prevBuffer; sobel_max_filter reads the tile
+	// halo of its neighbours, so it cannot write in place
+	status = clSetKernelArg(kernelSobelMax, 0, sizeof(cl_mem), &strip.nextBuffer);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (inputImageBuffer)");
+	status = clSetKernelArg(kernelSobelMax, 1, sizeof(cl_mem), &strip.prevBuffer);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (outputImageBuffer)");
+	status = clSetKernelArg(kernelSobelMax, 2, sizeof(cl_uint), &columns);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (width)");
+	status = clSetKernelArg(kernelSobelMax, 3, sizeof(cl_uint), &rows);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (height)");
+
+	// Square work-groups; rows are rounded up to whole groups
+	size_t globalThreads[] = { strip.columns,
+		(strip.rows + FUSED_GROUP_SIZE - 1) / FUSED_GROUP_SIZE * FUSED_GROUP_SIZE };
+	size_t localThreads[] = { FUSED_GROUP_SIZE, FUSED_GROUP_SIZE };
+
+	status = clEnqueueNDRangeKernel(
+		strip.queue,
+		kernelSobelMax,
+		2,
+		NULL,
+		globalThreads,
+		localThreads,
+		0,
+		NULL,
+		NULL);
+	CHECK_OPENCL_ERROR(status, "clEnqueueNDRangeKernel failed.");
+
+	return SDK_SUCCESS;
+}
+
+int EdgeDetector::Hysteresis(const StripContext& strip)
+{
+	cl_int status;
+
+	// Set appropriate arguments to the kernel
+
+	// input buffer image; Hyst_filter is per pixel and runs in place after sobel_max_filter
+	status = clSetKernelArg(
+		kernelHyst,
+		0,
+		sizeof(cl_mem),
+		fusedNms ? &strip.prevBuffer : &strip.nextBuffer);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (inputImageBuffer)")
+
+	// outBuffer imager
+	status = clSetKernelArg(
+		kernelHyst,
+		1,
+		sizeof(cl_mem),
+		&strip.prevBuffer);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (outputImageBuffer)");
+
+	return enqueueStage(strip, kernelHyst);
+}
+
+int EdgeDetector::Decimate(const PyramidLevel& finer, const PyramidLevel& level)
+{
+	cl_int status;
+	cl_uint finerWidth = finer.width;
+
+	// finer gaussian output
+	status = clSetKernelArg(
+		kernelDecimate,
+		0,
+		sizeof(cl_mem),
+		&finer.strip.nextBuffer);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (finer nextBuffer)")
+
+	status = clSetKernelArg(
+		kernelDecimate,
+		1,
+		sizeof(cl_uint),
+		&finerWidth);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (inputWidth)")
+
+	// level input, both buffers of its gaussian_filter
+	status = clSetKernelArg(
+		kernelDecimate,
+		2,
+		sizeof(cl_mem),
+		&level.strip.nextBuffer);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (nextBuffer)")
+
+	status = clSetKernelArg(
+		kernelDecimate,
+		3,
+		sizeof(cl_mem),
+		&level.strip.prevBuffer);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (prevBuffer)");
+
+	return enqueueStage(level.strip, kernelDecimate);
+}
+
+int
+EdgeDetector::chooseTileRows()
+{
+	size_t rowBytes = (size_t)width * pixelSize;
+	cl_ulong imageBytes = (cl_ulong)width_original * height_original * pixelSize;
+
+	if (forcedTileRows <= 0 && imageBytes <= deviceInfo.maxMemAllocSize)
+	{
+		tileRows = 0;
+		return SDK_SUCCESS;
+	}
+
+	// Two strips in flight, each with two uchar4 buffers, a theta buffer and
+	// packed input if any; keep half of the global memory for the driver and other allocations
+	size_t packedBytes = inputPixelBytes != pixelSize ? (size_t)width * inputPixelBytes : 0;
+	cl_ulong allocRows = deviceInfo.maxMemAllocSize / rowBytes;
+	cl_ulong memoryRows = deviceInfo.globalMemSize / 2 / (2 * (2 * rowBytes + width * thetaBytes + packedBytes));
+	cl_ulong maxRows = allocRows < memoryRows ? allocRows : memoryRows;
+	if (maxRows <= 2 * TILE_HALO)
+	{
+		std::cout << "Image width " << width << " does not fit a device allocation" << std::endl;
+		return SDK_FAILURE;
+	}
+
+	tileRows = (size_t)(maxRows - 2 * TILE_HALO);
+	if (forcedTileRows > 0 && (size_t)forcedTileRows < tileRows)
+	{
+		tileRows = forcedTileRows;
+	}
+	if (tileRows > height)
+	{
+		tileRows = height;
+	}
+
+	if (!sdkContext->quiet)
+	{
+		std::cout << "Processing in strips of " << tileRows << " rows (+"
+			<< TILE_HALO << " halo rows)" << std::endl;
+	}
+
+	return SDK_SUCCESS;
+}
+
+int
+EdgeDetector::uploadInput(const StripContext& strip, size_t firstRow, cl_bool blocking)
+{
+	size_t rowBytes = (size_t)width * inputPixelBytes;
+	cl_int status;
+
+	if (strip.columns == width)
+	{
+		status = clEnqueueWriteBuffer(
+			strip.queue,
+			strip.inputBuffer,
+			blocking,
+			0,
+			strip.rows * rowBytes,
+			(const cl_uchar*)inputImageData + firstRow * rowBytes,
+			0,
+			NULL,
+			NULL);
+		CHECK_OPENCL_ERROR(status, "clEnqueueWriteBuffer failed. (inputBuffer)");
+		return SDK_SUCCESS;
+	}
+
+	// Narrow strips are packed, strip.columns pixels per row
+	size_t bufferOrigin[] = { 0, 0, 0 };
+	size_t hostOrigin[] = { strip.firstColumn * inputPixelBytes, firstRow, 0 };
+	size_t region[] = { strip.columns * inputPixelBytes, strip.rows, 1 };
+
+	status = clEnqueueWriteBufferRect(
+		strip.queue,
+		strip.inputBuffer,
+		blocking,
+		bufferOrigin,
+		hostOrigin,
+		region,
+		strip.columns * inputPixelBytes,
+		0,
+		rowBytes,
+		0,
+		inputImageData,
+		0,
+		NULL,
+		NULL);
+	CHECK_OPENCL_ERROR(status, "clEnqueueWriteBufferRect failed. (inputBuffer)");
+
+	return SDK_SUCCESS;
+}
+
+int
+EdgeDetector::runCLTiles(size_t firstRow, size_t endRow, size_t firstColumn, size_t endColumn)
+{
+	cl_int status;
+	size_t rowBytes = (size_t)width * pixelSize;
+	size_t stripRows = tileRows != 0 ? tileRows : height;
+	StripContext image = wholeImage();
+	cl_uint stripIndex = 0;
+
+	// Columns get the same halo as rows, rounded up to whole work-groups
+	size_t left = firstColumn > TILE_HALO ? firstColumn - TILE_HALO : 0;
+	size_t right = endColumn + TILE_HALO < width ? endColumn + TILE_HALO : width;
+	size_t columns = (right - left + GROUP_SIZE - 1) / GROUP_SIZE * GROUP_SIZE;
+	if (left + columns > width)
+	{
+		left = width - columns;
+	}
+
+	for (size_t y0 = firstRow; y0 < endRow; y0 += stripRows, stripIndex++)
+	{
+		// Strips alternate between two queues; the in-order queue keeps a
+		// strip from overwriting the buffers of the one two steps earlier
+		StripContext& strip = tileRows != 0 ? tiles[stripIndex % 2] : image;
+		size_t y1 = y0 + stripRows < endRow ? y0 + stripRows : endRow;
+		size_t top = y0 > TILE_HALO ? y0 - TILE_HALO : 0;
+		size_t bottom = y1 + TILE_HALO < height ? y1 + TILE_HALO : height;
+		strip.rows = bottom - top;
+		strip.firstColumn = left;
+		strip.columns = columns;
+
+		if (uploadInput(strip, top, CL_FALSE) != SDK_SUCCESS)
+		{
+			return SDK_FAILURE;
+		}
+
+		if (GreyScale(strip) != SDK_SUCCESS ||
+			Gaussian(strip) != SDK_SUCCESS ||
+			SobelMax(strip) != SDK_SUCCESS ||
+			Hysteresis(strip) != SDK_SUCCESS)
+		{
+			return SDK_FAILURE;
+		}
+
+		// Halo rows are only context; read back the rows this strip owns
+		if (columns == width)
+		{
+			status = clEnqueueReadBuffer(
+				strip.queue,
+				strip.prevBuffer,
+				CL_FALSE,
+				(y0 - top) * rowBytes,
+				(y1 - y0) * rowBytes,
+				outputImageData + y0 * width,
+				0,
+				NULL,
+				NULL);
+			CHECK_OPENCL_ERROR(status, "clEnqueueReadBuffer failed. (strip)");
+		}
+		else
+		{
+			size_t bufferOrigin[] = { (firstColumn - left) * pixelSize, y0 - top, 0 };
+			size_t hostOrigin[] = { firstColumn * pixelSize, y0, 0 };
+			size_t region[] = { (endColumn - firstColumn) * pixelSize, y1 - y0, 1 };
+
+			status = clEnqueueReadBufferRect(
+				strip.queue,
+				strip.prevBuffer,
+				CL_FALSE,
+				bufferOrigin,
+				hostOrigin,
+				region,
+				columns * pixelSize,
+				0,
+				rowBytes,
+				0,
+				outputImageData,
+				0,
+				NULL,
+				NULL);
+			CHECK_OPENCL_ERROR(status, "clEnqueueReadBufferRect failed. (strip)");
+		}
+
+		status = clFlush(strip.queue);
+		CHECK_OPENCL_ERROR(status, "clFlush failed.");
+	}
+
+	if (tileRows == 0)
+	{
+		status = clFinish(commandQueue);
+		CHECK_OPENCL_ERROR(status, "clFinish failed.");
+		return SDK_SUCCESS;
+	}
+
+	for (int t = 0; t < 2; t++)
+	{
+		status = clFinish(tiles[t].queue);
+		CHECK_OPENCL_ERROR(status, "clFinish failed.");
+	}
+
+	return SDK_SUCCESS;
+}
+
+int
+EdgeDetector::runCLKernels()
+{
+	cl_int status;
+
+	if (tileRows != 0)
+	{
+		return runCLTiles(0, height, 0, width);
+	}
+
+	// Every frame starts from the input; gaussian_filter keeps its border
+	StripContext image = wholeImage();
+	if (unmapOutputs() != SDK_SUCCESS || uploadInput(image, 0, CL_FALSE) != SDK_SUCCESS)
+	{
+		return SDK_FAILURE;
+	}
+	if (GreyScale(image) != SDK_SUCCESS)
+	{
+		return SDK_FAILURE;
+	}
+	if (flatThreshold >= 0 && classifyTiles(image) != SDK_SUCCESS)
+	{
+		return SDK_FAILURE;
+	}
+	if (Gaussian(image) != SDK_SUCCESS ||
+		keepOutput(EDGE_OUTPUT_SMOOTHED, image.nextBuffer) != SDK_SUCCESS)
+	{
+		return SDK_FAILURE;
+	}
+	if (outputBuffers[EDGE_OUTPUT_MAGNITUDE] != NULL || outputBuffers[EDGE_OUTPUT_DIRECTION] != NULL)
+	{
+		// Magnitude and direction only exist between sobel and max
+		if (Sobel(image) != SDK_SUCCESS ||
+			keepOutput(EDGE_OUTPUT_MAGNITUDE, image.prevBuffer) != SDK_SUCCESS ||
+			keepOutput(EDGE_OUTPUT_DIRECTION, image.thetaBuffer) != SDK_SUCCESS ||
+			Max(image) != SDK_SUCCESS)
+		{
+			return SDK_FAILURE;
+		}
+	}
+	else if (SobelMax(image) != SDK_SUCCESS)
+	{
+		return SDK_FAILURE;
+	}
+	if (keepOutput(EDGE_OUTPUT_NMS, fusedNms ? image.prevBuffer : image.nextBuffer) != SDK_SUCCESS ||
+		Hysteresis(image) != SDK_SUCCESS)
+	{
+		return SDK_FAILURE;
+	}
+	if (flatThreshold >= 0 && zeroFlatTiles(image) != SDK_SUCCESS)
+	{
+		return SDK_FAILURE;
+	}
+
+	if (edgeListMode)
+	{
+		return readEdgeList(image);
+	}
+	if (packedOutput)
+	{
+		return readPackedEdges(image);
+	}
+	if (hasOutputs())
+	{
+		return mapOutputs(image);
+	}
+
+	// Enqueue readBuffer
+	cl_event readEvt;
+	status = clEnqueueReadBuffer(
+		commandQueue,
+		prevImageBuffer,
+		CL_TRUE,
+		0,
+		width * height * pixelSize,
+		outputImageData,
+		0,
+		NULL,
+		&readEvt);
+	CHECK_OPENCL_ERROR(status, "clEnqueueReadBuffer failed.");
+
+	status = clFlush(commandQueue);
+	CHECK_OPENCL_ERROR(status, "clFlush failed.");
+
+	status = waitForEventAndRelease(&readEvt);
+	CHECK_ERROR(status, SDK_SUCCESS, "WaitForEventAndRelease(readEvt) Failed");
+
+	return SDK_SUCCESS;
+}
+
+int
+EdgeDetector::runKernels()
+{
+	if (!regions.empty())
+	{
+		return runRegions(regions);
+	}
+	if (!pyramid.empty())
+	{
+		return runPyramid();
+	}
+	if (sdkContext->isNativeDevice())
+	{
+		if (nativeDetector.run(inputImageData, outputImageData, height) != SDK_SUCCESS)
+		{
+			return SDK_FAILURE;
+		}
+		if (edgeListMode)
+		{
+			edgeCount = nativeDetector.listEdges(edgePoints);
+		}
+		if (packedOutput)
+		{
+			packEdges();
+		}
+		return SDK_SUCCESS;
+	}
+	return runCLKernels();
+}
+
+int
+EdgeDetector::setupArithmetic(bool cpuDevice, bool halfDevice)
+{
+	if (arithmetic != "auto" && arithmetic != "float" && arithmetic != "fixed" && arithmetic != "half")
+	{
+		std::cout << "--arithmetic is auto, float, fixed or half" << std::endl;
+		return SDK_FAILURE;
+	}
+	if (arithmetic == "half" && !halfDevice)
+	{
+		std::cout << "--arithmetic half needs a device with cl_khr_fp16" << std::endl;
+		return SDK_FAILURE;
+	}
+	if (directionMode != "atan2" && directionMode != "tangent")
+	{
+		std::cout << "--direction is atan2 or tangent" << std::endl;
+		return SDK_FAILURE;
+	}
+	tangentDirection = directionMode == "tangent";
+	if (intermediateLayout != "split" && intermediateLayout != "packed")
+	{
+		std::cout << "--intermediate is split or packed" << std::endl;
+		return SDK_FAILURE;
+	}
+	if (intermediateLayout == "packed" && fusedNms)
+	{
+		std::cout << "--fused keeps the sobel output in local memory; --intermediate does not apply" << std::endl;
+		return SDK_FAILURE;
+	}
+	if (fastMagnitude != "sqrt" && fastMagnitude != "l1")
+	{
+		std::cout << "--fast-magnitude is sqrt or l1" << std::endl;
+		return SDK_FAILURE;
+	}
+	if (fastMath && arithmetic != "auto" && arithmetic != "float")
+	{
+		std::cout << "--fast-math relaxes the float kernels; use --arithmetic float or auto" << std::endl;
+		return SDK_FAILURE;
+	}
+	const char* borderNames[] = { "legacy", "clamp", "mirror", "zero", "skip" };
+	int border = 0;
+	while (border < 5 && borderName != borderNames[border])
+	{
+		border++;
+	}
+	if (border == 5)
+	{
+		std::cout << "--border is legacy, clamp, mirror, zero or skip" << std::endl;
+		return SDK_FAILURE;
+	}
+	borderMode = (NativeBorderMode)border;
+	if (borderMode != NATIVE_BORDER_LEGACY &&
+		(fusedNms || intermediateLayout == "packed" || !regions.empty() || pyramidLevels > 1 || incrementalRows > 0))
+	{
+		std::cout << "--border runs separate ring kernels over the whole image; it does not combine with "
+			<< "--fused, --intermediate packed, --roi, --pyramid or --incremental" << std::endl;
+		return SDK_FAILURE;
+	}
+	if (flatThreshold >= 0 && (fusedNms || intermediateLayout == "packed" || borderMode != NATIVE_BORDER_LEGACY ||
+		!regions.empty() || pyramidLevels > 1 || incrementalRows > 0))
+	{
+		std::cout << "--flat-threshold launches the split stages per tile of the whole image; it does not "
+			<< "combine with --fused, --intermediate packed, --border, --roi, --pyramid or --incremental" << std::endl;
+		return SDK_FAILURE;
+	}
+	// The native backend keeps its own byte planes
+	packedGradient = intermediateLayout == "packed" && !sdkContext->isNativeDevice();
+	thetaBytes = packedGradient ? sizeof(cl_ushort) : sizeof(cl_uchar);
+
+	// Integer gaussian and sobel give the float results bit for bit; integer greyscale does not
+	fixedFilters = !fastMath && (arithmetic == "fixed" || (arithmetic == "auto" && cpuDevice));
+	exactLuma = arithmetic == "fixed";
+	// Half precision is not bit exact; verifyResults() reports how far it is from float
+	halfFilters = !fastMath && (arithmetic == "half" || (arithmetic == "auto" && !cpuDevice && halfDevice));
+
+	mathFlags = "";
+	if (fastMath)
+	{
+		// Like half precision, verifyResults() reports the accuracy against the precise path
+		mathFlags = std::string("-cl-fast-relaxed-math -cl-mad-enable ") +
+			(fastMagnitude == "l1" ? "-D FAST_MAGNITUDE_L1 " : "-D FAST_MAGNITUDE_SQRT ");
+	}
+
+	arithmeticFlags = "";
+	if (fixedFilters)
+	{
+		arithmeticFlags += "-D FIXED_POINT_FILTERS ";
+	}
+	if (exactLuma)
+	{
+		arithmeticFlags += "-D EXACT_LUMA ";
+	}
+	if (halfFilters)
+	{
+		arithmeticFlags += "-D HALF_PRECISION_FILTERS ";
+	}
+
+	if (!sdkContext->quiet)
+	{
+		// The native device always filters in integers
+		std::cout << "Arithmetic: " << (exactLuma ? "integer" : "float") << " greyscale, "
+			<< (fixedFilters || sdkContext->isNativeDevice() ? "integer" : halfFilters ? "half" : "float")
+			<< " gaussian and sobel"
+			<< (fastMath ? ", fast math with " + fastMagnitude + " magnitude" : std::string(""))
+			<< std::endl;
+	}
+
+	return SDK_SUCCESS;
+}
+
+int
+EdgeDetector::buildStageProgram(cl_program& program, const buildProgramData& buildData)
+{
+	// --load names its own binary
+	if (programCache.empty() || sdkContext->isLoadBinaryEnabled())
+	{
+		return buildOpenCLProgram(program, context, buildData);
+	}
+
+	SDKFile source;
+	std::string sourcePath = getPath() + buildData.kernelName;
+	if (!source.open(sourcePath.c_str()))
+	{
+		std::cout << "Failed to load kernel file: " << sourcePath << std::endl;
+		return SDK_FAILURE;
+	}
+	std::string key = source.source() + '\n' + buildData.flagsStr + '\n';
+	const char* headers[] = { STAGE_COMMON_HEADER, SOBEL_FIXED_HEADER };
+	for (int h = 0; h < 2; h++)
+	{
+		// The flags only name the include directory; an edited header must miss the cache too
+		SDKFile header;
+		std::string headerPath = getPath() + headers[h];
+		if (header.open(headerPath.c_str()))
+		{
+			key += header.source() + '\n';
+		}
+	}
+	if (buildData.flagsFileName.size() != 0)
+	{
+		SDKFile flagsFile;
+		std::string flagsPath = getPath() + buildData.flagsFileName;
+		if (flagsFile.open(flagsPath.c_str()))
+		{
+			key += flagsFile.source() + '\n';
+		}
+	}
+	key += std::string(deviceInfo.name) + '\n' + deviceInfo.driverVersion;
+
+	// 64 bit FNV-1a of the key
+	cl_ulong hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < key.size(); i++)
+	{
+		hash = (hash ^ (unsigned char)key[i]) * 1099511628211ULL;
+	}
+
+	// Specialized binaries carry their image size in the name as well as in the key
+	std::string stem = buildData.kernelName.substr(0, buildData.kernelName.find_last_of('.'));
+	char name[64];
+	if (geometryFlags.empty())
+	{
+		sprintf(name, "-generic-%08x%08x.bin", (cl_uint)(hash >> 32), (cl_uint)hash);
+	}
+	else
+	{
+		sprintf(name, "-%ux%u-%08x%08x.bin", width, height, (cl_uint)(hash >> 32), (cl_uint)hash);
+	}
+	buildProgramData cached = buildData;
+	cached.binaryName = programCache + "/" + stem.substr(stem.find_last_of("/\\") + 1) + name;
+	std::string cachePath = getPath() + cached.binaryName;
+
+	FILE* fd = fopen(cachePath.c_str(), "rb");
+	if (fd != NULL)
+	{
+		fclose(fd);
+		program = NULL;
+		if (buildOpenCLProgram(program, context, cached) == SDK_SUCCESS)
+		{
+			if (!sdkContext->quiet)
+			{
+				std::cout << "Program cache: loaded " << cachePath << std::endl;
+			}
+			return SDK_SUCCESS;
+		}
+		// A binary the driver rejects is rebuilt and replaced
+		if (program != NULL)
+		{
+			clReleaseProgram(program);
+		}
+		std::cout << "Program cache: rebuilding " << cachePath << std::endl;
+	}
+
+	int retValue = buildOpenCLProgram(program, context, buildData);
+	CHECK_ERROR(retValue, SDK_SUCCESS, "buildOpenCLProgram() failed");
+
+	// Programs are built for one device, so there is one binary
+	size_t binarySize = 0;
+	cl_int status = clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &binarySize, NULL);
+	CHECK_OPENCL_ERROR(status, "clGetProgramInfo failed. (CL_PROGRAM_BINARY_SIZES)");
+	if (binarySize == 0)
+	{
+		return SDK_SUCCESS;
+	}
+
+	std::vector<unsigned char> binary(binarySize);
+	unsigned char* binaryData = &binary[0];
+	status = clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(unsigned char*), &binaryData, NULL);
+	CHECK_OPENCL_ERROR(status, "clGetProgramInfo failed. (CL_PROGRAM_BINARIES)");
+
+	// The cache only saves build time; failing to write it is not an error
+	fd = fopen(cachePath.c_str(), "wb");
+	bool saved = fd != NULL && fwrite(binaryData, binarySize, 1, fd) == 1;
+	if (fd != NULL)
+	{
+		saved = (fclose(fd) == 0) && saved;
+	}
+	if (!saved)
+	{
+		std::cout << "Program cache: cannot write " << cachePath << std::endl;
+	}
+	else if (!sdkContext->quiet)
+	{
+		std::cout << "Program cache: saved " << cachePath << std::endl;
+	}
+
+	return SDK_SUCCESS;
+}
+
+int
+EdgeDetector::setupRegions()
+{
+	// --roi is x,y,w,h[:x,y,w,h...]
+	for (size_t pos = 0; pos < regionList.size();)
+	{
+		size_t end = regionList.find(':', pos);
+		std::string item = regionList.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+		ImageRegion region;
+		char extra;
+		if (sscanf(item.c_str(), "%u,%u,%u,%u%c", &region.x, &region.y, &region.width, &region.height,
+			&extra) != 4)
+		{
+			std::cout << "Bad --roi region " << item << ", expected x,y,width,height" << std::endl;
+			return SDK_FAILURE;
+		}
+		regions.push_back(region);
+		pos = end == std::string::npos ? regionList.size() : end + 1;
+	}
+	regionList.clear();
+
+	if (regions.empty())
+	{
+		return SDK_SUCCESS;
+	}
+
+	// Regions are in the processed area; empty ones after clipping are dropped
+	size_t covered = 0;
+	std::vector<ImageRegion> clipped;
+	for (size_t i = 0; i < regions.size(); i++)
+	{
+		ImageRegion region = regions[i];
+		if (!inputTopDown)
+		{
+			// Regions count rows from the top of the picture; BMP rows are stored bottom-up
+			if (region.y >= height_original)
+			{
+				continue;
+			}
+			cl_uint end = region.height < height_original - region.y ? region.y + region.height : height_original;
+			region.height = end - region.y;
+			region.y = height_original - end;
+		}
+		if (region.x >= width || region.y >= height)
+		{
+			continue;
+		}
+		region.width = region.width < width - region.x ? region.width : width - region.x;
+		region.height = region.height < height - region.y ? region.height : height - region.y;
+		if (region.width != 0 && region.height != 0)
+		{
+			clipped.push_back(region);
+			covered += (size_t)region.width * region.height;
+		}
+	}
+	if (clipped.empty())
+	{
+		std::cout << "No region inside the " << width << "x" << height << " processed area" << std::endl;
+		return SDK_FAILURE;
+	}
+	regions = clipped;
+
+	// Nothing outside the regions is ever written
+	memset(outputImageData, 0, (size_t)width * height * pixelSize);
+
+	if (!sdkContext->quiet)
+	{
+		std::cout << "Processing " << regions.size() << " regions, "
+			<< 100.0 * covered / ((size_t)width * height) << "% of the image" << std::endl;
+	}
+
+	return SDK_SUCCESS;
+}
+
+int
+EdgeDetector::runRegions(const std::vector<ImageRegion>& list)
+{
+	if (!sdkContext->isNativeDevice())
+	{
+		for (size_t i = 0; i < list.size(); i++)
+		{
+			const ImageRegion& region = list[i];
+			if (runCLTiles(region.y, region.y + region.height, region.x, region.x + region.width)
+				!= SDK_SUCCESS)
+			{
+				return SDK_FAILURE;
+			}
+		}
+		return SDK_SUCCESS;
+	}
+
+	// The native stages work on full rows; merge overlapping row ranges so none runs twice
+	std::vector<std::pair<cl_uint, cl_uint> > rows;
+	for (size_t i = 0; i < list.size(); i++)
+	{
+		rows.push_back(std::make_pair(list[i].y, list[i].y + list[i].height));
+	}
+	std::sort(rows.begin(), rows.end());
+
+	for (size_t i = 0; i < rows.size();)
+	{
+		cl_uint y0 = rows[i].first;
+		cl_uint y1 = rows[i].second;
+		for (i++; i < rows.size() && rows[i].first <= y1; i++)
+		{
+			y1 = rows[i].second > y1 ? rows[i].second : y1;
+		}
+		if (nativeDetector.runRows(inputImageData, outputImageData, y0, y1) != SDK_SUCCESS)
+		{
+			return SDK_FAILURE;
+		}
+
+		// runRows wrote whole rows; clear the columns outside every region, like the OpenCL path
+		std::vector<std::pair<cl_uint, cl_uint> > spans;
+		for (cl_uint y = y0; y < y1; y++)
+		{
+			spans.clear();
+			for (size_t r = 0; r < list.size(); r++)
+			{
+				if (y >= list[r].y && y < list[r].y + list[r].height)
+				{
+					spans.push_back(std::make_pair(list[r].x, list[r].x + list[r].width));
+				}
+			}
+			std::sort(spans.begin(), spans.end());
+
+			cl_uchar4* row = outputImageData + (size_t)y * width;
+			cl_uint x = 0;
+			for (size_t r = 0; r < spans.size(); r++)
+			{
+				if (spans[r].first > x)
+				{
+					memset(row + x, 0, (spans[r].first - x) * pixelSize);
+				}
+				x = spans[r].second > x ? spans[r].second : x;
+			}
+			memset(row + x, 0, (width - x) * pixelSize);
+		}
+	}
+
+	return SDK_SUCCESS;
+}
+
+void
+EdgeDetector::maskToRegions(cl_uchar4* reference, const std::vector<ImageRegion>& list)
+{
+	// Keep the reference pixels of the regions; everything else must be zero in the output
+	std::vector<cl_uchar4> inside;
+	for (size_t i = 0; i < list.size(); i++)
+	{
+		const ImageRegion& region = list[i];
+		for (cl_uint y = region.y; y < region.y + region.height; y++)
+		{
+			const cl_uchar4* row = reference + (size_t)y * width + region.x;
+			inside.insert(inside.end(), row, row + region.width);
+		}
+	}
+
+	memset(reference, 0, (size_t)width * height * pixelSize);
+
+	size_t next = 0;
+	for (size_t i = 0; i < list.size(); i++)
+	{
+		const ImageRegion& region = list[i];
+		for (cl_uint y = region.y; y < region.y + region.height; y++)
+		{
+			memcpy(reference + (size_t)y * width + region.x, &inside[next], region.width * pixelSize);
+			next += region.width;
+		}
+	}
+}
+
+int
+EdgeDetector::setupPyramid()
+{
+	if (pyramidLevels <= 1)
+	{
+		pyramidFuse = false;
+		return SDK_SUCCESS;
+	}
+	if (!regions.empty() || incrementalRows > 0 || tileRows != 0)
+	{
+		std::cout << "--pyramid needs the whole image at once (no --roi, --incremental or strips)" << std::endl;
+		return SDK_FAILURE;
+	}
+
+	cl_int status;
+	bool native = sdkContext->isNativeDevice();
+
+	PyramidLevel base;
+	base.width = width;
+	base.height = height;
+	base.strip = native ? StripContext() : wholeImage();
+	base.native = &nativeDetector;
+	base.luma = NULL;
+	base.edges = outputImageData;
+	pyramid.push_back(base);
+
+	if (!native)
+	{
+		kernelDecimate = clCreateKernel(programGaus, "gaussian_decimate", &status);
+		CHECK_OPENCL_ERROR(status, "clCreateKernel failed. (gaussian_decimate)");
+	}
+
+	while ((int)pyramid.size() < pyramidLevels)
+	{
+		const PyramidLevel& finer = pyramid.back();
+		PyramidLevel level;
+		level.width = finer.width / 2 / GROUP_SIZE * GROUP_SIZE;
+		level.height = finer.height / 2;
+		if (level.width < GROUP_SIZE || level.height < 3)
+		{
+			std::cout << "--pyramid: stopping at " << pyramid.size()
+				<< " levels, the next one would be too small" << std::endl;
+			break;
+		}
+		size_t pixels = (size_t)level.width * level.height;
+
+		level.native = NULL;
+		level.luma = NULL;
+		level.edges = (cl_uchar4*)malloc(pixels * pixelSize);
+		CHECK_ALLOCATION(level.edges, "Failed to allocate memory! (level edges)");
+
+		if (native)
+		{
+			level.native = new NativeEdgeDetector();
+			CHECK_ALLOCATION(level.native, "Failed to allocate memory! (level detector)");
+			status = level.native->setup(level.width, level.height, threads < 0 ? 0 : threads);
+			CHECK_ERROR(status, SDK_SUCCESS, "NativeEdgeDetector::setup() failed");
+			level.native->setTangentDirection(tangentDirection);
+			level.native->setZeroBorder(fusedNms);
+			level.native->setL1Magnitude(fastMath && fastMagnitude == "l1");
+			level.native->setInputFormat(NATIVE_INPUT_LUMA);
+			level.luma = (cl_uchar*)malloc(pixels);
+			CHECK_ALLOCATION(level.luma, "Failed to allocate memory! (level luma)");
+		}
+		else
+		{
+			level.strip.queue = commandQueue;
+			level.strip.nextBuffer = clCreateBuffer(context, CL_MEM_READ_WRITE,
+				pixels * pixelSize, NULL, &status);
+			CHECK_OPENCL_ERROR(status, "clCreateBuffer failed. (level nextBuffer)");
+			level.strip.prevBuffer = clCreateBuffer(context, CL_MEM_READ_WRITE,
+				pixels * pixelSize, NULL, &status);
+			CHECK_OPENCL_ERROR(status, "clCreateBuffer failed. (level prevBuffer)");
+			level.strip.thetaBuffer = clCreateBuffer(context, CL_MEM_READ_WRITE,
+				pixels * thetaBytes, NULL, &status);
+			CHECK_OPENCL_ERROR(status, "clCreateBuffer failed. (level thetaBuffer)");
+			level.strip.inputBuffer = level.strip.nextBuffer;
+			level.strip.rows = level.height;
+			level.strip.firstColumn = 0;
+			level.strip.columns = level.width;
+			level.strip.tileList = NULL;
+			level.strip.tileCount = 0;
+		}
+
+		pyramid.push_back(level);
+	}
+
+	if (!sdkContext->quiet)
+	{
+		std::cout << "Pyramid of " << pyramid.size() << " levels, coarsest "
+			<< pyramid.back().width << "x" << pyramid.back().height << std::endl;
+	}
+
+	return SDK_SUCCESS;
+}
+
+int
+EdgeDetector::runPyramid()
+{
+	size_t last = pyramid.size() - 1;
+	cl_int status;
+
+	if (sdkContext->isNativeDevice())
+	{
+		// Each level starts from the gaussian plane of the one above it
+		for (size_t l = 0; l <= last; l++)
+		{
+			PyramidLevel& level = pyramid[l];
+			const void* input = inputImageData;
+			if (l > 0)
+			{
+				nativeDecimate(pyramid[l - 1].native->getGaussianPlane(), pyramid[l - 1].width,
+					level.luma, level.width, level.height);
+				input = level.luma;
+			}
+
+			// With --pyramid-fuse only the coarsest level needs its edges
+			status = pyramidFuse && l != last ?
+				level.native->smooth(input, level.height) :
+				level.native->run(input, level.edges, level.height);
+			if (status != SDK_SUCCESS)
+			{
+				return SDK_FAILURE;
+			}
+		}
+	}
+	else
+	{
+		// Smooth every level first; max overwrites the gaussian output the next level needs
+		if (uploadInput(pyramid[0].strip, 0, CL_FALSE) != SDK_SUCCESS ||
+			GreyScale(pyramid[0].strip) != SDK_SUCCESS ||
+			Gaussian(pyramid[0].strip) != SDK_SUCCESS)
+		{
+			return SDK_FAILURE;
+		}
+		for (size_t l = 1; l <= last; l++)
+		{
+			if (Decimate(pyramid[l - 1], pyramid[l]) != SDK_SUCCESS ||
+				Gaussian(pyramid[l].strip) != SDK_SUCCESS)
+			{
+				return SDK_FAILURE;
+			}
+		}
+
+		for (size_t l = pyramidFuse ? last : 0; l <= last; l++)
+		{
+			const PyramidLevel& level = pyramid[l];
+			if (SobelMax(level.strip) != SDK_SUCCESS ||
+				Hysteresis(level.strip) != SDK_SUCCESS)
+			{
+				return SDK_FAILURE;
+			}
+
+			status = clEnqueueReadBuffer(
+				commandQueue,
+				level.strip.prevBuffer,
+				CL_FALSE,
+				0,
+				(size_t)level.width * level.height * pixelSize,
+				level.edges,
+				0,
+				NULL,
+				NULL);
+			CHECK_OPENCL_ERROR(status, "clEnqueueReadBuffer failed. (level)");
+		}
+
+		status = clFinish(commandQueue);
+		CHECK_OPENCL_ERROR(status, "clFinish failed.");
+	}
+
+	if (!pyramidFuse)
+	{
+		return SDK_SUCCESS;
+	}
+
+	// Full resolution edges only where the coarsest level found some
+	gatePyramid();
+	memset(outputImageData, 0, (size_t)width * height * pixelSize);
+	return runRegions(gatedRegions);
+}
+
+void
+EdgeDetector::gatePyramid()
+{
+	const PyramidLevel& coarse = pyramid.back();
+	cl_uint shift = (cl_uint)pyramid.size() - 1;
+	cl_uint tile = PYRAMID_TILE > (1u << shift) ? PYRAMID_TILE : (1u << shift);
+	size_t covered = 0;
+
+	// A tile is kept if the coarse pixels under it, one more on each side, hold an edge.
+	// Tiles the coarse level does not reach (cut off widths and rows) are always kept.
+	auto hasEdge = [&](cl_uint x0, cl_uint x1, cl_uint y0, cl_uint y1)
+	{
+		cl_uint cx0 = x0 >> shift, cx1 = (x1 - 1) >> shift;
+		cl_uint cy0 = y0 >> shift, cy1 = (y1 - 1) >> shift;
+		if (cx1 >= coarse.width || cy1 >= coarse.height)
+		{
+			return true;
+		}
+		cx0 = cx0 > 0 ? cx0 - 1 : 0;
+		cy0 = cy0 > 0 ? cy0 - 1 : 0;
+		cx1 = cx1 + 1 < coarse.width ? cx1 + 1 : cx1;
+		cy1 = cy1 + 1 < coarse.height ? cy1 + 1 : cy1;
+		for (cl_uint cy = cy0; cy <= cy1; cy++)
+		{
+			const cl_uchar4* row = coarse.edges + (size_t)cy * coarse.width;
+			for (cl_uint cx = cx0; cx <= cx1; cx++)
+			{
+				if (row[cx].s[0] != 0)
+				{
+					return true;
+				}
+			}
+		}
+		return false;
+	};
+
+	// Neighbouring kept tiles of a tile row become one region
+	gatedRegions.clear();
+	for (cl_uint y0 = 0; y0 < height; y0 += tile)
+	{
+		cl_uint y1 = y0 + tile < height ? y0 + tile : height;
+		ImageRegion run = { 0, y0, 0, y1 - y0 };
+		for (cl_uint x0 = 0; x0 < width; x0 += tile)
+		{
+			cl_uint x1 = x0 + tile < width ? x0 + tile : width;
+			if (hasEdge(x0, x1, y0, y1))
+			{
+				run.x = run.width == 0 ? x0 : run.x;
+				run.width = x1 - run.x;
+				continue;
+			}
+			if (run.width != 0)
+			{
+				gatedRegions.push_back(run);
+				covered += (size_t)run.width * run.height;
+				run.width = 0;
+			}
+		}
+		if (run.width != 0)
+		{
+			gatedRegions.push_back(run);
+			covered += (size_t)run.width * run.height;
+		}
+	}
+
+	gatedFraction = (double)covered / ((size_t)width * height);
+}
+
+int
+EdgeDetector::cleanupPyramid()
+{
+	cl_int status;
+
+	// Level 0 is the full resolution image, released with it
+	for (size_t l = 1; l < pyramid.size(); l++)
+	{
+		PyramidLevel& level = pyramid[l];
+		if (level.native != NULL)
+		{
+			status = level.native->cleanup();
+			CHECK_ERROR(status, SDK_SUCCESS, "NativeEdgeDetector::cleanup() failed");
+			delete level.native;
+		}
+		else
+		{
+			status = clReleaseMemObject(level.strip.nextBuffer);
+			CHECK_OPENCL_ERROR(status, "clReleaseMemObject failed. (level nextBuffer)");
+			status = clReleaseMemObject(level.strip.prevBuffer);
+			CHECK_OPENCL_ERROR(status, "clReleaseMemObject failed. (level prevBuffer)");
+			status = clReleaseMemObject(level.strip.thetaBuffer);
+			CHECK_OPENCL_ERROR(status, "clReleaseMemObject failed. (level thetaBuffer)");
+		}
+		FREE(level.luma);
+		FREE(level.edges);
+	}
+	pyramid.clear();
+
+	if (kernelDecimate != NULL)
+	{
+		status = clReleaseKernel(kernelDecimate);
+		CHECK_OPENCL_ERROR(status, "clReleaseKernel failed. (gaussian_decimate)");
+		kernelDecimate = NULL;
+	}
+
+	return SDK_SUCCESS;
+}
+
+int
+EdgeDetector::buildCompactProgram()
+{
+	if (programCompact != NULL)
+	{
+		return SDK_SUCCESS;
+	}
+
+	buildProgramData buildDataCompact;
+	buildDataCompact.kernelName = std::string(COMPACT_KERNEL);
+	buildDataCompact.devices = devices;
+	buildDataCompact.deviceId = sdkContext->deviceId;
+	buildDataCompact.flagsStr = mathFlags;
+	if (sdkContext->isComplierFlagsSpecified())
+	{
+		buildDataCompact.flagsFileName = std::string(sdkContext->flags.c_str());
+	}
+
+	int retValue = buildOpenCLProgram(programCompact, context, buildDataCompact);
+	CHECK_ERROR(retValue, 0, "buildOpenCLProgram() failed");
+
+	return SDK_SUCCESS;
+}
+
+int
+EdgeDetector::setupEdgeList()
+{
+	if (!edgeListMode)
+	{
+		return SDK_SUCCESS;
+	}
+	if (tileRows != 0 || !regions.empty() || !pyramid.empty() || incrementalRows > 0)
+	{
+		std::cout << "--edge-list needs the edge map of the whole image at once" << std::endl;
+		return SDK_FAILURE;
+	}
+	if (fusedNms)
+	{
+		std::cout << "--edge-list reads the directions --fused keeps in local memory" << std::endl;
+		return SDK_FAILURE;
+	}
+	if (packedGradient)
+	{
+		std::cout << "--edge-list reads the directions of --intermediate split" << std::endl;
+		return SDK_FAILURE;
+	}
+	if (width > 65536 || height > 65536)
+	{
+		std::cout << "--edge-list stores coordinates in 16 bits" << std::endl;
+		return SDK_FAILURE;
+	}
+
+	size_t pixels = (size_t)width * height;
+	edgePoints = (cl_ushort4*)malloc(pixels * sizeof(cl_ushort4));
+	CHECK_ALLOCATION(edgePoints, "Failed to allocate memory! (edgePoints)");
+
+	if (sdkContext->isNativeDevice())
+	{
+		return SDK_SUCCESS;
+	}
+
+	int retValue = buildCompactProgram();
+	CHECK_ERROR(retValue, SDK_SUCCESS, "buildCompactProgram() failed");
+
+	cl_int status;
+	kernelCount = clCreateKernel(programCompact, "edge_count", &status);
+	CHECK_OPENCL_ERROR(status, "clCreateKernel failed. (edge_count)");
+	kernelScan = clCreateKernel(programCompact, "edge_scan", &status);
+	CHECK_OPENCL_ERROR(status, "clCreateKernel failed. (edge_scan)");
+	kernelScatter = clCreateKernel(programCompact, "edge_scatter", &status);
+	CHECK_OPENCL_ERROR(status, "clCreateKernel failed. (edge_scatter)");
+
+	// One power of two group size every compaction kernel can run with
+	compactGroupSize = COMPACT_GROUP_SIZE;
+	cl_kernel compactKernels[] = { kernelCount, kernelScan, kernelScatter };
+	for (int k = 0; k < 3; k++)
+	{
+		status = kernelInfo.setKernelWorkGroupInfo(compactKernels[k], devices[sdkContext->deviceId]);
+		CHECK_ERROR(status, SDK_SUCCESS, "kernelInfo.setKernelWorkGroupInfo() failed");
+		while (compactGroupSize > kernelInfo.kernelWorkGroupSize)
+		{
+			compactGroupSize /= 2;
+		}
+	}
+
+	size_t groups = (pixels + compactGroupSize - 1) / compactGroupSize;
+	groupCountBuffer = clCreateBuffer(context, CL_MEM_READ_WRITE, (groups + 1) * sizeof(cl_uint), NULL, &status);
+	CHECK_OPENCL_ERROR(status, "clCreateBuffer failed. (groupCountBuffer)");
+	pointBuffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY, pixels * sizeof(cl_ushort4), NULL, &status);
+	CHECK_OPENCL_ERROR(status, "clCreateBuffer failed. (pointBuffer)");
+
+	return SDK_SUCCESS;
+}
+
+int
+EdgeDetector::setupPackedOutput()
+{
+	if (!packedOutput)
+	{
+		return SDK_SUCCESS;
+	}
+	if (tileRows != 0 || !regions.empty() || !pyramid.empty() || incrementalRows > 0 || edgeListMode)
+	{
+		std::cout << "--packed-output needs the edge map of the whole image at once" << std::endl;
+		return SDK_FAILURE;
+	}
+
+	// Rows are padded to 32 bits, like the rows of a 1 bit BMP
+	packedRowBytes = ((size_t)width + 31) / 32 * sizeof(cl_uint);
+	packedEdges = (cl_uchar*)malloc(packedRowBytes * height);
+	CHECK_ALLOCATION(packedEdges, "Failed to allocate memory! (packedEdges)");
+
+	if (sdkContext->isNativeDevice())
+	{
+		return SDK_SUCCESS;
+	}
+
+	int retValue = buildCompactProgram();
+	CHECK_ERROR(retValue, SDK_SUCCESS, "buildCompactProgram() failed");
+
+	cl_int status;
+	kernelPack = clCreateKernel(programCompact, "edge_pack", &status);
+	CHECK_OPENCL_ERROR(status, "clCreateKernel failed. (edge_pack)");
+
+	packedBuffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY, packedRowBytes * height, NULL, &status);
+	CHECK_OPENCL_ERROR(status, "clCreateBuffer failed. (packedBuffer)");
+
+	return SDK_SUCCESS;
+}
+
+int
+EdgeDetector::readPackedEdges(const StripContext& strip)
+{
+	cl_int status;
+	cl_uint imageWidth = width;
+
+	// edge_pack(edges, width, bits)
+	status = clSetKernelArg(kernelPack, 0, sizeof(cl_mem), &strip.prevBuffer);
+	status |= clSetKernelArg(kernelPack, 1, sizeof(cl_uint), &imageWidth);
+	status |= clSetKernelArg(kernelPack, 2, sizeof(cl_mem), &packedBuffer);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (edge_pack)");
+
+	size_t globalThreads[] = { packedRowBytes / sizeof(cl_uint), height };
+	status = clEnqueueNDRangeKernel(strip.queue, kernelPack, 2, NULL, globalThreads, NULL,
+		0, NULL, NULL);
+	CHECK_OPENCL_ERROR(status, "clEnqueueNDRangeKernel failed. (edge_pack)");
+
+	status = clEnqueueReadBuffer(strip.queue, packedBuffer, CL_TRUE, 0, packedRowBytes * height,
+		packedEdges, 0, NULL, NULL);
+	CHECK_OPENCL_ERROR(status, "clEnqueueReadBuffer failed. (packedBuffer)");
+
+	return SDK_SUCCESS;
+}
+
+void
+EdgeDetector::packEdges()
+{
+	size_t bytes = ((size_t)width + 7) / 8;
+	for (cl_uint y = 0; y < height; y++)
+	{
+		cl_uchar* row = packedEdges + y * packedRowBytes;
+		bitMapPackBits((const uchar4*)(outputImageData + (size_t)y * width), row, width);
+		memset(row + bytes, 0, packedRowBytes - bytes);
+	}
+}
+
+void
+EdgeDetector::unpackEdges()
+{
+	for (cl_uint y = 0; y < height; y++)
+	{
+		bitMapUnpackBits(packedEdges + y * packedRowBytes, (uchar4*)(outputImageData + (size_t)y * width),
+			width);
+	}
+}
+
+int
+EdgeDetector::cleanupPackedOutput()
+{
+	cl_int status;
+	if (kernelPack != NULL)
+	{
+		status = clReleaseKernel(kernelPack);
+		CHECK_OPENCL_ERROR(status, "clReleaseKernel failed. (edge_pack)");
+		kernelPack = NULL;
+	}
+	if (packedBuffer != NULL)
+	{
+		status = clReleaseMemObject(packedBuffer);
+		CHECK_OPENCL_ERROR(status, "clReleaseMemObject failed. (packedBuffer)");
+		packedBuffer = NULL;
+	}
+
+	FREE(packedEdges);
+	return SDK_SUCCESS;
+}
+
+int
+EdgeDetector::readEdgeList(const StripContext& strip)
+{
+	cl_int status;
+	cl_uint pixels = width * height;
+	cl_uint groups = (cl_uint)((pixels + compactGroupSize - 1) / compactGroupSize);
+	size_t scratch = compactGroupSize * sizeof(cl_uint);
+	size_t globalThreads[] = { groups * compactGroupSize };
+	size_t localThreads[] = { compactGroupSize };
+
+	// edge_count(edges, pixels, groupCounts, scratch)
+	status = clSetKernelArg(kernelCount, 0, sizeof(cl_mem), &strip.prevBuffer);
+	status |= clSetKernelArg(kernelCount, 1, sizeof(cl_uint), &pixels);
+	status |= clSetKernelArg(kernelCount, 2, sizeof(cl_mem), &groupCountBuffer);
+	status |= clSetKernelArg(kernelCount, 3, scratch, NULL);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (edge_count)");
+
+	status = clEnqueueNDRangeKernel(strip.queue, kernelCount, 1, NULL, globalThreads, localThreads,
+		0, NULL, NULL);
+	CHECK_OPENCL_ERROR(status, "clEnqueueNDRangeKernel failed. (edge_count)");
+
+	// edge_scan(groupCounts, groups, scratch), a single work-group
+	status = clSetKernelArg(kernelScan, 0, sizeof(cl_mem), &groupCountBuffer);
+	status |= clSetKernelArg(kernelScan, 1, sizeof(cl_uint), &groups);
+	status |= clSetKernelArg(kernelScan, 2, scratch, NULL);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (edge_scan)");
+
+	status = clEnqueueNDRangeKernel(strip.queue, kernelScan, 1, NULL, localThreads, localThreads,
+		0, NULL, NULL);
+	CHECK_OPENCL_ERROR(status, "clEnqueueNDRangeKernel failed. (edge_scan)");
+
+	// edge_scatter(edges, theta, width, height, directionScale, groupOffsets, points, scratch)
+	cl_uint imageWidth = width;
+	cl_uint imageHeight = height;
+	cl_uint directionScale = tangentDirection ? 45 : 1;
+	status = clSetKernelArg(kernelScatter, 0, sizeof(cl_mem), &strip.prevBuffer);
+	status |= clSetKernelArg(kernelScatter, 1, sizeof(cl_mem), &strip.thetaBuffer);
+	status |= clSetKernelArg(kernelScatter, 2, sizeof(cl_uint), &imageWidth);
+	status |= clSetKernelArg(kernelScatter, 3, sizeof(cl_uint), &imageHeight);
+	status |= clSetKernelArg(kernelScatter, 4, sizeof(cl_uint), &directionScale);
+	status |= clSetKernelArg(kernelScatter, 5, sizeof(cl_mem), &groupCountBuffer);
+	status |= clSetKernelArg(kernelScatter, 6, sizeof(cl_mem), &pointBuffer);
+	status |= clSetKernelArg(kernelScatter, 7, scratch, NULL);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (edge_scatter)");
+
+	status = clEnqueueNDRangeKernel(strip.queue, kernelScatter, 1, NULL, globalThreads, localThreads,
+		0, NULL, NULL);
+	CHECK_OPENCL_ERROR(status, "clEnqueueNDRangeKernel failed. (edge_scatter)");
+
+	// The total follows the group offsets; only as many records as it says are read
+	status = clEnqueueReadBuffer(strip.queue, groupCountBuffer, CL_TRUE, groups * sizeof(cl_uint),
+		sizeof(cl_uint), &edgeCount, 0, NULL, NULL);
+	CHECK_OPENCL_ERROR(status, "clEnqueueReadBuffer failed. (edge count)");
+
+	if (edgeCount != 0)
+	{
+		status = clEnqueueReadBuffer(strip.queue, pointBuffer, CL_TRUE, 0,
+			(size_t)edgeCount * sizeof(cl_ushort4), edgePoints, 0, NULL, NULL);
+		CHECK_OPENCL_ERROR(status, "clEnqueueReadBuffer failed. (edge points)");
+	}
+
+	return SDK_SUCCESS;
+}
+
+void
+EdgeDetector::expandEdgeList()
+{
+	memset(outputImageData, 0, (size_t)width * height * pixelSize);
+	for (cl_uint i = 0; i < edgeCount; i++)
+	{
+		cl_uchar4& pixel = outputImageData[(size_t)edgePoints[i].s[1] * width + edgePoints[i].s[0]];
+		pixel.s[0] = pixel.s[1] = pixel.s[2] = pixel.s[3] = 255;
+	}
+}
+
+int
+EdgeDetector::writeEdgeList(std::string outputImageName)
+{
+	FILE* fd = fopen(outputImageName.c_str(), "w");
+	if (fd == NULL)
+	{
+		std::cout << "Failed to write edge list!";
+		return SDK_FAILURE;
+	}
+
+	bool ok = fprintf(fd, "x,y,direction\n") > 0;
+	for (cl_uint i = 0; ok && i < edgeCount; i++)
+	{
+		const cl_ushort4& point = edgePoints[i];
+		cl_uint y = inputTopDown ? point.s[1] : height_original - 1 - point.s[1];
+		ok = fprintf(fd, "%u,%u,%u\n", (cl_uint)point.s[0], y, (cl_uint)point.s[2]) > 0;
+	}
+
+	if ((fclose(fd) != 0) || !ok)
+	{
+		std::cout << "Failed to write edge list!";
+		return SDK_FAILURE;
+	}
+	return SDK_SUCCESS;
+}
+
+int
+EdgeDetector::cleanupEdgeList()
+{
+	cl_int status;
+	cl_kernel compactKernels[] = { kernelCount, kernelScan, kernelScatter };
+	for (int k = 0; k < 3; k++)
+	{
+		if (compactKernels[k] != NULL)
+		{
+			status = clReleaseKernel(compactKernels[k]);
+			CHECK_OPENCL_ERROR(status, "clReleaseKernel failed. (compaction)");
+		}
+	}
+	kernelCount = kernelScan = kernelScatter = NULL;
+
+	if (programCompact != NULL)
+	{
+		status = clReleaseProgram(programCompact);
+		CHECK_OPENCL_ERROR(status, "clReleaseProgram failed. (compaction)");
+		programCompact = NULL;
+	}
+
+	cl_mem compactBuffers[] = { groupCountBuffer, pointBuffer };
+	for (int b = 0; b < 2; b++)
+	{
+		if (compactBuffers[b] != NULL)
+		{
+			status = clReleaseMemObject(compactBuffers[b]);
+			CHECK_OPENCL_ERROR(status, "clReleaseMemObject failed. (compaction)");
+		}
+	}
+	groupCountBuffer = pointBuffer = NULL;
+
+	FREE(edgePoints);
+	return SDK_SUCCESS;
+}
+
+int
+EdgeDetector::setupFlatTiles()
+{
+	if (flatThreshold < 0)
+	{
+		return SDK_SUCCESS;
+	}
+	if (sdkContext->isNativeDevice())
+	{
+		// The native stages run whole rows
+		std::cout << "--flat-threshold skips OpenCL tile launches; the native backend runs every tile"
+			<< std::endl;
+		flatThreshold = -1;
+		return SDK_SUCCESS;
+	}
+	if (width / FLAT_TILE > 65536 || height / FLAT_TILE > 65536)
+	{
+		std::cout << "--flat-threshold stores tile coordinates in 16 bits" << std::endl;
+		return SDK_FAILURE;
+	}
+	cl_uint exactThreshold = fastMath && fastMagnitude == "l1" ? FLAT_EXACT_THRESHOLD_L1 : FLAT_EXACT_THRESHOLD;
+	if ((cl_uint)flatThreshold > exactThreshold && !sdkContext->quiet)
+	{
+		std::cout << "--flat-threshold above " << exactThreshold << " can drop edges" << std::endl;
+	}
+
+	buildProgramData buildDataFlat;
+	buildDataFlat.kernelName = std::string(FLAT_TILE_KERNEL);
+	buildDataFlat.devices = devices;
+	buildDataFlat.deviceId = sdkContext->deviceId;
+	char flags[32];
+	sprintf(flags, "-D TILE_LIST=%u ", FLAT_TILE);
+	buildDataFlat.flagsStr = mathFlags + flags;
+	if (sdkContext->isComplierFlagsSpecified())
+	{
+		buildDataFlat.flagsFileName = std::string(sdkContext->flags.c_str());
+	}
+
+	int retValue = buildStageProgram(programFlat, buildDataFlat);
+	CHECK_ERROR(retValue, SDK_SUCCESS, "buildStageProgram() failed");
+
+	cl_int status;
+	kernelTileRange = clCreateKernel(programFlat, "tile_range", &status);
+	CHECK_OPENCL_ERROR(status, "clCreateKernel failed. (tile_range)");
+	kernelTileLists = clCreateKernel(programFlat, "tile_lists", &status);
+	CHECK_OPENCL_ERROR(status, "clCreateKernel failed. (tile_lists)");
+	kernelTileZero = clCreateKernel(programFlat, "tile_zero", &status);
+	CHECK_OPENCL_ERROR(status, "clCreateKernel failed. (tile_zero)");
+
+	status = kernelInfo.setKernelWorkGroupInfo(kernelTileRange, devices[sdkContext->deviceId]);
+	CHECK_ERROR(status, SDK_SUCCESS, "kernelInfo.setKernelWorkGroupInfo() failed");
+	flatGroupSize = FLAT_GROUP_SIZE;
+	while (flatGroupSize > kernelInfo.kernelWorkGroupSize)
+	{
+		flatGroupSize /= 2;
+	}
+
+	size_t tileCount = (size_t)(width / FLAT_TILE) * (height / FLAT_TILE);
+	tileRangeBuffer = clCreateBuffer(context, CL_MEM_READ_WRITE, tileCount, NULL, &status);
+	CHECK_OPENCL_ERROR(status, "clCreateBuffer failed. (tileRangeBuffer)");
+	tileCountBuffer = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(tileCounts), NULL, &status);
+	CHECK_OPENCL_ERROR(status, "clCreateBuffer failed. (tileCountBuffer)");
+	runTileBuffer = clCreateBuffer(context, CL_MEM_READ_WRITE, tileCount * sizeof(cl_uint), NULL, &status);
+	CHECK_OPENCL_ERROR(status, "clCreateBuffer failed. (runTileBuffer)");
+	flatTileBuffer = clCreateBuffer(context, CL_MEM_READ_WRITE, tileCount * sizeof(cl_uint), NULL, &status);
+	CHECK_OPENCL_ERROR(status, "clCreateBuffer failed. (flatTileBuffer)");
+
+	return SDK_SUCCESS;
+}
+
+int
+EdgeDetector::classifyTiles(StripContext& strip)
+{
+	cl_int status;
+	cl_uint tileColumns = width / FLAT_TILE;
+	cl_uint tileGridRows = height / FLAT_TILE;
+	cl_uint imageWidth = width;
+	cl_uint imageHeight = height;
+	cl_uint threshold = (cl_uint)flatThreshold;
+	size_t tileCount = (size_t)tileColumns * tileGridRows;
+
+	status = clSetKernelArg(kernelTileRange, 0, sizeof(cl_mem), &strip.prevBuffer);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (greyImage)");
+	status = clSetKernelArg(kernelTileRange, 1, sizeof(cl_uint), &imageWidth);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (width)");
+	status = clSetKernelArg(kernelTileRange, 2, sizeof(cl_uint), &imageHeight);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (height)");
+	status = clSetKernelArg(kernelTileRange, 3, sizeof(cl_uint), &tileColumns);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (tileColumns)");
+	status = clSetKernelArg(kernelTileRange, 4, sizeof(cl_mem), &tileRangeBuffer);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (ranges)");
+	status = clSetKernelArg(kernelTileRange, 5, 2 * flatGroupSize, NULL);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (scratch)");
+
+	size_t rangeThreads[] = { tileCount * flatGroupSize };
+	size_t rangeGroup[] = { flatGroupSize };
+	status = clEnqueueNDRangeKernel(strip.queue, kernelTileRange, 1, NULL, rangeThreads, rangeGroup,
+		0, NULL, NULL);
+	CHECK_OPENCL_ERROR(status, "clEnqueueNDRangeKernel failed. (tile_range)");
+
+	// The lists are filled with atomics from zero counts
+	tileCounts[0] = tileCounts[1] = 0;
+	status = clEnqueueWriteBuffer(strip.queue, tileCountBuffer, CL_FALSE, 0, sizeof(tileCounts), tileCounts,
+		0, NULL, NULL);
+	CHECK_OPENCL_ERROR(status, "clEnqueueWriteBuffer failed. (tileCountBuffer)");
+
+	status = clSetKernelArg(kernelTileLists, 0, sizeof(cl_mem), &tileRangeBuffer);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (ranges)");
+	status = clSetKernelArg(kernelTileLists, 1, sizeof(cl_uint), &tileColumns);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (tileColumns)");
+	status = clSetKernelArg(kernelTileLists, 2, sizeof(cl_uint), &tileGridRows);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (tileRows)");
+	status = clSetKernelArg(kernelTileLists, 3, sizeof(cl_uint), &threshold);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (threshold)");
+	status = clSetKernelArg(kernelTileLists, 4, sizeof(cl_mem), &tileCountBuffer);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (counts)");
+	status = clSetKernelArg(kernelTileLists, 5, sizeof(cl_mem), &runTileBuffer);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (runList)");
+	status = clSetKernelArg(kernelTileLists, 6, sizeof(cl_mem), &flatTileBuffer);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (flatList)");
+
+	size_t listThreads[] = { tileCount };
+	status = clEnqueueNDRangeKernel(strip.queue, kernelTileLists, 1, NULL, listThreads, NULL, 0, NULL, NULL);
+	CHECK_OPENCL_ERROR(status, "clEnqueueNDRangeKernel failed. (tile_lists)");
+
+	// OpenCL has no indirect launch; the counts size the tile launches
+	status = clEnqueueReadBuffer(strip.queue, tileCountBuffer, CL_TRUE, 0, sizeof(tileCounts), tileCounts,
+		0, NULL, NULL);
+	CHECK_OPENCL_ERROR(status, "clEnqueueReadBuffer failed. (tileCountBuffer)");
+
+	strip.tileList = runTileBuffer;
+	strip.tileCount = tileCounts[0];
+	skippedTiles += tileCount - tileCounts[0];
+	flatFrames++;
+
+	return SDK_SUCCESS;
+}
+
+int
+EdgeDetector::zeroFlatTiles(const StripContext& strip)
+{
+	if (tileCounts[1] == 0)
+	{
+		return SDK_SUCCESS;
+	}
+
+	cl_int status;
+	cl_uint imageWidth = width;
+	status = clSetKernelArg(kernelTileZero, 0, sizeof(cl_mem), &strip.prevBuffer);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (outputImage)");
+	status = clSetKernelArg(kernelTileZero, 1, sizeof(cl_uint), &imageWidth);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (width)");
+	status = clSetKernelArg(kernelTileZero, 2, sizeof(cl_mem), &flatTileBuffer);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (tileList)");
+
+	size_t globalThreads[] = { FLAT_TILE, FLAT_TILE * (size_t)tileCounts[1] };
+	status = clEnqueueNDRangeKernel(strip.queue, kernelTileZero, 2, NULL, globalThreads, NULL, 0, NULL, NULL);
+	CHECK_OPENCL_ERROR(status, "clEnqueueNDRangeKernel failed. (tile_zero)");
+
+	return SDK_SUCCESS;
+}
+
+int
+EdgeDetector::cleanupFlatTiles()
+{
+	cl_int status;
+	cl_kernel flatKernels[] = { kernelTileRange, kernelTileLists, kernelTileZero };
+	for (int k = 0; k < 3; k++)
+	{
+		if (flatKernels[k] != NULL)
+		{
+			status = clReleaseKernel(flatKernels[k]);
+			CHECK_OPENCL_ERROR(status, "clReleaseKernel failed. (flat tiles)");
+		}
+	}
+	kernelTileRange = kernelTileLists = kernelTileZero = NULL;
+
+	if (programFlat != NULL)
+	{
+		status = clReleaseProgram(programFlat);
+		CHECK_OPENCL_ERROR(status, "clReleaseProgram failed. (flat tiles)");
+		programFlat = NULL;
+	}
+
+	cl_mem flatBuffers[] = { tileRangeBuffer, tileCountBuffer, runTileBuffer, flatTileBuffer };
+	for (int b = 0; b < 4; b++)
+	{
+		if (flatBuffers[b] != NULL)
+		{
+			status = clReleaseMemObject(flatBuffers[b]);
+			CHECK_OPENCL_ERROR(status, "clReleaseMemObject failed. (flat tiles)");
+		}
+	}
+	tileRangeBuffer = tileCountBuffer = runTileBuffer = flatTileBuffer = NULL;
+
+	return SDK_SUCCESS;
+}
+
+int
+EdgeDetector::setupSweep()
+{
+	if (!isSweep())
+	{
+		return SDK_SUCCESS;
+	}
+	if (tileRows != 0 || !regions.empty() || !pyramid.empty() || incrementalRows > 0 || flatThreshold >= 0 ||
+		borderMode != NATIVE_BORDER_LEGACY || edgeListMode || packedOutput || streaming || isVideo())
+	{
+		std::cout << "--sweep-sigma and --sweep-thresholds write whole-image edge maps; they do not combine "
+			<< "with strips, --roi, --pyramid, --incremental, --flat-threshold, --border, --edge-list, "
+			<< "--packed-output, --stream or --video" << std::endl;
+		return SDK_FAILURE;
+	}
+
+	// Either list defaults to the setting of a normal run
+	std::string sigmaList = sweepSigmaList.empty() ? "0" : sweepSigmaList;
+	for (size_t pos = 0; pos < sigmaList.size();)
+	{
+		size_t end = sigmaList.find(',', pos);
+		SweepPrefix prefix;
+		prefix.name = sigmaList.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+		float sigma;
+		char extra;
+		if (sscanf(prefix.name.c_str(), "%f%c", &sigma, &extra) != 1 || sigma < 0)
+		{
+			std::cout << "Bad --sweep-sigma " << prefix.name << ", expected a sigma >= 0" << std::endl;
+			return SDK_FAILURE;
+		}
+		// Sampled at -1, 0 and 1 and normalized; sigma 0.85 is close to 1-2-1
+		float e = sigma > 0 ? (float)exp(-1.0 / (2.0 * sigma * sigma)) : 0.5f;
+		prefix.side = e / (1 + 2 * e);
+		prefix.nmsBuffer = NULL;
+		prefix.nmsPlane = NULL;
+		sweepPrefixes.push_back(prefix);
+		pos = end == std::string::npos ? sigmaList.size() : end + 1;
+	}
+
+	std::string thresholdList = sweepThresholdList.empty() ? "20/70" : sweepThresholdList;
+	for (size_t pos = 0; pos < thresholdList.size();)
+	{
+		size_t end = thresholdList.find(',', pos);
+		std::string item = thresholdList.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+		SweepThresholds pair;
+		char extra;
+		if (sscanf(item.c_str(), "%u/%u%c", &pair.low, &pair.high, &extra) != 2 ||
+			pair.low > pair.high || pair.high > 255)
+		{
+			std::cout << "Bad --sweep-thresholds pair " << item << ", expected low/high up to 255" << std::endl;
+			return SDK_FAILURE;
+		}
+		sweepThresholds.push_back(pair);
+		pos = end == std::string::npos ? thresholdList.size() : end + 1;
+	}
+
+	size_t pixels = (size_t)width * height;
+	size_t outputPixels = (size_t)width_original * height_original;
+	for (size_t t = 0; t < sweepThresholds.size(); t++)
+	{
+		// Pixels past the processed region stay black
+		cl_uchar4* output = (cl_uchar4*)malloc(outputPixels * pixelSize);
+		CHECK_ALLOCATION(output, "Failed to allocate memory! (sweep output)");
+		memset(output, 0, outputPixels * pixelSize);
+		sweepOutputs.push_back(output);
+	}
+
+	if (sdkContext->isNativeDevice())
+	{
+		for (size_t p = 0; p < sweepPrefixes.size(); p++)
+		{
+			sweepPrefixes[p].nmsPlane = (cl_uchar*)malloc(pixels);
+			CHECK_ALLOCATION(sweepPrefixes[p].nmsPlane, "Failed to allocate memory! (sweep max plane)");
+		}
+		return SDK_SUCCESS;
+	}
+
+	cl_int status;
+	kernelGausWeighted = clCreateKernel(programGaus, "gaussian_weighted", &status);
+	CHECK_OPENCL_ERROR(status, "clCreateKernel failed. (gaussian_weighted)");
+	kernelHystThreshold = clCreateKernel(programHyst, "Hyst_threshold_filter", &status);
+	CHECK_OPENCL_ERROR(status, "clCreateKernel failed. (Hyst_threshold_filter)");
+
+	for (size_t p = 0; p < sweepPrefixes.size(); p++)
+	{
+		sweepPrefixes[p].nmsBuffer = clCreateBuffer(context, CL_MEM_READ_WRITE, pixels * pixelSize, NULL, &status);
+		CHECK_OPENCL_ERROR(status, "clCreateBuffer failed. (sweep max output)");
+	}
+	for (size_t t = 0; t < sweepThresholds.size(); t++)
+	{
+		cl_mem buffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR, pixels * pixelSize,
+			NULL, &status);
+		CHECK_OPENCL_ERROR(status, "clCreateBuffer failed. (sweep output)");
+		sweepOutputBuffers.push_back(buffer);
+	}
+
+	return SDK_SUCCESS;
+}
+
+int
+EdgeDetector::GaussianWeighted(const StripContext& strip, float side)
+{
+	cl_int status;
+
+	status = clSetKernelArg(kernelGausWeighted, 0, sizeof(cl_mem), &strip.prevBuffer);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (inputImage)");
+	status = clSetKernelArg(kernelGausWeighted, 1, sizeof(cl_mem), &strip.nextBuffer);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (outputImage)");
+	status = clSetKernelArg(kernelGausWeighted, 2, sizeof(cl_float), &side);
+	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (side)");
+
+	return enqueueStage(strip, kernelGausWeighted);
+}
+
+int
+EdgeDetector::runSweep(std::string outputImageName)
+{
+	if (!byteRWSupport)
+	{
+		return SDK_SUCCESS;
+	}
+
+	int status;
+	cl_int clStatus;
+	size_t pixels = (size_t)width * height;
+	bool native = sdkContext->isNativeDevice();
+	int timer = sampleTimer->createTimer();
+
+	// Every sigma runs greyscale to max once; its max output is kept for the threshold pairs
+	sampleTimer->resetTimer(timer);
+	sampleTimer->startTimer(timer);
+	for (size_t p = 0; p < sweepPrefixes.size(); p++)
+	{
+		SweepPrefix& prefix = sweepPrefixes[p];
+		if (native)
+		{
+			nativeDetector.setGaussianSide(prefix.side);
+			status = nativeDetector.run(inputImageData, outputImageData, height);
+			CHECK_ERROR(status, SDK_SUCCESS, "NativeEdgeDetector::run() failed");
+			memcpy(prefix.nmsPlane, nativeDetector.getMaxPlane(), pixels);
+			continue;
+		}
+
+		// The max output lands in the buffer kept for the sigma instead of being copied there
+		StripContext strip = wholeImage();
+		cl_mem& nmsBuffer = fusedNms ? strip.prevBuffer : strip.nextBuffer;
+		if (strip.inputBuffer == nmsBuffer)
+		{
+			strip.inputBuffer = prefix.nmsBuffer;
+		}
+		nmsBuffer = prefix.nmsBuffer;
+
+		if (uploadInput(strip, 0, CL_FALSE) != SDK_SUCCESS || GreyScale(strip) != SDK_SUCCESS)
+		{
+			return SDK_FAILURE;
+		}
+		// Sigma 0 keeps the gaussian_filter, and the arithmetic, of a normal run
+		status = prefix.side == 0.25f ? Gaussian(strip) : GaussianWeighted(strip, prefix.side);
+		if (status != SDK_SUCCESS || SobelMax(strip) != SDK_SUCCESS)
+		{
+			return SDK_FAILURE;
+		}
+	}
+	if (!native)
+	{
+		clStatus = clFinish(commandQueue);
+		CHECK_OPENCL_ERROR(clStatus, "clFinish failed.");
+	}
+	sampleTimer->stopTimer(timer);
+	double prefixTime = sampleTimer->readTimer(timer);
+
+	size_t dot = outputImageName.find_last_of('.');
+	size_t slash = outputImageName.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+	{
+		dot = outputImageName.size();
+	}
+
+	double thresholdTime = 0;
+	int failed = 0;
+	for (size_t p = 0; p < sweepPrefixes.size(); p++)
+	{
+		SweepPrefix& prefix = sweepPrefixes[p];
+
+		// Hysteresis of every pair and the reads back go out as one submission
+		sampleTimer->resetTimer(timer);
+		sampleTimer->startTimer(timer);
+		for (size_t t = 0; t < sweepThresholds.size(); t++)
+		{
+			if (native)
+			{
+				nativeDetector.setThresholds(sweepThresholds[t].low, sweepThresholds[t].high);
+				status = nativeDetector.threshold(prefix.nmsPlane, sweepOutputs[t]);
+				CHECK_ERROR(status, SDK_SUCCESS, "NativeEdgeDetector::threshold() failed");
+				continue;
+			}
+
+			cl_float low = (cl_float)sweepThresholds[t].low;
+			cl_float high = (cl_float)sweepThresholds[t].high;
+			clStatus = clSetKernelArg(kernelHystThreshold, 0, sizeof(cl_mem), &prefix.nmsBuffer);
+			CHECK_OPENCL_ERROR(clStatus, "clSetKernelArg failed. (inputImage)");
+			clStatus = clSetKernelArg(kernelHystThreshold, 1, sizeof(cl_mem), &sweepOutputBuffers[t]);
+			CHECK_OPENCL_ERROR(clStatus, "clSetKernelArg failed. (outputImage)");
+			clStatus = clSetKernelArg(kernelHystThreshold, 2, sizeof(cl_float), &low);
+			CHECK_OPENCL_ERROR(clStatus, "clSetKernelArg failed. (lowThresh)");
+			clStatus = clSetKernelArg(kernelHystThreshold, 3, sizeof(cl_float), &high);
+			CHECK_OPENCL_ERROR(clStatus, "clSetKernelArg failed. (highThresh)");
+			status = enqueueStage(wholeImage(), kernelHystThreshold);
+			CHECK_ERROR(status, SDK_SUCCESS, "enqueueStage() failed");
+
+			clStatus = clEnqueueReadBuffer(commandQueue, sweepOutputBuffers[t], CL_FALSE, 0,
+				pixels * pixelSize, sweepOutputs[t], 0, NULL, NULL);
+			CHECK_OPENCL_ERROR(clStatus, "clEnqueueReadBuffer failed. (sweep output)");
+		}
+		if (!native)
+		{
+			clStatus = clFinish(commandQueue);
+			CHECK_OPENCL_ERROR(clStatus, "clFinish failed.");
+		}
+		sampleTimer->stopTimer(timer);
+		thresholdTime += sampleTimer->readTimer(timer);
+
+		if (sdkContext->verify)
+		{
+			status = setupReference();
+			CHECK_ERROR(status, SDK_SUCCESS, "setupReference() failed");
+			nativeReference.setGaussianSide(prefix.side);
+			status = nativeReference.run(inputImageData, (cl_uchar4*)verificationOutput);
+			CHECK_ERROR(status, SDK_SUCCESS, "NativeEdgeDetector::run() failed");
+		}
+
+		for (size_t t = 0; t < sweepThresholds.size(); t++)
+		{
+			const SweepThresholds& pair = sweepThresholds[t];
+			std::string name = "_sigma" + prefix.name + "_" + toString(pair.low, std::dec) + "-" +
+				toString(pair.high, std::dec);
+			std::string fileName = outputImageName.substr(0, dot) + name + outputImageName.substr(dot);
+			if (writeImage(fileName, sweepOutputs[t], width_original, height_original, imagePitch) != SDK_SUCCESS)
+			{
+				return SDK_FAILURE;
+			}
+
+			size_t edges = 0;
+			for (size_t i = 0; i < pixels; i++)
+			{
+				edges += sweepOutputs[t][i].s[0] != 0;
+			}
+			std::cout << "Sigma " << prefix.name << ", thresholds " << pair.low << "/" << pair.high << ": "
+				<< edges << " edges, " << fileName << std::endl;
+
+			if (sdkContext->verify)
+			{
+				nativeReference.setThresholds(pair.low, pair.high);
+				status = nativeReference.threshold(nativeReference.getMaxPlane(), (cl_uchar4*)verificationOutput);
+				CHECK_ERROR(status, SDK_SUCCESS, "NativeEdgeDetector::threshold() failed");
+				failed |= checkStage(name.c_str() + 1, verificationOutput, (const cl_uchar*)sweepOutputs[t],
+					pixels * pixelSize, 1, pixelSize, VERIFY_TOL_HYST, false);
+			}
+		}
+	}
+
+	// Without the kept prefixes every pair would run the whole pipeline
+	size_t prefixCount = sweepPrefixes.size();
+	size_t runs = prefixCount * sweepThresholds.size();
+	std::cout << "Sweep: " << prefixCount << " prefix runs in " << prefixTime << " s ("
+		<< prefixTime / prefixCount << " s each), " << runs << " hysteresis runs in " << thresholdTime
+		<< " s (" << thresholdTime / runs << " s each); " << runs << " full runs would take about "
+		<< runs * (prefixTime / prefixCount + thresholdTime / runs) << " s" << std::endl;
+	kernelTime = prefixTime + thresholdTime;
+
+	if (sdkContext->verify)
+	{
+		if (failed)
+		{
+			std::cout << "Failed\n" << std::endl;
+			return SDK_FAILURE;
+		}
+		std::cout << "Passed!\n" << std::endl;
+	}
+
+	return SDK_SUCCESS;
+}
+
+int
+EdgeDetector::cleanupSweep()
+{
+	cl_int status;
+	cl_kernel sweepKernels[] = { kernelGausWeighted, kernelHystThreshold };
+	for (int k = 0; k < 2; k++)
+	{
+		if (sweepKernels[k] != NULL)
+		{
+			status = clReleaseKernel(sweepKernels[k]);
+			CHECK_OPENCL_ERROR(status, "clReleaseKernel failed. (sweep)");
+		}
+	}
+	kernelGausWeighted = kernelHystThreshold = NULL;
+
+	for (size_t p = 0; p < sweepPrefixes.size(); p++)
+	{
+		if (sweepPrefixes[p].nmsBuffer != NULL)
+		{
+			status = clReleaseMemObject(sweepPrefixes[p].nmsBuffer);
+			CHECK_OPENCL_ERROR(status, "clReleaseMemObject failed. (sweep max output)");
+		}
+		FREE(sweepPrefixes[p].nmsPlane);
+	}
+	sweepPrefixes.clear();
+
+	for (size_t t = 0; t < sweepOutputBuffers.size(); t++)
+	{
+		status = clReleaseMemObject(sweepOutputBuffers[t]);
+		CHECK_OPENCL_ERROR(status, "clReleaseMemObject failed. (sweep output)");
+	}
+	sweepOutputBuffers.clear();
+
+	for (size_t t = 0; t < sweepOutputs.size(); t++)
+	{
+		FREE(sweepOutputs[t]);
+	}
+	sweepOutputs.clear();
+
+	return SDK_SUCCESS;
+}
+
+int
+EdgeDetector::setupOutputs()
+{
+	for (size_t pos = 0; pos < outputList.size();)
+	{
+		size_t end = outputList.find(',', pos);
+		std::string name = outputList.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+		int o = 0;
+		while (o < EDGE_OUTPUT_COUNT && name != EDGE_OUTPUT_NAMES[o])
+		{
+			o++;
+		}
+		if (o == EDGE_OUTPUT_COUNT)
+		{
+			std::cout << "Bad --outputs name " << name << ", expected smoothed, magnitude, direction, nms "
+				<< "or edges" << std::endl;
+			return SDK_FAILURE;
+		}
+		outputRequested[o] = true;
+		pos = end == std::string::npos ? outputList.size() : end + 1;
+	}
+
+	if (!hasOutputs())
+	{
+		return SDK_SUCCESS;
+	}
+	if (tileRows != 0 || !regions.empty() || !pyramid.empty() || incrementalRows > 0 || flatThreshold >= 0 ||
+		edgeListMode || packedOutput || streaming || isVideo() || isSweep())
+	{
+		std::cout << "--outputs keeps the intermediates of the whole image; it does not combine with strips, "
+			<< "--roi, --pyramid, --incremental, --flat-threshold, --edge-list, --packed-output, --stream, "
+			<< "--video or a sweep" << std::endl;
+		return SDK_FAILURE;
+	}
+	if (sdkContext->isNativeDevice())
+	{
+		// The native detector keeps every stage in a plane of its own
+		return SDK_SUCCESS;
+	}
+	if ((outputRequested[EDGE_OUTPUT_MAGNITUDE] || outputRequested[EDGE_OUTPUT_DIRECTION]) &&
+		(fusedNms || packedGradient))
+	{
+		std::cout << "Magnitude and direction outputs need the split sobel output, not --fused or "
+			<< "--intermediate packed" << std::endl;
+		return SDK_FAILURE;
+	}
+
+	size_t pixels = (size_t)width * height;
+	cl_int status;
+	for (int o = 0; o < EDGE_OUTPUT_EDGES; o++)
+	{
+		if (!outputRequested[o])
+		{
+			continue;
+		}
+		size_t bytes = pixels * (o == EDGE_OUTPUT_DIRECTION ? thetaBytes : pixelSize);
+		outputBuffers[o] = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, bytes, NULL,
+			&status);
+		CHECK_OPENCL_ERROR(status, "clCreateBuffer failed. (outputBuffers)");
+	}
+
+	return SDK_SUCCESS;
+}
+
+int
+EdgeDetector::keepOutput(EdgeOutput output, cl_mem buffer)
+{
+	if (outputBuffers[output] == NULL)
+	{
+		return SDK_SUCCESS;
+	}
+
+	size_t pixels = (size_t)width * height;
+	size_t bytes = pixels * (output == EDGE_OUTPUT_DIRECTION ? thetaBytes : pixelSize);
+	cl_int status = clEnqueueCopyBuffer(commandQueue, buffer, outputBuffers[output], 0, 0, bytes,
+		0, NULL, NULL);
+	CHECK_OPENCL_ERROR(status, "clEnqueueCopyBuffer failed. (outputBuffers)");
+
+	return SDK_SUCCESS;
+}
+
+int
+EdgeDetector::mapOutputs(const StripContext& strip)
+{
+	size_t pixels = (size_t)width * height;
+	cl_int status;
+
+	status = clEnqueueReadBuffer(strip.queue, strip.prevBuffer, CL_FALSE, 0, pixels * pixelSize,
+		outputImageData, 0, NULL, NULL);
+	CHECK_OPENCL_ERROR(status, "clEnqueueReadBuffer failed.");
+
+	for (int o = 0; o < EDGE_OUTPUT_EDGES; o++)
+	{
+		if (outputBuffers[o] == NULL)
+		{
+			continue;
+		}
+		size_t bytes = pixels * (o == EDGE_OUTPUT_DIRECTION ? thetaBytes : pixelSize);
+		mappedOutputs[o] = (cl_uchar*)clEnqueueMapBuffer(strip.queue, outputBuffers[o], CL_FALSE,
+			CL_MAP_READ, 0, bytes, 0, NULL, NULL, &status);
+		CHECK_OPENCL_ERROR(status, "clEnqueueMapBuffer failed. (outputBuffers)");
+	}
+
+	status = clFinish(strip.queue);
+	CHECK_OPENCL_ERROR(status, "clFinish failed.");
+
+	return SDK_SUCCESS;
+}
+
+int
+EdgeDetector::unmapOutputs()
+{
+	cl_int status;
+	for (int o = 0; o < EDGE_OUTPUT_EDGES; o++)
+	{
+		if (mappedOutputs[o] == NULL)
+		{
+			continue;
+		}
+		// In order on the queue, so the copies of the next run wait for it
+		status = clEnqueueUnmapMemObject(commandQueue, outputBuffers[o], mappedOutputs[o], 0, NULL, NULL);
+		CHECK_OPENCL_ERROR(status, "clEnqueueUnmapMemObject failed. (outputBuffers)");
+		mappedOutputs[o] = NULL;
+	}
+
+	return SDK_SUCCESS;
+}
+
+const cl_uchar*
+EdgeDetector::getOutput(EdgeOutput output, cl_uint* stride) const
+{
+	if (!outputRequested[output])
+	{
+		return NULL;
+	}
+	if (output == EDGE_OUTPUT_EDGES)
+	{
+		*stride = pixelSize;
+		return (const cl_uchar*)outputImageData;
+	}
+	if (!sdkContext->isNativeDevice())
+	{
+		*stride = output == EDGE_OUTPUT_DIRECTION ? 1 : pixelSize;
+		return mappedOutputs[output];
+	}
+
+	*stride = 1;
+	switch (output)
+	{
+	case EDGE_OUTPUT_SMOOTHED:
+		return nativeDetector.getGaussianPlane();
+	case EDGE_OUTPUT_MAGNITUDE:
+		return nativeDetector.getMagnitudePlane();
+	case EDGE_OUTPUT_DIRECTION:
+		return nativeDetector.getThetaPlane();
+	default:
+		return nativeDetector.getMaxPlane();
+	}
+}
+
+int
+EdgeDetector::writeOutputs(std::string outputImageName)
+{
+	size_t dot = outputImageName.find_last_of('.');
+	size_t slash = outputImageName.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+	{
+		dot = outputImageName.size();
+	}
+
+	// Laid out like outputImageData; pixels past the processed area stay black
+	size_t pixels = (size_t)width * height;
+	size_t outputPixels = (size_t)width_original * height_original;
+	cl_uchar4* image = (cl_uchar4*)malloc(outputPixels * sizeof(cl_uchar4));
+	CHECK_ALLOCATION(image, "Failed to allocate memory! (output image)");
+	memset(image, 0, outputPixels * sizeof(cl_uchar4));
+
+	int status = SDK_SUCCESS;
+	for (int o = 0; o < EDGE_OUTPUT_EDGES && status == SDK_SUCCESS; o++)
+	{
+		cl_uint stride;
+		const cl_uchar* data = getOutput((EdgeOutput)o, &stride);
+		if (data == NULL)
+		{
+			continue;
+		}
+
+		// Directions are drawn in degrees
+		cl_uint scale = o == EDGE_OUTPUT_DIRECTION ? getDirectionScale() : 1;
+		for (size_t i = 0; i < pixels; i++)
+		{
+			cl_uchar value = (cl_uchar)(data[i * stride] * scale);
+			image[i].s[0] = image[i].s[1] = image[i].s[2] = value;
+			image[i].s[3] = 0;
+		}
+
+		std::string name = outputImageName.substr(0, dot) + "_" + EDGE_OUTPUT_NAMES[o] +
+			outputImageName.substr(dot);
+		status = writeImage(name, image, width_original, height_original, imagePitch);
+	}
+
+	FREE(image);
+	return status;
+}
+
+int
+EdgeDetector::cleanupOutputs()
+{
+	if (sdkContext->isNativeDevice())
+	{
+		return SDK_SUCCESS;
+	}
+
+	int retValue = unmapOutputs();
+	CHECK_ERROR(retValue, SDK_SUCCESS, "unmapOutputs() failed");
+
+	cl_int status;
+	for (int o = 0; o < EDGE_OUTPUT_EDGES; o++)
+	{
+		if (outputBuffers[o] != NULL)
+		{
+			status = clReleaseMemObject(outputBuffers[o]);
+			CHECK_OPENCL_ERROR(status, "clReleaseMemObject failed. (outputBuffers)");
+			outputBuffers[o] = NULL;
+		}
+	}
+
+	return SDK_SUCCESS;
+}
+
+int
+EdgeDetector::updateRows(size_t y0, size_t y1)
+{
+	if (sdkContext->isNativeDevice())
+	{
+		return nativeDetector.update(inputImageData, outputImageData, (cl_uint)y0, (cl_uint)y1);
+	}
+
+	// An output row depends on the input rows up to TILE_HALO away
+	size_t top = y0 > TILE_HALO ? y0 - TILE_HALO : 0;
+	size_t bottom = y1 + TILE_HALO < height ? y1 + TILE_HALO : height;
+	return runCLTiles(top, bottom, 0, width);
+}
+
+int
+EdgeDetector::runIncremental(size_t& dirtyTiles)
+{
+	size_t rowBytes = (size_t)width * inputPixelBytes;
+	size_t tileCount = (height + incrementalRows - 1) / incrementalRows;
+	const cl_uchar* current = (const cl_uchar*)inputImageData;
+	size_t runStart = height;
+
+	// Neighbouring changed tiles are rerun together, so their halos are processed once
+	dirtyTiles = 0;
+	for (size_t t = 0; t <= tileCount; t++)
+	{
+		size_t y0 = t * incrementalRows < height ? t * incrementalRows : height;
+		size_t y1 = y0 + incrementalRows < height ? y0 + incrementalRows : height;
+		size_t offset = y0 * rowBytes;
+		size_t bytes = (y1 - y0) * rowBytes;
+
+		if (t < tileCount && memcmp(current + offset, previousInput + offset, bytes) != 0)
+		{
+			memcpy(previousInput + offset, current + offset, bytes);
+			if (runStart == height)
+			{
+				runStart = y0;
+			}
+			dirtyTiles++;
+			continue;
+		}
+
+		if (runStart != height)
+		{
+			if (updateRows(runStart, y0) != SDK_SUCCESS)
+			{
+				return SDK_FAILURE;
+			}
+			runStart = height;
+		}
+	}
+
+	return SDK_SUCCESS;
+}
+
+
+int
+EdgeDetector::runStream(std::string inputImageName, std::string outputImageName)
+{
+	if (imageFileType(inputImageName) != IMAGE_FILE_BMP || imageFileType(outputImageName) != IMAGE_FILE_BMP)
+	{
+		std::cout << "--stream reads and writes BMP only" << std::endl;
+		return SDK_FAILURE;
+	}
+	if (!regionList.empty() || !regions.empty() || pyramidLevels > 1 || edgeListMode || packedOutput)
+	{
+		std::cout << "--roi, --pyramid, --edge-list and --packed-output need the whole image, not --stream" << std::endl;
+		return SDK_FAILURE;
+	}
+
+	BitMapStripReader reader;
+	if (!reader.open(inputImageName.c_str()))
+	{
+		std::cout << "Failed to load input image!";
+		return SDK_FAILURE;
+	}
+
+	cl_uint imageWidth = reader.getWidth();
+	cl_uint imageHeight = reader.getHeight();
+	size_t stripRows = forcedTileRows > 0 ? forcedTileRows : STREAM_STRIP_ROWS;
+	size_t bufferRows = stripRows + 2 * TILE_HALO;
+	if (bufferRows > imageHeight)
+	{
+		bufferRows = imageHeight;
+	}
+
+	// The detector is set up for one strip; --tile-rows sized the strip already
+	forcedTileRows = 0;
+	width = (imageWidth / GROUP_SIZE) * GROUP_SIZE;
+	height = bufferRows;
+	width_original = width;
+	height_original = bufferRows;
+
+	inputImageData = (cl_uchar4*)malloc(width * bufferRows * pixelSize);
+	CHECK_ALLOCATION(inputImageData, "Failed to allocate memory! (inputImageData)");
+	outputImageData = (cl_uchar4*)malloc(width * bufferRows * pixelSize);
+	CHECK_ALLOCATION(outputImageData, "Failed to allocate memory! (outputImageData)");
+	verificationOutput = (cl_uchar*)malloc(width * bufferRows * pixelSize);
+	CHECK_ALLOCATION(verificationOutput, "verificationOutput heap allocation failed!");
+
+	int status = setup();
+	if (status != SDK_SUCCESS)
+	{
+		return status;
+	}
+
+	BitMapStripWriter writer;
+	if (!writer.open(outputImageName.c_str(), imageWidth, imageHeight, greyOutput ? 8 : 24))
+	{
+		std::cout << "Failed to write output image!";
+		return SDK_FAILURE;
+	}
+
+	int timer = sampleTimer->createTimer();
+	sampleTimer->resetTimer(timer);
+	sampleTimer->startTimer(timer);
+
+	for (size_t y0 = 0; y0 < imageHeight; y0 += stripRows)
+	{
+		size_t y1 = y0 + stripRows < imageHeight ? y0 + stripRows : imageHeight;
+		size_t top = y0 > TILE_HALO ? y0 - TILE_HALO : 0;
+		size_t bottom = y1 + TILE_HALO < imageHeight ? y1 + TILE_HALO : imageHeight;
+
+		if (!reader.readRows((int)top, (int)(bottom - top), (uchar4*)inputImageData, width))
+		{
+			std::cout << "Failed to read input rows " << top << " to " << bottom << std::endl;
+			return SDK_FAILURE;
+		}
+
+		height = bottom - top;
+		if (runKernels() != SDK_SUCCESS)
+		{
+			return SDK_FAILURE;
+		}
+
+		// Halo rows are only context; write the rows this strip owns
+		if (!writer.writeRows((const uchar4*)(outputImageData + (y0 - top) * width), (int)(y1 - y0), width))
+		{
+			std::cout << "Failed to write output image!";
+			return SDK_FAILURE;
+		}
+	}
+
+	if (!writer.close())
+	{
+		std::cout << "Failed to write output image!";
+		return SDK_FAILURE;
+	}
+
+	sampleTimer->stopTimer(timer);
+	kernelTime = (double)(sampleTimer->readTimer(timer));
+
+	// Strip buffers stay allocated for bufferRows; report the image size
+	height = imageHeight;
+
+	return SDK_SUCCESS;
+}
+
+int
+EdgeDetector::runVideo()
+{
+	VideoFormat format;
+	if (!parseVideoFormat(videoFormat, format))
+	{
+		std::cout << "Unknown --video format " << videoFormat << std::endl;
+		return SDK_FAILURE;
+	}
+	if (incrementalRows > 0 && (!regionList.empty() || !regions.empty()))
+	{
+		// Incremental updates rely on every row of the previous frame being computed
+		std::cout << "--incremental cannot be combined with --roi" << std::endl;
+		return SDK_FAILURE;
+	}
+	if (edgeListMode || packedOutput)
+	{
+		std::cout << "--video writes edge maps, not --edge-list or --packed-output" << std::endl;
+		return SDK_FAILURE;
+	}
+
+	videoBinaryMode(stdin);
+	videoBinaryMode(stdout);
+
+	VideoFrameReader reader;
+	if (!reader.open(stdin, format, rawWidth, rawHeight))
+	{
+		return SDK_FAILURE;
+	}
+
+	// The luminance plane is the greyscale input; chroma is skipped
+	width_original = reader.getWidth();
+	height_original = reader.getHeight();
+	width = (width_original / GROUP_SIZE) * GROUP_SIZE;
+	height = (height_original / GROUP_SIZE) * GROUP_SIZE;
+	inputFormat = NATIVE_INPUT_LUMA;
+	inputPixelBytes = 1;
+	inputTopDown = true;
+
+	// Frames are held at the processed row pitch; the writer pads them back to width_original
+	size_t pixels = (size_t)width * height_original;
+	inputImageData = (cl_uchar4*)malloc(pixels);
+	CHECK_ALLOCATION(inputImageData, "Failed to allocate memory! (inputImageData)");
+	outputImageData = (cl_uchar4*)malloc(pixels * pixelSize);
+	CHECK_ALLOCATION(outputImageData, "Failed to allocate memory! (outputImageData)");
+	verificationOutput = (cl_uchar*)malloc(pixels * pixelSize);
+	CHECK_ALLOCATION(verificationOutput, "verificationOutput heap allocation failed!");
+
+	// Pixels past the processed region stay black
+	memset(outputImageData, 0, pixels * pixelSize);
 
-	pixelData = inputPixels;
-	if (pixelData == NULL)
+	int status = setup();
+	if (status != SDK_SUCCESS)
 	{
-		std::cout << "Failed to read pixel Data!";
+		return status;
+	}
+
+	size_t tileCount = 0;
+	size_t inputBytes = (size_t)width * height * inputPixelBytes;
+	if (incrementalRows > 0)
+	{
+		previousInput = (cl_uchar*)malloc(inputBytes);
+		CHECK_ALLOCATION(previousInput, "Failed to allocate memory! (previousInput)");
+		tileCount = (height + incrementalRows - 1) / incrementalRows;
+	}
+
+	VideoFrameWriter writer;
+	if (!writer.open(stdout, format, width_original, height_original, reader.getChromaBytes(),
+		reader.getHeader()))
+	{
+		std::cout << "Failed to write video header" << std::endl;
 		return SDK_FAILURE;
 	}
 
-	// Copy pixel data into inputImageData
-	memcpy(inputImageData, pixelData, width_original * height_original * pixelSize);
-	// allocate memory for verification output
-	verificationOutput = (cl_uchar*)malloc(width_original * height_original * pixelSize);
-	CHECK_ALLOCATION(verificationOutput,
-		"verificationOutput heap allocation failed!");
+	if (canaryPeriod > 0)
+	{
+		// Start sampling at a random frame so the canary does not always see frame 0
+		canaryStart = (int)(std::random_device()() % (unsigned int)canaryPeriod);
+	}
 
-	// initialize the data to NULL
-	memset(verificationOutput, 0, width_original * height_original * pixelSize);
+	int timer = sampleTimer->createTimer();
+	sampleTimer->resetTimer(timer);
+	sampleTimer->startTimer(timer);
 
-	return SDK_SUCCESS;
+	int frames = 0;
+	size_t dirtySum = 0;
+	int unchangedFrames = 0;
+	for (;;)
+	{
+		bool endOfStream = false;
+		if (!reader.readFrame((unsigned char*)inputImageData, width, endOfStream))
+		{
+			std::cout << "Failed to read frame " << frames << std::endl;
+			return SDK_FAILURE;
+		}
+		if (endOfStream)
+		{
+			break;
+		}
 
-}
+		if (incrementalRows > 0 && frames > 0)
+		{
+			// Tiles equal to the previous frame keep their edges in outputImageData
+			size_t dirtyTiles = 0;
+			if (runIncremental(dirtyTiles) != SDK_SUCCESS)
+			{
+				return SDK_FAILURE;
+			}
+			dirtySum += dirtyTiles;
+			unchangedFrames += dirtyTiles == 0 ? 1 : 0;
+			if (!sdkContext->quiet)
+			{
+				std::cout << "Frame " << frames << ": " << dirtyTiles << " of " << tileCount
+					<< " tiles dirty (" << 100.0 * dirtyTiles / tileCount << "%)" << std::endl;
+			}
+		}
+		else
+		{
+			if (runKernels() != SDK_SUCCESS)
+			{
+				return SDK_FAILURE;
+			}
+			if (incrementalRows > 0)
+			{
+				memcpy(previousInput, inputImageData, inputBytes);
+			}
+			if (flatThreshold >= 0 && !sdkContext->quiet)
+			{
+				size_t flatTiles = (size_t)(width / FLAT_TILE) * (height / FLAT_TILE);
+				std::cout << "Frame " << frames << ": " << flatTiles - tileCounts[0] << " of " << flatTiles
+					<< " tiles skipped (" << 100.0 * (flatTiles - tileCounts[0]) / flatTiles << "%)" << std::endl;
+			}
+		}
 
+		if (canarySample(frames, timer) != SDK_SUCCESS)
+		{
+			return SDK_FAILURE;
+		}
 
-int
-EdgeDetector::writeOutputImage(std::string outputImageName)
-{
-	// copy output image data back to original pixel data
-	memcpy(pixelData, outputImageData,
-		width_original * height_original * pixelSize);
+		if (!writer.writeFrame((const uchar4*)outputImageData, width))
+		{
+			std::cout << "Failed to write frame " << frames << std::endl;
+			return SDK_FAILURE;
+		}
+		frames++;
+	}
 
-	//inputBitmap.height = height;
-	//inputBitmap.width = width;
-	// write the output bmp file
-	if (!inputBitmap.write(outputImageName.c_str()))
+	if (!writer.close())
 	{
-		std::cout << "Failed to write output image!";
+		std::cout << "Failed to write video" << std::endl;
 		return SDK_FAILURE;
 	}
 
-	return SDK_SUCCESS;
-}
+	sampleTimer->stopTimer(timer);
+	double seconds = (double)(sampleTimer->readTimer(timer));
+	kernelTime = frames > 0 ? seconds / frames : 0;
 
-int
-EdgeDetector::writeOutputImage(SDKBitMap* outputImage)
-{
-	// copy output image data back to original pixel data
-	memcpy(pixelData, outputImageData,
-		width_original * height_original * pixelSize);
+	std::cout << frames << " frames of " << width_original << "x" << height_original;
+	if (seconds > 0)
+	{
+		std::cout << ", " << frames / seconds << " frames/s";
+	}
+	std::cout << std::endl;
 
-	//inputBitmap.height = height;
-	//inputBitmap.width = width;
-	// write the output bmp file
+	if (incrementalRows > 0 && frames > 1)
+	{
+		std::cout << "Incremental: " << 100.0 * dirtySum / ((frames - 1) * tileCount)
+			<< "% of " << tileCount << " tiles rerun per frame, " << unchangedFrames
+			<< " of " << frames - 1 << " frames unchanged" << std::endl;
+	}
 
-	outputImage = &inputBitmap;
+	if (canaryFrames > 0)
+	{
+		std::cout << "Canary: " << canaryFailures << " of " << canaryFrames
+			<< " frames outside tolerance" << std::endl;
+	}
 
 	return SDK_SUCCESS;
 }
 
 int
-EdgeDetector::writeOutputImage(uchar4* inputPixels)
+EdgeDetector::initialize()
 {
-	// copy output image data back to original pixel data
-	memcpy(inputPixels, outputImageData,
-		width_original * height_original * pixelSize);
+	cl_int status = 0;
+	// Call base class Initialize to get default configuration
+	status = sdkContext->initialize();
+	CHECK_ERROR(status, SDK_SUCCESS, "OpenCL Initialization failed");
 
-	return SDK_SUCCESS;
-}
+	Option* iteration_option = new Option;
+	CHECK_ALLOCATION(iteration_option, "Memory Allocation error.\n");
 
-int
-EdgeDetector::genBinaryImage()
-{
-	bifData binaryData;
-	binaryData.kernelName = std::string(SOBEL_FILTER_KERNEL);
-	binaryData.flagsStr = std::string("");
-	if (sdkContext->isComplierFlagsSpecified())
-	{
-		binaryData.flagsFileName = std::string(sdkContext->flags.c_str());
-	}
+	iteration_option->_sVersion = "i";
+	iteration_option->_lVersion = "iterations";
+	iteration_option->_description = "Number of iterations to execute kernel";
+	iteration_option->_type = CA_ARG_INT;
+	iteration_option->_value = &iterations;
 
-	binaryData.binaryName = std::string(sdkContext->dumpBinary.c_str());
-	int status = generateBinaryImage(binaryData, sdkContext);
-	return status;
-}
+	sdkContext->AddOption(iteration_option);
 
+	delete iteration_option;
 
-int
-EdgeDetector::setupCL()
-{
-	cl_int status = CL_SUCCESS;
-	cl_device_type dType;
+	Option* threads_option = new Option;
+	CHECK_ALLOCATION(threads_option, "Memory Allocation error.\n");
 
-	if (sdkContext->deviceType.compare("cpu") == 0)
-	{
-		dType = CL_DEVICE_TYPE_CPU;
-	}
-	else //deviceType = "gpu"
-	{
-		dType = CL_DEVICE_TYPE_GPU;
-		if (sdkContext->isThereGPU() == false)
-		{
-			std::cout << "GPU not found. Falling back to CPU device" << std::endl;
-			dType = CL_DEVICE_TYPE_CPU;
-		}
-	}
+	threads_option->_sVersion = "";
+	threads_option->_lVersion = "threads";
+	threads_option->_description = "Worker threads for --device native (0 = all cores)";
+	threads_option->_usage = "[value]";
+	threads_option->_type = CA_ARG_INT;
+	threads_option->_value = &threads;
 
-	cl_platform_id platform = sdkContext->platforms[sdkContext->chosen_platform];
+	sdkContext->AddOption(threads_option);
 
-	// Display available devices.
-	int retValue = displayDevices(platform, dType);
-	CHECK_ERROR(retValue, SDK_SUCCESS, "displayDevices() failed");
-	std::cout << "Selected Device: " << sdkContext->deviceId << std::endl;
+	delete threads_option;
 
-	// If we could find our platform, use it. Otherwise use just available platform.
-	cl_context_properties cps[3] =
-	{
-		CL_CONTEXT_PLATFORM,
-		(cl_context_properties)platform,
-		0
-	};
+	Option* canary_option = new Option;
+	CHECK_ALLOCATION(canary_option, "Memory Allocation error.\n");
 
-	context = clCreateContextFromType(
-		cps,
-		dType,
-		NULL,
-		NULL,
-		&status);
-	CHECK_OPENCL_ERROR(status, "clCreateContextFromType failed.");
+	canary_option->_sVersion = "";
+	canary_option->_lVersion = "canary";
+	canary_option->_description = "Verify one in N timed frames against the native reference (0 = off)";
+	canary_option->_usage = "[N]";
+	canary_option->_type = CA_ARG_INT;
+	canary_option->_value = &canaryPeriod;
 
-	// getting device on which to run the sample
-	status = getDevices(context, &devices, sdkContext->deviceId,
-		sdkContext->isDeviceIdEnabled());
-	CHECK_ERROR(status, SDK_SUCCESS, "getDevices() failed");
+	sdkContext->AddOption(canary_option);
 
-	{
-		// The block is to move the declaration of prop closer to its use
-		cl_command_queue_properties prop = 0;
-		commandQueue = clCreateCommandQueue(
-			context,
-			devices[sdkContext->deviceId],
-			prop,
-			&status);
-		CHECK_OPENCL_ERROR(status, "clCreateCommandQueue failed.");
-	}
+	delete canary_option;
 
-	//Set device info of given cl_device_id
-	retValue = deviceInfo.setDeviceInfo(devices[sdkContext->deviceId]);
-	CHECK_ERROR(retValue, 0, "SDKDeviceInfo::setDeviceInfo() failed");
+	Option* tile_option = new Option;
+	CHECK_ALLOCATION(tile_option, "Memory Allocation error.\n");
 
+	tile_option->_sVersion = "";
+	tile_option->_lVersion = "tile-rows";
+	tile_option->_description = "Process the image in strips of N rows (0 = only when it exceeds the device max allocation)";
+	tile_option->_usage = "[N]";
+	tile_option->_type = CA_ARG_INT;
+	tile_option->_value = &forcedTileRows;
 
-	// Create and initialize memory objects
+	sdkContext->AddOption(tile_option);
 
-	// Set Presistent memory only for AMD platform
-	cl_mem_flags inMemFlags = CL_MEM_READ_ONLY;
+	delete tile_option;
 
+	Option* stream_option = new Option;
+	CHECK_ALLOCATION(stream_option, "Memory Allocation error.\n");
 
-	// Create memory object for input Image
-	inputImageBuffer = clCreateBuffer(
-		context,
-		inMemFlags,
-		width_original * height_original * pixelSize,
-		0,
-		&status);
-	CHECK_OPENCL_ERROR(status, "clCreateBuffer failed. (inputImageBuffer)");
+	stream_option->_sVersion = "";
+	stream_option->_lVersion = "stream";
+	stream_option->_description = "Read, process and write the image in strips of --tile-rows rows";
+	stream_option->_usage = "";
+	stream_option->_type = CA_NO_ARGUMENT;
+	stream_option->_value = &streaming;
 
-	// Create memory objects for output Image
+	sdkContext->AddOption(stream_option);
 
-	nextImageBuffer = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR | CL_MEM_COPY_HOST_PTR,
-		width_original * height_original * pixelSize, inputImageData, &status);
+	delete stream_option;
 
-	prevImageBuffer = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
-		width_original * height_original * pixelSize, 0, &status);
+	Option* grey_option = new Option;
+	CHECK_ALLOCATION(grey_option, "Memory Allocation error.\n");
 
+	grey_option->_sVersion = "";
+	grey_option->_lVersion = "grey-output";
+	grey_option->_description = "Write the edge map as an 8 bit greyscale BMP (1/3 of the bytes)";
+	grey_option->_usage = "";
+	grey_option->_type = CA_NO_ARGUMENT;
+	grey_option->_value = &greyOutput;
 
+	sdkContext->AddOption(grey_option);
 
-	thetaBuffer = clCreateBuffer(context,
-		CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
-		width * height * pixelSize, 0, &status);
+	delete grey_option;
 
-	// create a CL program using the kernel source
-	buildProgramData buildDataGrey;
-	buildDataGrey.kernelName = std::string(GREYSCALE_KERNEL);
-	buildDataGrey.devices = devices;
-	buildDataGrey.deviceId = sdkContext->deviceId;
-	buildDataGrey.flagsStr = std::string("");
-	if (sdkContext->isLoadBinaryEnabled())
-	{
-		buildDataGrey.binaryName = std::string(sdkContext->loadBinary.c_str());
-	}
+	Option* input_option = new Option;
+	CHECK_ALLOCATION(input_option, "Memory Allocation error.\n");
 
-	if (sdkContext->isComplierFlagsSpecified())
-	{
-		buildDataGrey.flagsFileName = std::string(sdkContext->flags.c_str());
-	}
+	input_option->_sVersion = "";
+	input_option->_lVersion = "input";
+	input_option->_description = "Input image: .bmp, binary .pgm/.ppm, or a raw 8 bit plane (.raw/.y/.gray)";
+	input_option->_usage = "[file]";
+	input_option->_type = CA_ARG_STRING;
+	input_option->_value = &inputFile;
 
-	retValue = buildOpenCLProgram(programGrey, context, buildDataGrey);
-	CHECK_ERROR(retValue, 0, "buildOpenCLProgram() failed");
+	sdkContext->AddOption(input_option);
 
-	// get a kernel object handle for a kernel with the given name
-	kernelGrey = clCreateKernel(
-		programGrey,
-		"greyscale_filter",
-		&status);
-	CHECK_OPENCL_ERROR(status, "clCreateKernel failed.");
+	delete input_option;
 
-	status = kernelInfo.setKernelWorkGroupInfo(kernelGrey,
-		devices[sdkContext->deviceId]);
-	CHECK_ERROR(status, SDK_SUCCESS, "kernelInfo.setKernelWorkGroupInfo() failed");
+	Option* output_option = new Option;
+	CHECK_ALLOCATION(output_option, "Memory Allocation error.\n");
 
+	output_option->_sVersion = "";
+	output_option->_lVersion = "output";
+	output_option->_description = "Output image, format from the extension like --input";
+	output_option->_usage = "[file]";
+	output_option->_type = CA_ARG_STRING;
+	output_option->_value = &outputFile;
 
-	if ((blockSizeX * blockSizeY) > kernelInfo.kernelWorkGroupSize)
-	{
-		if (!sdkContext->quiet)
-		{
-			std::cout << "Out of Resources!" << std::endl;
-			std::cout << "Group Size specified : "
-				<< blockSizeX * blockSizeY << std::endl;
-			std::cout << "Max Group Size supported on the kernel : "
-				<< kernelWorkGroupSize << std::endl;
-			std::cout << "Falling back to " << kernelInfo.kernelWorkGroupSize << std::endl;
-		}
+	sdkContext->AddOption(output_option);
 
-		// Three possible cases
-		if (blockSizeX > kernelInfo.kernelWorkGroupSize)
-		{
-			blockSizeX = kernelInfo.kernelWorkGroupSize;
-			blockSizeY = 1;
-		}
-	}
+	delete output_option;
 
-	buildProgramData buildDataGaus;
-	buildDataGaus.kernelName = std::string(GAUSSIAN_KERNEL);
-	buildDataGaus.devices = devices;
-	buildDataGaus.deviceId = sdkContext->deviceId;
-	buildDataGaus.flagsStr = std::string("");
-	if (sdkContext->isLoadBinaryEnabled())
-	{
-		buildDataGaus.binaryName = std::string(sdkContext->loadBinary.c_str());
-	}
+	Option* width_option = new Option;
+	CHECK_ALLOCATION(width_option, "Memory Allocation error.\n");
 
-	if (sdkContext->isComplierFlagsSpecified())
-	{
-		buildDataGaus.flagsFileName = std::string(sdkContext->flags.c_str());
-	}
+	width_option->_sVersion = "";
+	width_option->_lVersion = "width";
+	width_option->_description = "Width of raw input";
+	width_option->_usage = "[pixels]";
+	width_option->_type = CA_ARG_INT;
+	width_option->_value = &rawWidth;
 
-	retValue = buildOpenCLProgram(programGaus, context, buildDataGaus);
-	CHECK_ERROR(retValue, 0, "buildOpenCLProgram() failed");
+	sdkContext->AddOption(width_option);
 
-	// get a kernel object handle for a kernel with the given name
-	kernelGaus = clCreateKernel(
-		programGaus,
-		"gaussian_filter",
-		&status);
-	CHECK_OPENCL_ERROR(status, "clCreateKernel failed.");
+	delete width_option;
 
-	status = kernelInfo.setKernelWorkGroupInfo(kernelGaus,
-		devices[sdkContext->deviceId]);
-	CHECK_ERROR(status, SDK_SUCCESS, "kernelInfo.setKernelWorkGroupInfo() failed");
+	Option* height_option = new Option;
+	CHECK_ALLOCATION(height_option, "Memory Allocation error.\n");
 
+	height_option->_sVersion = "";
+	height_option->_lVersion = "height";
+	height_option->_description = "Height of raw input";
+	height_option->_usage = "[rows]";
+	height_option->_type = CA_ARG_INT;
+	height_option->_value = &rawHeight;
 
-	if ((blockSizeX * blockSizeY) > kernelInfo.kernelWorkGroupSize)
-	{
-		if (!sdkContext->quiet)
-		{
-			std::cout << "Out of Resources!" << std::endl;
-			std::cout << "Group Size specified : "
-				<< blockSizeX * blockSizeY << std::endl;
-			std::cout << "Max Group Size supported on the kernel : "
-				<< kernelWorkGroupSize << std::endl;
-			std::cout << "Falling back to " << kernelInfo.kernelWorkGroupSize << std::endl;
-		}
+	sdkContext->AddOption(height_option);
 
-		// Three possible cases
-		if (blockSizeX > kernelInfo.kernelWorkGroupSize)
-		{
-			blockSizeX = kernelInfo.kernelWorkGroupSize;
-			blockSizeY = 1;
-		}
-	}
+	delete height_option;
+
+	Option* stride_option = new Option;
+	CHECK_ALLOCATION(stride_option, "Memory Allocation error.\n");
+
+	stride_option->_sVersion = "";
+	stride_option->_lVersion = "stride";
+	stride_option->_description = "Bytes from one raw input row to the next (0 = width)";
+	stride_option->_usage = "[bytes]";
+	stride_option->_type = CA_ARG_INT;
+	stride_option->_value = &rawStride;
 
-	buildProgramData buildDataSobel;
-	buildDataSobel.kernelName = std::string(SOBEL_FILTER_KERNEL);
-	buildDataSobel.devices = devices;
-	buildDataSobel.deviceId = sdkContext->deviceId;
-	buildDataSobel.flagsStr = std::string("");
-	if (sdkContext->isLoadBinaryEnabled())
-	{
-		buildDataSobel.binaryName = std::string(sdkContext->loadBinary.c_str());
-	}
+	sdkContext->AddOption(stride_option);
 
-	if (sdkContext->isComplierFlagsSpecified())
-	{
-		buildDataSobel.flagsFileName = std::string(sdkContext->flags.c_str());
-	}
+	delete stride_option;
 
-	retValue = buildOpenCLProgram(programSobel, context, buildDataSobel);
-	CHECK_ERROR(retValue, 0, "buildOpenCLProgram() failed");
+	Option* video_option = new Option;
+	CHECK_ALLOCATION(video_option, "Memory Allocation error.\n");
 
-	// get a kernel object handle for a kernel with the given name
-	kernelSobel = clCreateKernel(
-		programSobel,
-		"sobel_filter",
-		&status);
-	CHECK_OPENCL_ERROR(status, "clCreateKernel failed.");
+	video_option->_sVersion = "";
+	video_option->_lVersion = "video";
+	video_option->_description = "Filter a y4m, i420 or nv12 (--width/--height) stream from stdin to stdout";
+	video_option->_usage = "[y4m|i420|nv12]";
+	video_option->_type = CA_ARG_STRING;
+	video_option->_value = &videoFormat;
 
-	status = kernelInfo.setKernelWorkGroupInfo(kernelSobel,
-		devices[sdkContext->deviceId]);
-	CHECK_ERROR(status, SDK_SUCCESS, "kernelInfo.setKernelWorkGroupInfo() failed");
+	sdkContext->AddOption(video_option);
 
+	delete video_option;
 
-	if ((blockSizeX * blockSizeY) > kernelInfo.kernelWorkGroupSize)
-	{
-		if (!sdkContext->quiet)
-		{
-			std::cout << "Out of Resources!" << std::endl;
-			std::cout << "Group Size specified : "
-				<< blockSizeX * blockSizeY << std::endl;
-			std::cout << "Max Group Size supported on the kernel : "
-				<< kernelWorkGroupSize << std::endl;
-			std::cout << "Falling back to " << kernelInfo.kernelWorkGroupSize << std::endl;
-		}
+	Option* incremental_option = new Option;
+	CHECK_ALLOCATION(incremental_option, "Memory Allocation error.\n");
 
-		// Three possible cases
-		if (blockSizeX > kernelInfo.kernelWorkGroupSize)
-		{
-			blockSizeX = kernelInfo.kernelWorkGroupSize;
-			blockSizeY = 1;
-		}
-	}
+	incremental_option->_sVersion = "";
+	incremental_option->_lVersion = "incremental";
+	incremental_option->_description = "--video: rerun only tiles of N rows that changed since the previous frame (0 = off)";
+	incremental_option->_usage = "[N]";
+	incremental_option->_type = CA_ARG_INT;
+	incremental_option->_value = &incrementalRows;
 
-	buildProgramData buildDataMax;
-	buildDataMax.kernelName = std::string(MAX_KERNEL);
-	buildDataMax.devices = devices;
-	buildDataMax.deviceId = sdkContext->deviceId;
-	buildDataMax.flagsStr = std::string("");
-	if (sdkContext->isLoadBinaryEnabled())
-	{
-		buildDataMax.binaryName = std::string(sdkContext->loadBinary.c_str());
-	}
+	sdkContext->AddOption(incremental_option);
 
-	if (sdkContext->isComplierFlagsSpecified())
-	{
-		buildDataMax.flagsFileName = std::string(sdkContext->flags.c_str());
-	}
+	delete incremental_option;
 
-	retValue = buildOpenCLProgram(programMax, context, buildDataMax);
-	CHECK_ERROR(retValue, 0, "buildOpenCLProgram() failed");
+	Option* roi_option = new Option;
+	CHECK_ALLOCATION(roi_option, "Memory Allocation error.\n");
 
-	// get a kernel object handle for a kernel with the given name
-	kernelMax = clCreateKernel(
-		programMax,
-		"Max_filter",
-		&status);
-	CHECK_OPENCL_ERROR(status, "clCreateKernel failed.");
+	roi_option->_sVersion = "";
+	roi_option->_lVersion = "roi";
+	roi_option->_description = "Only process these regions (x,y,width,height, several separated by ':')";
+	roi_option->_usage = "[x,y,w,h[:x,y,w,h...]]";
+	roi_option->_type = CA_ARG_STRING;
+	roi_option->_value = &regionList;
 
-	status = kernelInfo.setKernelWorkGroupInfo(kernelMax,
-		devices[sdkContext->deviceId]);
-	CHECK_ERROR(status, SDK_SUCCESS, "kernelInfo.setKernelWorkGroupInfo() failed");
+	sdkContext->AddOption(roi_option);
 
+	delete roi_option;
 
-	if ((blockSizeX * blockSizeY) > kernelInfo.kernelWorkGroupSize)
-	{
-		if (!sdkContext->quiet)
-		{
-			std::cout << "Out of Resources!" << std::endl;
-			std::cout << "Group Size specified : "
-				<< blockSizeX * blockSizeY << std::endl;
-			std::cout << "Max Group Size supported on the kernel : "
-				<< kernelWorkGroupSize << std::endl;
-			std::cout << "Falling back to " << kernelInfo.kernelWorkGroupSize << std::endl;
-		}
+	Option* pyramid_option = new Option;
+	CHECK_ALLOCATION(pyramid_option, "Memory Allocation error.\n");
 
-		// Three possible cases
-		if (blockSizeX > kernelInfo.kernelWorkGroupSize)
-		{
-			blockSizeX = kernelInfo.kernelWorkGroupSize;
-			blockSizeY = 1;
-		}
-	}
+	pyramid_option->_sVersion = "";
+	pyramid_option->_lVersion = "pyramid";
+	pyramid_option->_description = "Detect edges on N levels of 2x decimation, written as <output>_level<n> (0 = off)";
+	pyramid_option->_usage = "[N]";
+	pyramid_option->_type = CA_ARG_INT;
+	pyramid_option->_value = &pyramidLevels;
 
+	sdkContext->AddOption(pyramid_option);
 
-	buildProgramData buildDataHyst;
-	buildDataHyst.kernelName = std::string(HYSTERESIS_KERNEL);
-	buildDataHyst.devices = devices;
-	buildDataHyst.deviceId = sdkContext->deviceId;
-	buildDataHyst.flagsStr = std::string("");
-	if (sdkContext->isLoadBinaryEnabled())
-	{
-		buildDataHyst.binaryName = std::string(sdkContext->loadBinary.c_str());
-	}
+	delete pyramid_option;
 
-	if (sdkContext->isComplierFlagsSpecified())
-	{
-		buildDataHyst.flagsFileName = std::string(sdkContext->flags.c_str());
-	}
+	Option* fuse_option = new Option;
+	CHECK_ALLOCATION(fuse_option, "Memory Allocation error.\n");
 
-	retValue = buildOpenCLProgram(programHyst, context, buildDataHyst);
-	CHECK_ERROR(retValue, 0, "buildOpenCLProgram() failed");
+	fuse_option->_sVersion = "";
+	fuse_option->_lVersion = "pyramid-fuse";
+	fuse_option->_description = "--pyramid: only process full resolution tiles near edges of the coarsest level";
+	fuse_option->_usage = "";
+	fuse_option->_type = CA_NO_ARGUMENT;
+	fuse_option->_value = &pyramidFuse;
 
-	// get a kernel object handle for a kernel with the given name
-	kernelHyst = clCreateKernel(
-		programHyst,
-		"Hyst_filter",
-		&status);
-	CHECK_OPENCL_ERROR(status, "clCreateKernel failed.");
+	sdkContext->AddOption(fuse_option);
 
-	status = kernelInfo.setKernelWorkGroupInfo(kernelHyst,
-		devices[sdkContext->deviceId]);
-	CHECK_ERROR(status, SDK_SUCCESS, "kernelInfo.setKernelWorkGroupInfo() failed");
+	delete fuse_option;
 
+	Option* list_option = new Option;
+	CHECK_ALLOCATION(list_option, "Memory Allocation error.\n");
 
-	if ((blockSizeX * blockSizeY) > kernelInfo.kernelWorkGroupSize)
-	{
-		if (!sdkContext->quiet)
-		{
-			std::cout << "Out of Resources!" << std::endl;
-			std::cout << "Group Size specified : "
-				<< blockSizeX * blockSizeY << std::endl;
-			std::cout << "Hyst Group Size supported on the kernel : "
-				<< kernelWorkGroupSize << std::endl;
-			std::cout << "Falling back to " << kernelInfo.kernelWorkGroupSize << std::endl;
-		}
+	list_option->_sVersion = "";
+	list_option->_lVersion = "edge-list";
+	list_option->_description = "Read back only the edge pixels (x, y, direction); a .txt/.csv --output gets the list";
+	list_option->_usage = "";
+	list_option->_type = CA_NO_ARGUMENT;
+	list_option->_value = &edgeListMode;
 
-		// Three possible cases
-		if (blockSizeX > kernelInfo.kernelWorkGroupSize)
-		{
-			blockSizeX = kernelInfo.kernelWorkGroupSize;
-			blockSizeY = 1;
-		}
-	}
-	return SDK_SUCCESS;
-}
+	sdkContext->AddOption(list_option);
 
+	delete list_option;
 
-int EdgeDetector::GreyScale()
-{
-	cl_int status;
+	Option* packed_option = new Option;
+	CHECK_ALLOCATION(packed_option, "Memory Allocation error.\n");
 
-	// Set input data
+	packed_option->_sVersion = "";
+	packed_option->_lVersion = "packed-output";
+	packed_option->_description = "Read back the edge map packed 1 bit per pixel; .bmp and .pbm outputs are written 1 bit per pixel";
+	packed_option->_usage = "";
+	packed_option->_type = CA_NO_ARGUMENT;
+	packed_option->_value = &packedOutput;
 
-	// Set appropriate arguments to the kernel
+	sdkContext->AddOption(packed_option);
 
-	// input buffer image
-	status = clSetKernelArg(
-		kernelGrey,
-		0,
-		sizeof(cl_mem),
-		&nextImageBuffer);
-	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (nextImageBuffer)")
+	delete packed_option;
 
-		// outBuffer imager
-		status = clSetKernelArg(
-		kernelGrey,
-		1,
-		sizeof(cl_mem),
-		&prevImageBuffer);
-	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (prevImageBuffer");
+	Option* arithmetic_option = new Option;
+	CHECK_ALLOCATION(arithmetic_option, "Memory Allocation error.\n");
 
-	// Enqueue a kernel run call.
-	size_t globalThreads[] = { width, height };
-	size_t localThreads[] = { blockSizeX, blockSizeY };
+	arithmetic_option->_sVersion = "";
+	arithmetic_option->_lVersion = "arithmetic";
+	arithmetic_option->_description = "Kernel arithmetic: auto (integer gaussian/sobel on CPUs, half on devices with cl_khr_fp16), float, fixed (also integer greyscale, -e reports the difference) or half";
+	arithmetic_option->_usage = "[auto|float|fixed|half]";
+	arithmetic_option->_type = CA_ARG_STRING;
+	arithmetic_option->_value = &arithmetic;
 
-	cl_event ndrEvt;
-	status = clEnqueueNDRangeKernel(
-		commandQueue,
-		kernelGrey,
-		2,
-		NULL,
-		globalThreads,
-		localThreads,
-		0,
-		NULL,
-		&ndrEvt);
-	CHECK_OPENCL_ERROR(status, "clEnqueueNDRangeKernel failed.");
+	sdkContext->AddOption(arithmetic_option);
 
-	return 1;
-}
+	delete arithmetic_option;
 
-int EdgeDetector::Gaussian()
-{
-	cl_int status;
+	Option* direction_option = new Option;
+	CHECK_ALLOCATION(direction_option, "Memory Allocation error.\n");
 
-	// Set input data
+	direction_option->_sVersion = "";
+	direction_option->_lVersion = "direction";
+	direction_option->_description = "Gradient directions: atan2 (sobel_filter) or tangent (trig-free 22.5/67.5 degree buckets, luminance only)";
+	direction_option->_usage = "[atan2|tangent]";
+	direction_option->_type = CA_ARG_STRING;
+	direction_option->_value = &directionMode;
 
-	// Set appropriate arguments to the kernel
+	sdkContext->AddOption(direction_option);
 
-	// input buffer image
-	status = clSetKernelArg(
-		kernelGaus,
-		0,
-		sizeof(cl_mem),
-		&prevImageBuffer);
-	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (PrevBuff())")
+	delete direction_option;
 
-		// outBuffer imager
-		status = clSetKernelArg(
-		kernelGaus,
-		1,
-		sizeof(cl_mem),
-		&nextImageBuffer);
-	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (outputImageBuffer)");
+	Option* fused_option = new Option;
+	CHECK_ALLOCATION(fused_option, "Memory Allocation error.\n");
 
-	// Enqueue a kernel run call.
-	size_t globalThreads[] = { width, height };
-	size_t localThreads[] = { blockSizeX, blockSizeY };
+	fused_option->_sVersion = "";
+	fused_option->_lVersion = "fused";
+	fused_option->_description = "Run sobel and max as one kernel with the magnitude in local memory; the border ring of the edge map is 0";
+	fused_option->_usage = "";
+	fused_option->_type = CA_NO_ARGUMENT;
+	fused_option->_value = &fusedNms;
 
-	cl_event ndrEvt;
-	status = clEnqueueNDRangeKernel(
-		commandQueue,
-		kernelGaus,
-		2,
-		NULL,
-		globalThreads,
-		localThreads,
-		0,
-		NULL,
-		&ndrEvt);
-	CHECK_OPENCL_ERROR(status, "clEnqueueNDRangeKernel failed.");
-	return 1;
-}
+	sdkContext->AddOption(fused_option);
 
-int EdgeDetector::Sobel()
-{
-	cl_int status;
+	delete fused_option;
 
-	// Set input data
+	Option* intermediate_option = new Option;
+	CHECK_ALLOCATION(intermediate_option, "Memory Allocation error.\n");
 
-	// Set appropriate arguments to the kernel
+	intermediate_option->_sVersion = "";
+	intermediate_option->_lVersion = "intermediate";
+	intermediate_option->_description = "Sobel output layout: split (uchar4 magnitude and uchar theta) or packed (one ushort, magnitude << 2 | direction code)";
+	intermediate_option->_usage = "[split|packed]";
+	intermediate_option->_type = CA_ARG_STRING;
+	intermediate_option->_value = &intermediateLayout;
 
-	// input buffer image
-	status = clSetKernelArg(
-		kernelSobel,
-		0,
-		sizeof(cl_mem),
-		&nextImageBuffer);
-	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (inputImageBuffer)")
+	sdkContext->AddOption(intermediate_option);
 
-		// outBuffer imager
-		status = clSetKernelArg(
-		kernelSobel,
-		1,
-		sizeof(cl_mem),
-		&prevImageBuffer);
-	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (outputImageBuffer)");
+	delete intermediate_option;
 
-	status = clSetKernelArg(
-		kernelSobel,
-		2,
-		sizeof(cl_mem),
-		&thetaBuffer);
-	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (thetaBuffer)");
+	Option* specialize_option = new Option;
+	CHECK_ALLOCATION(specialize_option, "Memory Allocation error.\n");
 
-	// Enqueue a kernel run call.
-	size_t globalThreads[] = { width, height };
-	size_t localThreads[] = { blockSizeX, blockSizeY };
-	std::cout << "Width " << width << std::endl;
-	std::cout << "height " << height << std::endl;
-	cl_event ndrEvt;
-	status = clEnqueueNDRangeKernel(
-		commandQueue,
-		kernelSobel,
-		2,
-		NULL,
-		globalThreads,
-		localThreads,
-		0,
-		NULL,
-		&ndrEvt);
+	specialize_option->_sVersion = "";
+	specialize_option->_lVersion = "specialize";
+	specialize_option->_description = "Build the kernels for the image size (-D WIDTH and -D HEIGHT); whole-image runs only";
+	specialize_option->_usage = "";
+	specialize_option->_type = CA_NO_ARGUMENT;
+	specialize_option->_value = &specialize;
 
-	CHECK_OPENCL_ERROR(status, "clEnqueueNDRangeKernel failed.");
-	return 1;
-}
+	sdkContext->AddOption(specialize_option);
 
-int EdgeDetector::Max()
-{
-	cl_int status;
+	delete specialize_option;
 
-	// Set input data
+	Option* fast_math_option = new Option;
+	CHECK_ALLOCATION(fast_math_option, "Memory Allocation error.\n");
 
-	// Set appropriate arguments to the kernel
+	fast_math_option->_sVersion = "";
+	fast_math_option->_lVersion = "fast-math";
+	fast_math_option->_description = "Build with -cl-fast-relaxed-math -cl-mad-enable and a cheaper sobel magnitude; reports the edge F1 against the precise path";
+	fast_math_option->_usage = "";
+	fast_math_option->_type = CA_NO_ARGUMENT;
+	fast_math_option->_value = &fastMath;
 
-	// input buffer image
-	status = clSetKernelArg(
-		kernelMax,
-		0,
-		sizeof(cl_mem),
-		&prevImageBuffer);
-	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (inputImageBuffer)")
+	sdkContext->AddOption(fast_math_option);
 
-		// outBuffer imager
-		status = clSetKernelArg(
-		kernelMax,
-		1,
-		sizeof(cl_mem),
-		&nextImageBuffer);
-	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (outputImageBuffer)");
+	delete fast_math_option;
 
-	status = clSetKernelArg(
-		kernelMax,
-		2,
-		sizeof(cl_mem),
-		&thetaBuffer);
-	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (thetaBuffer)");
+	Option* magnitude_option = new Option;
+	CHECK_ALLOCATION(magnitude_option, "Memory Allocation error.\n");
 
-	// Enqueue a kernel run call.
-	size_t globalThreads[] = { width, height };
-	size_t localThreads[] = { blockSizeX, blockSizeY };
+	magnitude_option->_sVersion = "";
+	magnitude_option->_lVersion = "fast-magnitude";
+	magnitude_option->_description = "Sobel magnitude of --fast-math: sqrt (native_sqrt of the sum of squares) or l1 (|Gx| + |Gy|)";
+	magnitude_option->_usage = "[sqrt|l1]";
+	magnitude_option->_type = CA_ARG_STRING;
+	magnitude_option->_value = &fastMagnitude;
 
-	cl_event ndrEvt;
-	status = clEnqueueNDRangeKernel(
-		commandQueue,
-		kernelMax,
-		2,
-		NULL,
-		globalThreads,
-		localThreads,
-		0,
-		NULL,
-		&ndrEvt);
-	CHECK_OPENCL_ERROR(status, "clEnqueueNDRangeKernel failed.");
-	return 1;
-}
-int EdgeDetector::Hysteresis()
-{
-	cl_int status;
+	sdkContext->AddOption(magnitude_option);
 
+	delete magnitude_option;
 
-	// Set appropriate arguments to the kernel
+	Option* border_option = new Option;
+	CHECK_ALLOCATION(border_option, "Memory Allocation error.\n");
 
-	// input buffer image
-	status = clSetKernelArg(
-		kernelHyst,
-		0,
-		sizeof(cl_mem),
-		&nextImageBuffer);
-	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (inputImageBuffer)")
+	border_option->_sVersion = "";
+	border_option->_lVersion = "border";
+	border_option->_description = "Pixels outside the image for gaussian, sobel and max: legacy (ring left as the buffers hold it), clamp, mirror, zero or skip (ring outputs 0)";
+	border_option->_usage = "[legacy|clamp|mirror|zero|skip]";
+	border_option->_type = CA_ARG_STRING;
+	border_option->_value = &borderName;
 
+	sdkContext->AddOption(border_option);
 
-		// outBuffer imager
-		status = clSetKernelArg(
-		kernelHyst,
-		1,
-		sizeof(cl_mem),
-		&prevImageBuffer);
+	delete border_option;
+
+	Option* cache_option = new Option;
+	CHECK_ALLOCATION(cache_option, "Memory Allocation error.\n");
+
+	cache_option->_sVersion = "";
+	cache_option->_lVersion = "program-cache";
+	cache_option->_description = "Existing directory (next to the kernels) to keep built program binaries in, one per kernel file, build options and device";
+	cache_option->_usage = "[dir]";
+	cache_option->_type = CA_ARG_STRING;
+	cache_option->_value = &programCache;
+
+	sdkContext->AddOption(cache_option);
+
+	delete cache_option;
+
+	Option* flat_option = new Option;
+	CHECK_ALLOCATION(flat_option, "Memory Allocation error.\n");
 
-	CHECK_OPENCL_ERROR(status, "clSetKernelArg failed. (outputImageBuffer)");
+	flat_option->_sVersion = "";
+	flat_option->_lVersion = "flat-threshold";
+	flat_option->_description = "Skip 16x16 tiles whose luminance range is at most N and write them as zero; up to 15 keeps every edge (-1 = off)";
+	flat_option->_usage = "[N]";
+	flat_option->_type = CA_ARG_INT;
+	flat_option->_value = &flatThreshold;
 
-	// Enqueue a kernel run call.
-	size_t globalThreads[] = { width, height };
-	size_t localThreads[] = { blockSizeX, blockSizeY };
+	sdkContext->AddOption(flat_option);
 
-	cl_event ndrEvt;
-	status = clEnqueueNDRangeKernel(
-		commandQueue,
-		kernelHyst,
-		2,
-		NULL,
-		globalThreads,
-		localThreads,
-		0,
-		NULL,
-		&ndrEvt);
-	CHECK_OPENCL_ERROR(status, "clEnqueueNDRangeKernel failed.");
-	return 1;
-}
-int
-EdgeDetector::runCLKernels()
-{
-	cl_int status;
-	EdgeDetector::GreyScale();
-	EdgeDetector::Gaussian();
-	EdgeDetector::Sobel();
-	EdgeDetector::Max();
-	EdgeDetector::Hysteresis();
+	delete flat_option;
 
-	// Enqueue readBuffer
-	cl_event readEvt;
-	status = clEnqueueReadBuffer(
-		commandQueue,
-		prevImageBuffer,
-		CL_TRUE,
-		0,
-		width * height * pixelSize,
-		outputImageData,
-		0,
-		NULL,
-		&readEvt);
-	CHECK_OPENCL_ERROR(status, "clEnqueueReadBuffer failed.");
+	Option* sweep_sigma_option = new Option;
+	CHECK_ALLOCATION(sweep_sigma_option, "Memory Allocation error.\n");
 
-	status = clFlush(commandQueue);
-	CHECK_OPENCL_ERROR(status, "clFlush failed.");
+	sweep_sigma_option->_sVersion = "";
+	sweep_sigma_option->_lVersion = "sweep-sigma";
+	sweep_sigma_option->_description = "Sweep the gaussian over sigmas s1,s2,...; 0 is the 1-2-1 filter of a normal run";
+	sweep_sigma_option->_usage = "[list]";
+	sweep_sigma_option->_type = CA_ARG_STRING;
+	sweep_sigma_option->_value = &sweepSigmaList;
 
-	status = waitForEventAndRelease(&readEvt);
-	CHECK_ERROR(status, SDK_SUCCESS, "WaitForEventAndRelease(readEvt) Failed");
+	sdkContext->AddOption(sweep_sigma_option);
 
-	return SDK_SUCCESS;
-}
+	delete sweep_sigma_option;
 
+	Option* sweep_thresholds_option = new Option;
+	CHECK_ALLOCATION(sweep_thresholds_option, "Memory Allocation error.\n");
 
+	sweep_thresholds_option->_sVersion = "";
+	sweep_thresholds_option->_lVersion = "sweep-thresholds";
+	sweep_thresholds_option->_description = "Sweep hysteresis over low/high pairs l1/h1,l2/h2,...; reruns only hysteresis per pair";
+	sweep_thresholds_option->_usage = "[list]";
+	sweep_thresholds_option->_type = CA_ARG_STRING;
+	sweep_thresholds_option->_value = &sweepThresholdList;
 
-int
-EdgeDetector::initialize()
-{
-	cl_int status = 0;
-	// Call base class Initialize to get default configuration
-	status = sdkContext->initialize();
-	CHECK_ERROR(status, SDK_SUCCESS, "OpenCL Initialization failed");
+	sdkContext->AddOption(sweep_thresholds_option);
 
-	Option* iteration_option = new Option;
-	CHECK_ALLOCATION(iteration_option, "Memory Allocation error.\n");
+	delete sweep_thresholds_option;
 
-	iteration_option->_sVersion = "i";
-	iteration_option->_lVersion = "iterations";
-	iteration_option->_description = "Number of iterations to execute kernel";
-	iteration_option->_type = CA_ARG_INT;
-	iteration_option->_value = &iterations;
+	Option* outputs_option = new Option;
+	CHECK_ALLOCATION(outputs_option, "Memory Allocation error.\n");
 
-	sdkContext->AddOption(iteration_option);
+	outputs_option->_sVersion = "";
+	outputs_option->_lVersion = "outputs";
+	outputs_option->_description = "Also keep smoothed, magnitude, direction and/or nms, written as <output>_<name>";
+	outputs_option->_usage = "[list]";
+	outputs_option->_type = CA_ARG_STRING;
+	outputs_option->_value = &outputList;
 
-	delete iteration_option;
+	sdkContext->AddOption(outputs_option);
+
+	delete outputs_option;
 
 	return SDK_SUCCESS;
 }
@@ -1051,12 +5131,79 @@ EdgeDetector::setup()
 {
 	cl_int status = 0;
 
+	if (canaryPeriod > 0)
+	{
+		// Start sampling at a random frame, kept below iterations so short runs still check one
+		unsigned int window = (unsigned int)std::min(canaryPeriod, std::max(iterations, 1));
+		canaryStart = (int)(std::random_device()() % window);
+	}
+
 	// create and initialize timers
 	int timer = sampleTimer->createTimer();
 	sampleTimer->resetTimer(timer);
 	sampleTimer->startTimer(timer);
 
-	status = setupCL();
+	if (setupRegions() != SDK_SUCCESS)
+	{
+		return SDK_FAILURE;
+	}
+
+	if (sdkContext->isNativeDevice())
+	{
+		if (setupArithmetic(true, false) != SDK_SUCCESS)
+		{
+			return SDK_FAILURE;
+		}
+		status = nativeDetector.setup(width, height, threads < 0 ? 0 : threads);
+		nativeDetector.setExactLuma(exactLuma);
+		nativeDetector.setTangentDirection(tangentDirection);
+		nativeDetector.setZeroBorder(fusedNms);
+		nativeDetector.setL1Magnitude(fastMath && fastMagnitude == "l1");
+		nativeDetector.setBorderMode(borderMode);
+		nativeDetector.setInputFormat(inputFormat, inputPalette);
+		std::cout << "Selected Device: native (" << nativeDetector.threadCount()
+			<< " threads)" << std::endl;
+	}
+	else
+	{
+		status = setupCL();
+	}
+	if (status != SDK_SUCCESS)
+	{
+		return status;
+	}
+
+	status = setupPyramid();
+	if (status != SDK_SUCCESS)
+	{
+		return status;
+	}
+
+	status = setupEdgeList();
+	if (status != SDK_SUCCESS)
+	{
+		return status;
+	}
+
+	status = setupPackedOutput();
+	if (status != SDK_SUCCESS)
+	{
+		return status;
+	}
+
+	status = setupFlatTiles();
+	if (status != SDK_SUCCESS)
+	{
+		return status;
+	}
+
+	status = setupSweep();
+	if (status != SDK_SUCCESS)
+	{
+		return status;
+	}
+
+	status = setupOutputs();
 	if (status != SDK_SUCCESS)
 	{
 		return status;
@@ -1082,7 +5229,7 @@ EdgeDetector::run()
 	for (int i = 0; i < 2 && iterations != 1; i++)
 	{
 		// Set kernel arguments and run kernel
-		if (runCLKernels() != SDK_SUCCESS)
+		if (runKernels() != SDK_SUCCESS)
 		{
 			return SDK_FAILURE;
 		}
@@ -1100,7 +5247,12 @@ EdgeDetector::run()
 	for (int i = 0; i < iterations; i++)
 	{
 		// Set kernel arguments and run kernel
-		if (runCLKernels() != SDK_SUCCESS)
+		if (runKernels() != SDK_SUCCESS)
+		{
+			return SDK_FAILURE;
+		}
+
+		if (canarySample(i, timer) != SDK_SUCCESS)
 		{
 			return SDK_FAILURE;
 		}
@@ -1110,6 +5262,12 @@ EdgeDetector::run()
 	// Compute kernel time
 	kernelTime = (double)(sampleTimer->readTimer(timer)) / iterations;
 
+	if (canaryFrames > 0)
+	{
+		std::cout << "Canary: " << canaryFailures << " of " << canaryFrames
+			<< " frames outside tolerance" << std::endl;
+	}
+
 	return SDK_SUCCESS;
 }
 
@@ -1121,55 +5279,149 @@ EdgeDetector::cleanup()
 		return SDK_SUCCESS;
 	}
 
-	// Releases OpenCL resources (Context, Memory etc.)
 	cl_int status;
 
-	status = clReleaseKernel(kernelGrey);
-	CHECK_OPENCL_ERROR(status, "clReleaseKernel failed.");
+	status = cleanupPyramid();
+	CHECK_ERROR(status, SDK_SUCCESS, "cleanupPyramid() failed");
+
+	status = cleanupPackedOutput();
+	CHECK_ERROR(status, SDK_SUCCESS, "cleanupPackedOutput() failed");
+
+	status = cleanupEdgeList();
+	CHECK_ERROR(status, SDK_SUCCESS, "cleanupEdgeList() failed");
+
+	status = cleanupFlatTiles();
+	CHECK_ERROR(status, SDK_SUCCESS, "cleanupFlatTiles() failed");
+
+	status = cleanupSweep();
+	CHECK_ERROR(status, SDK_SUCCESS, "cleanupSweep() failed");
+
+	status = cleanupOutputs();
+	CHECK_ERROR(status, SDK_SUCCESS, "cleanupOutputs() failed");
+
+	if (referenceReady)
+	{
+		status = nativeReference.cleanup();
+		CHECK_ERROR(status, SDK_SUCCESS, "NativeEdgeDetector::cleanup() failed");
+		referenceReady = false;
+	}
+
+	if (sdkContext->isNativeDevice())
+	{
+		status = nativeDetector.cleanup();
+		CHECK_ERROR(status, SDK_SUCCESS, "NativeEdgeDetector::cleanup() failed");
+	}
+	else
+	{
+		// Releases OpenCL resources (Context, Memory etc.)
+		status = clReleaseKernel(kernelGrey);
+		CHECK_OPENCL_ERROR(status, "clReleaseKernel failed.");
+
+		status = clReleaseProgram(programGrey);
+		CHECK_OPENCL_ERROR(status, "clReleaseProgram failed.");
+
+		status = clReleaseProgram(programGaus);
+		CHECK_OPENCL_ERROR(status, "clReleaseProgram failed.");
+
+		status = clReleaseKernel(kernelGaus);
+		CHECK_OPENCL_ERROR(status, "clReleaseKernel failed.");
 
-	status = clReleaseProgram(programGrey);
-	CHECK_OPENCL_ERROR(status, "clReleaseProgram failed.");
+		status = clReleaseProgram(programSobel);
+		CHECK_OPENCL_ERROR(status, "clReleaseProgram failed.");
 
-	status = clReleaseProgram(programGaus);
-	CHECK_OPENCL_ERROR(status, "clReleaseProgram failed.");
+		status = clReleaseKernel(kernelSobel);
+		CHECK_OPENCL_ERROR(status, "clReleaseKernel failed.");
 
-	status = clReleaseKernel(kernelGaus);
-	CHECK_OPENCL_ERROR(status, "clReleaseKernel failed.");
+		if (kernelSobelMax != NULL)
+		{
+			status = clReleaseKernel(kernelSobelMax);
+			CHECK_OPENCL_ERROR(status, "clReleaseKernel failed.");
+		}
+
+		cl_kernel borderKernels[] = { kernelGausBorder, kernelSobelBorder, kernelMaxBorder };
+		for (int k = 0; k < 3; k++)
+		{
+			if (borderKernels[k] != NULL)
+			{
+				status = clReleaseKernel(borderKernels[k]);
+				CHECK_OPENCL_ERROR(status, "clReleaseKernel failed. (border)");
+			}
+		}
+
+		status = clReleaseProgram(programMax);
+		CHECK_OPENCL_ERROR(status, "clReleaseProgram failed.");
 
-	status = clReleaseProgram(programSobel);
-	CHECK_OPENCL_ERROR(status, "clReleaseProgram failed.");
+		status = clReleaseKernel(kernelMax);
+		CHECK_OPENCL_ERROR(status, "clReleaseKernel failed.");
 
-	status = clReleaseKernel(kernelSobel);
-	CHECK_OPENCL_ERROR(status, "clReleaseKernel failed.");
+		status = clReleaseProgram(programHyst);
+		CHECK_OPENCL_ERROR(status, "clReleaseProgram failed.");
 
-	status = clReleaseProgram(programMax);
-	CHECK_OPENCL_ERROR(status, "clReleaseProgram failed.");
+		status = clReleaseKernel(kernelHyst);
+		CHECK_OPENCL_ERROR(status, "clReleaseKernel failed.");
 
-	status = clReleaseKernel(kernelMax);
-	CHECK_OPENCL_ERROR(status, "clReleaseKernel failed.");
+		if (tileRows == 0)
+		{
+			status = clReleaseMemObject(inputImageBuffer);
+			CHECK_OPENCL_ERROR(status, "clReleaseMemObject failed.");
 
-	status = clReleaseProgram(programHyst);
-	CHECK_OPENCL_ERROR(status, "clReleaseProgram failed.");
+			status = clReleaseMemObject(nextImageBuffer);
+			CHECK_OPENCL_ERROR(status, "clReleaseMemObject failed.");
 
-	status = clReleaseKernel(kernelHyst);
-	CHECK_OPENCL_ERROR(status, "clReleaseKernel failed.");
+			status = clReleaseMemObject(prevImageBuffer);
+			CHECK_OPENCL_ERROR(status, "clReleaseMemObject failed.");
 
-	status = clReleaseMemObject(inputImageBuffer);
-	CHECK_OPENCL_ERROR(status, "clReleaseMemObject failed.");
+			status = clReleaseMemObject(thetaBuffer);
+			CHECK_OPENCL_ERROR(status, "clReleaseMemObject failed.");
+		}
+		else
+		{
+			for (int t = 0; t < 2; t++)
+			{
+				status = clReleaseMemObject(tiles[t].nextBuffer);
+				CHECK_OPENCL_ERROR(status, "clReleaseMemObject failed.");
+
+				status = clReleaseMemObject(tiles[t].prevBuffer);
+				CHECK_OPENCL_ERROR(status, "clReleaseMemObject failed.");
+
+				status = clReleaseMemObject(tiles[t].thetaBuffer);
+				CHECK_OPENCL_ERROR(status, "clReleaseMemObject failed.");
+
+				if (tiles[t].inputBuffer != tiles[t].nextBuffer)
+				{
+					status = clReleaseMemObject(tiles[t].inputBuffer);
+					CHECK_OPENCL_ERROR(status, "clReleaseMemObject failed.");
+				}
+			}
+
+			status = clReleaseCommandQueue(tiles[1].queue);
+			CHECK_OPENCL_ERROR(status, "clReleaseCommandQueue failed.");
+		}
 
-	status = clReleaseMemObject(nextImageBuffer);
-	CHECK_OPENCL_ERROR(status, "clReleaseMemObject failed.");
+		if (paletteBuffer != NULL)
+		{
+			status = clReleaseMemObject(paletteBuffer);
+			CHECK_OPENCL_ERROR(status, "clReleaseMemObject failed.");
+		}
 
-	status = clReleaseMemObject(prevImageBuffer);
-	CHECK_OPENCL_ERROR(status, "clReleaseMemObject failed.");
+		status = clReleaseCommandQueue(commandQueue);
+		CHECK_OPENCL_ERROR(status, "clReleaseCommandQueue failed.");
 
-	status = clReleaseCommandQueue(commandQueue);
-	CHECK_OPENCL_ERROR(status, "clReleaseCommandQueue failed.");
+		status = clReleaseContext(context);
+		CHECK_OPENCL_ERROR(status, "clReleaseContext failed.");
 
-	status = clReleaseContext(context);
-	CHECK_OPENCL_ERROR(status, "clReleaseContext failed.");
+		FREE(devices);
+	}
 
 	// release program resources (input memory etc.)
+	if (mappedInput != NULL || planarInput != NULL)
+	{
+		delete mappedInput;
+		mappedInput = NULL;
+		delete planarInput;
+		planarInput = NULL;
+		inputImageData = NULL;
+	}
 	FREE(inputImageData);
 
 	FREE(outputImageData);
@@ -1178,7 +5430,7 @@ EdgeDetector::cleanup()
 
 	FREE(verificationOutput);
 
-	FREE(devices);
+	FREE(previousInput);
 
 	return SDK_SUCCESS;
 }
@@ -1258,65 +5510,324 @@ EdgeDetector::EdgeDetectorCPUReference()
 	free(ptr);
 }
 
-/*
 int
-EdgeDetector::verifyResults()
+EdgeDetector::setupReference()
 {
-if(!byteRWSupport)
-{
-return SDK_SUCCESS;
+	if (referenceReady)
+	{
+		return SDK_SUCCESS;
+	}
+
+	int status = nativeReference.setup(width, height, threads < 0 ? 0 : threads,
+		!sdkContext->isNativeDevice());
+	CHECK_ERROR(status, SDK_SUCCESS, "NativeEdgeDetector::setup() failed");
+	// The reference follows the float kernels, so -e checks --arithmetic fixed against them
+	nativeReference.setExactLuma(false);
+	nativeReference.setTangentDirection(tangentDirection);
+	nativeReference.setZeroBorder(fusedNms);
+	nativeReference.setBorderMode(borderMode);
+	nativeReference.setInputFormat(inputFormat, inputPalette);
+	referenceReady = true;
+
+	return SDK_SUCCESS;
 }
 
-if(sdkContext->verify)
+int
+EdgeDetector::checkStage(const char* stage, const cl_uchar* reference, const cl_uchar* test,
+	size_t count, cl_uint testStride, cl_uint bytesPerPixel, cl_uchar tolerance, bool report)
 {
-// reference implementation
-EdgeDetectorCPUReference();
+	NativeCompareResult result = nativeCompare(reference, test, count, testStride, tolerance);
+	bool passed = result.mismatches <= (size_t)(count * VERIFY_MISMATCH_RATE);
 
-float *outputDevice = new float[width * height * pixelSize];
-CHECK_ALLOCATION(outputDevice,
-"Failed to allocate host memory! (outputDevice)");
+	if ((report || !passed) && !sdkContext->quiet)
+	{
+		std::cout << std::left << std::setw(16) << stage << ": "
+			<< result.mismatches << " mismatches, max abs error " << result.maxAbsError
+			<< " (tolerance " << (cl_uint)tolerance << ")";
+		if (result.firstBad >= 0)
+		{
+			size_t pixel = (size_t)result.firstBad / bytesPerPixel;
+			std::cout << ", first at (" << pixel % width << ", " << pixel / width << ")";
+		}
+		std::cout << (passed ? "" : " FAILED") << std::endl;
+	}
 
-float *outputReference = new float[width * height * pixelSize];
-CHECK_ALLOCATION(outputReference, "Failed to allocate host memory!"
-"(outputReference)");
+	return passed ? SDK_SUCCESS : SDK_FAILURE;
+}
 
-// copy uchar data to float array
-for(int i = 0; i < (int)(width * height); i++)
+void
+EdgeDetector::reportEdgeAccuracy(const cl_uchar* reference, const cl_uchar* test, size_t pixels)
 {
-outputDevice[i * 4 + 0] = outputImageData[i].s[0];
-outputDevice[i * 4 + 1] = outputImageData[i].s[1];
-outputDevice[i * 4 + 2] = outputImageData[i].s[2];
-outputDevice[i * 4 + 3] = outputImageData[i].s[3];
+	size_t both = 0, referenceEdges = 0, testEdges = 0;
+	for (size_t i = 0; i < pixels; i++)
+	{
+		bool inReference = reference[i * pixelSize] != 0;
+		bool inTest = test[i * pixelSize] != 0;
+		referenceEdges += inReference;
+		testEdges += inTest;
+		both += inReference && inTest;
+	}
 
-outputReference[i * 4 + 0] = verificationOutput[i * 4 + 0];
-outputReference[i * 4 + 1] = verificationOutput[i * 4 + 1];
-outputReference[i * 4 + 2] = verificationOutput[i * 4 + 2];
-outputReference[i * 4 + 3] = verificationOutput[i * 4 + 3];
+	// No edges on either side is a perfect match
+	double precision = testEdges ? (double)both / testEdges : 1.0;
+	double recall = referenceEdges ? (double)both / referenceEdges : 1.0;
+	double f1 = precision + recall > 0 ? 2 * precision * recall / (precision + recall) : 0.0;
+	std::cout << "Edge pixels: precision " << precision << ", recall " << recall << ", F1 " << f1
+		<< " (" << testEdges << " edges, " << referenceEdges << " in the reference)" << std::endl;
 }
 
-
-// compare the results and see if they match
-if(compare(outputReference,
-outputDevice,
-width * height * 4))
+int
+EdgeDetector::readStage(cl_mem buffer, void* data, size_t size)
 {
-std::cout << "Passed!\n" << std::endl;
-delete[] outputDevice;
-delete[] outputReference;
-return SDK_SUCCESS;
+	cl_int status = clEnqueueReadBuffer(
+		commandQueue,
+		buffer,
+		CL_TRUE,
+		0,
+		size,
+		data,
+		0,
+		NULL,
+		NULL);
+	CHECK_OPENCL_ERROR(status, "clEnqueueReadBuffer failed.");
+
+	return SDK_SUCCESS;
 }
-else
+
+int
+EdgeDetector::canaryCheck()
 {
-std::cout << "Failed\n" << std::endl;
-delete[] outputDevice;
-delete[] outputReference;
-return SDK_FAILURE;
+	int status = setupReference();
+	CHECK_ERROR(status, SDK_SUCCESS, "setupReference() failed");
+
+	status = nativeReference.run(inputImageData, (cl_uchar4*)verificationOutput);
+	CHECK_ERROR(status, SDK_SUCCESS, "NativeEdgeDetector::run() failed");
+	if (edgeListMode)
+	{
+		expandEdgeList();
+	}
+	if (packedOutput)
+	{
+		unpackEdges();
+	}
+	if (!regions.empty() || pyramidFuse)
+	{
+		maskToRegions((cl_uchar4*)verificationOutput, pyramidFuse ? gatedRegions : regions);
+	}
+
+	canaryFrames++;
+	if (checkStage("canary", verificationOutput, (const cl_uchar*)outputImageData,
+		(size_t)width * height * pixelSize, 1, pixelSize, VERIFY_TOL_HYST, false) != SDK_SUCCESS)
+	{
+		canaryFailures++;
+	}
+
+	return SDK_SUCCESS;
 }
+
+int
+EdgeDetector::canarySample(int frame, int timer)
+{
+	if (canaryPeriod <= 0 || frame < canaryStart || (frame - canaryStart) % canaryPeriod != 0)
+	{
+		return SDK_SUCCESS;
+	}
+
+	// The reference run is not part of the frame time
+	sampleTimer->stopTimer(timer);
+	int status = canaryCheck();
+	sampleTimer->startTimer(timer);
+	return status;
 }
 
-return SDK_SUCCESS;
+int
+EdgeDetector::verifyResults()
+{
+	if (!byteRWSupport || (!sdkContext->verify && !halfFilters && !fastMath))
+	{
+		return SDK_SUCCESS;
+	}
+	if (!sdkContext->verify)
+	{
+		// Half precision and fast math always get the accuracy report; it only fails with -e
+		std::cout << (fastMath ? "Fast math accuracy against the precise path:" :
+			"Half precision accuracy against the float path:") << std::endl;
+	}
+
+	int status = setupReference();
+	CHECK_ERROR(status, SDK_SUCCESS, "setupReference() failed");
+
+	status = nativeReference.run(inputImageData, (cl_uchar4*)verificationOutput);
+	CHECK_ERROR(status, SDK_SUCCESS, "NativeEdgeDetector::run() failed");
+
+	size_t pixels = (size_t)width * height;
+	int failed = 0;
+
+	if (edgeListMode)
+	{
+		// The edge map is checked as drawn from the list
+		expandEdgeList();
+	}
+	if (packedOutput)
+	{
+		unpackEdges();
+	}
+
+	if (!regions.empty() || pyramidFuse)
+	{
+		// Intermediates outside the regions were never computed; the output there must be zero
+		const std::vector<ImageRegion>& computed = pyramidFuse ? gatedRegions : regions;
+		std::cout << "Verifying " << computed.size() << " regions against native reference" << std::endl;
+		maskToRegions((cl_uchar4*)verificationOutput, computed);
+	}
+	else if (sdkContext->isNativeDevice())
+	{
+		std::cout << "Verifying against scalar reference" << std::endl;
+
+		failed |= checkStage("greyscale", nativeReference.getGreyPlane(),
+			nativeDetector.getGreyPlane(), pixels, 1, 1, VERIFY_TOL_GREY, true);
+		failed |= checkStage("gaussian", nativeReference.getGaussianPlane(),
+			nativeDetector.getGaussianPlane(), pixels, 1, 1, VERIFY_TOL_GAUSSIAN, true);
+		failed |= checkStage("sobel magnitude", nativeReference.getMagnitudePlane(),
+			nativeDetector.getMagnitudePlane(), pixels, 1, 1, VERIFY_TOL_SOBEL, true);
+		failed |= checkStage("sobel theta", nativeReference.getThetaPlane(),
+			nativeDetector.getThetaPlane(), pixels, 1, 1, VERIFY_TOL_THETA, true);
+		failed |= checkStage("max", nativeReference.getMaxPlane(),
+			nativeDetector.getMaxPlane(), pixels, 1, 1, VERIFY_TOL_MAX, true);
+	}
+	else if (flatThreshold >= 0)
+	{
+		// Intermediates of skipped tiles were never computed
+		std::cout << "Verifying tiles against native reference" << std::endl;
+	}
+	else if (tileRows != 0)
+	{
+		// Intermediates only exist per strip; check the stitched output
+		std::cout << "Verifying stitched strips against native reference" << std::endl;
+	}
+	else
+	{
+		std::cout << "Verifying against native reference" << std::endl;
+
+		// Run the pipeline once more, one stage at a time, reading every intermediate back
+		cl_uchar* stageData = (cl_uchar*)malloc(pixels * pixelSize);
+		CHECK_ALLOCATION(stageData, "Failed to allocate host memory! (stageData)");
+
+		StripContext image = wholeImage();
+		status = uploadInput(image, 0, CL_TRUE);
+		CHECK_ERROR(status, SDK_SUCCESS, "uploadInput() failed");
+
+		GreyScale(image);
+		status = readStage(prevImageBuffer, stageData, pixels * pixelSize);
+		CHECK_ERROR(status, SDK_SUCCESS, "readStage() failed");
+		failed |= checkStage("greyscale", nativeReference.getGreyPlane(), stageData,
+			pixels, pixelSize, 1, VERIFY_TOL_GREY, true);
+
+		Gaussian(image);
+		status = readStage(nextImageBuffer, stageData, pixels * pixelSize);
+		CHECK_ERROR(status, SDK_SUCCESS, "readStage() failed");
+		failed |= checkStage("gaussian", nativeReference.getGaussianPlane(), stageData,
+			pixels, pixelSize, 1, VERIFY_TOL_GAUSSIAN, true);
+
+		if (fusedNms)
+		{
+			// Magnitude and theta never reach global memory
+			SobelMax(image);
+			status = readStage(prevImageBuffer, stageData, pixels * pixelSize);
+			CHECK_ERROR(status, SDK_SUCCESS, "readStage() failed");
+			failed |= checkStage("sobel + max", nativeReference.getMaxPlane(), stageData,
+				pixels, pixelSize, 1, VERIFY_TOL_MAX, true);
+		}
+		else
+		{
+			Sobel(image);
+			if (packedGradient)
+			{
+				// Unpack magnitude << 2 | code into the two planes of the split layout
+				status = readStage(thetaBuffer, stageData, pixels * sizeof(cl_ushort));
+				CHECK_ERROR(status, SDK_SUCCESS, "readStage() failed");
+				const cl_ushort* gradient = (const cl_ushort*)stageData;
+				for (size_t i = 0; i < pixels; i++)
+				{
+					cl_ushort g = gradient[i];
+					stageData[2 * pixels + i] = (cl_uchar)(g >> 2);
+					stageData[3 * pixels + i] = (cl_uchar)((g & 3) * 45);
+				}
+				failed |= checkStage("sobel magnitude", nativeReference.getMagnitudePlane(),
+					stageData + 2 * pixels, pixels, 1, 1, VERIFY_TOL_SOBEL, true);
+				memmove(stageData, stageData + 3 * pixels, pixels);
+			}
+			else
+			{
+				status = readStage(prevImageBuffer, stageData, pixels * pixelSize);
+				CHECK_ERROR(status, SDK_SUCCESS, "readStage() failed");
+				failed |= checkStage("sobel magnitude", nativeReference.getMagnitudePlane(), stageData,
+					pixels, pixelSize, 1, VERIFY_TOL_SOBEL, true);
+				status = readStage(thetaBuffer, stageData, pixels);
+				CHECK_ERROR(status, SDK_SUCCESS, "readStage() failed");
+				for (size_t i = 0; tangentDirection && i < pixels; i++)
+				{
+					// sobel_direction writes codes, the reference degrees
+					stageData[i] *= 45;
+				}
+			}
+			failed |= checkStage("sobel theta", nativeReference.getThetaPlane(), stageData,
+				pixels, 1, 1, VERIFY_TOL_THETA, true);
+
+			Max(image);
+			status = readStage(nextImageBuffer, stageData, pixels * pixelSize);
+			CHECK_ERROR(status, SDK_SUCCESS, "readStage() failed");
+			failed |= checkStage("max", nativeReference.getMaxPlane(), stageData,
+				pixels, pixelSize, 1, VERIFY_TOL_MAX, true);
+		}
+
+		// The outputs mapped by the last timed run
+		const cl_uchar* referencePlanes[] = { nativeReference.getGaussianPlane(),
+			nativeReference.getMagnitudePlane(), nativeReference.getThetaPlane(), nativeReference.getMaxPlane() };
+		const cl_uchar tolerances[] = { VERIFY_TOL_GAUSSIAN, VERIFY_TOL_SOBEL, VERIFY_TOL_THETA, VERIFY_TOL_MAX };
+		for (int o = 0; o < EDGE_OUTPUT_EDGES; o++)
+		{
+			cl_uint stride;
+			const cl_uchar* data = getOutput((EdgeOutput)o, &stride);
+			if (data == NULL)
+			{
+				continue;
+			}
+			cl_uint scale = o == EDGE_OUTPUT_DIRECTION ? getDirectionScale() : 1;
+			for (size_t i = 0; i < pixels; i++)
+			{
+				stageData[i] = (cl_uchar)(data[i * stride] * scale);
+			}
+			std::string stage = std::string("output ") + EDGE_OUTPUT_NAMES[o];
+			failed |= checkStage(stage.c_str(), referencePlanes[o], stageData, pixels, 1, 1, tolerances[o], true);
+		}
+
+		FREE(stageData);
+	}
+
+	failed |= checkStage("hysteresis", verificationOutput, (const cl_uchar*)outputImageData,
+		pixels * pixelSize, 1, pixelSize, VERIFY_TOL_HYST, true);
+	if (fastMath || flatThreshold >= 0)
+	{
+		reportEdgeAccuracy(verificationOutput, (const cl_uchar*)outputImageData, pixels);
+	}
+
+	if (!sdkContext->verify)
+	{
+		std::cout << (failed ? "Outside" : "Within") << " the --verify tolerances\n" << std::endl;
+		return SDK_SUCCESS;
+	}
+
+	if (failed)
+	{
+		std::cout << "Failed\n" << std::endl;
+		return SDK_FAILURE;
+	}
+
+	std::cout << "Passed!\n" << std::endl;
+	return SDK_SUCCESS;
 }
-*/
+
 void
 EdgeDetector::printStats()
 {
@@ -1340,6 +5851,45 @@ EdgeDetector::printStats()
 
 		printStatistics(strArray, stats, 4);
 	}
+
+	if (edgeListMode)
+	{
+		std::cout << "Edge list: " << edgeCount << " edges, " << (size_t)edgeCount * sizeof(cl_ushort4)
+			<< " bytes instead of " << (size_t)width * height * pixelSize << std::endl;
+	}
+
+	if (packedOutput)
+	{
+		std::cout << "Packed output: " << packedRowBytes * height << " bytes instead of "
+			<< (size_t)width * height * pixelSize << std::endl;
+	}
+
+	if (!sdkContext->isNativeDevice() && !fusedNms && (packedGradient || sdkContext->timing))
+	{
+		// Bytes sobel writes per frame and max reads back for each pixel
+		size_t splitBytes = pixelSize + sizeof(cl_uchar);
+		size_t bytes = packedGradient ? sizeof(cl_ushort) : splitBytes;
+		std::cout << "Intermediate: " << intermediateLayout << ", " << bytes << " bytes per pixel written ("
+			<< bytes * width * height << " bytes per frame, split " << splitBytes * width * height << ")"
+			<< std::endl;
+		// The image buffers are allocated either way; they also carry the greyscale, gaussian and edges
+		std::cout << "Intermediate allocated: thetaBuffer " << thetaBufferBytes << " bytes, image buffers "
+			<< imageBufferBytes << " bytes" << std::endl;
+	}
+
+	if (flatFrames > 0)
+	{
+		size_t tileCount = (size_t)(width / FLAT_TILE) * (height / FLAT_TILE);
+		std::cout << "Flat tiles: " << 100.0 * skippedTiles / ((size_t)flatFrames * tileCount)
+			<< "% of " << tileCount << " tiles skipped per frame, " << tileCounts[1]
+			<< " written as zero in the last frame" << std::endl;
+	}
+
+	if (pyramidFuse)
+	{
+		std::cout << "Pyramid gating: " << 100.0 * gatedFraction
+			<< "% of the image processed at full resolution" << std::endl;
+	}
 }
 
 
@@ -0,0 +1,342 @@
+#ifndef Mapped_BitMap_H_
+#define Mapped_BitMap_H_
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "SDKUtil.hpp"
+#include "SDKBitMap.hpp"
+
+using namespace appsdk;
+
+/**
+* MappedBitMap
+* Loads a BMP through a read-only file mapping. 32 bit bottom-up images are
+* used in place (B, G, R, A byte order, rows in file order like SDKBitMap).
+* On request 24 and 8 bit bottom-up images without row padding are kept
+* packed as well; every other layout is converted once into an R, G, B, A copy.
+*/
+
+class MappedBitMap : public BitMapHeader, public BitMapInfoHeader
+{
+        const unsigned char* base_;     /**< Start of the file mapping */
+        size_t mappedSize_;             /**< Bytes mapped */
+#if defined(_WIN32)
+        HANDLE file_;                   /**< File handle */
+        HANDLE mapping_;                /**< File mapping handle */
+#else
+        int fd_;                        /**< File descriptor */
+#endif
+        const unsigned char* pixels_;   /**< First pixel row, mapped or converted */
+        uchar4* converted_;             /**< Owned copy when conversion was needed */
+        int rows_;                      /**< Image height (positive) */
+        bool bgra_;                     /**< pixels_ hold B, G, R, A */
+        int pixelBytes_;                /**< Bytes per pixel of pixels_: 4, 3 (B, G, R) or 1 (index) */
+
+        bool map(const char* filename);
+        void unmap();
+
+    public:
+
+        MappedBitMap()
+            : base_(NULL),
+              mappedSize_(0),
+#if defined(_WIN32)
+              file_(INVALID_HANDLE_VALUE),
+              mapping_(NULL),
+#else
+              fd_(-1),
+#endif
+              pixels_(NULL),
+              converted_(NULL),
+              rows_(0),
+              bgra_(false),
+              pixelBytes_(0)
+        {}
+
+        ~MappedBitMap()
+        {
+            close();
+        }
+
+        /**
+        * Map and parse a bitmap
+        * @param filename path of the bitmap
+        * @param keepPacked keep unpadded bottom-up 24 and 8 bit rows as they are
+        * @return true if an uncompressed 8, 24 or 32 bit bitmap was loaded
+        */
+        bool load(const char* filename, bool keepPacked = false);
+
+        /**
+        * Convert packed pixels to R, G, B, A uchar4 and drop the mapping;
+        * nothing to do if the pixels are uchar4 already
+        * @return true on success
+        */
+        bool expand();
+
+        /**
+        * Release the mapping and any converted copy
+        */
+        void close();
+
+        int getWidth() const { return width; }
+
+        int getHeight() const { return rows_; }
+
+        /**
+        * Pixels in file row order, width * height contiguous uchar4.
+        * Mapped pixels need not be 4 byte aligned. Only valid if getPixelBytes() is 4.
+        */
+        const uchar4* getPixels() const { return (const uchar4*)pixels_; }
+
+        /**
+        * Pixels in file row order, width * height * getPixelBytes() contiguous bytes
+        */
+        const unsigned char* getData() const { return pixels_; }
+
+        /**
+        * 4 for uchar4, 3 for packed B, G, R and 1 for packed palette indices
+        */
+        int getPixelBytes() const { return pixelBytes_; }
+
+        /**
+        * Palette of packed 8 bit pixels, 256 entries stored as B, G, R, reserved
+        */
+        const ColorPalette* getPalette() const
+        {
+            return (const ColorPalette*)(base_ + sizeof(BitMapHeader) + sizeInfo);
+        }
+
+        /**
+        * true if getPixels() points into the file mapping (no copy was made)
+        */
+        bool isZeroCopy() const { return pixels_ != NULL && converted_ == NULL; }
+
+        /**
+        * true if getPixels() is in B, G, R, A order instead of R, G, B, A
+        */
+        bool isBGRA() const { return bgra_; }
+};
+
+bool
+MappedBitMap::map(const char* filename)
+{
+#if defined(_WIN32)
+	file_ = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file_ == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file_, &fileSize) || fileSize.QuadPart == 0)
+	{
+		return false;
+	}
+	mappedSize_ = (size_t)fileSize.QuadPart;
+	mapping_ = CreateFileMappingA(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping_ == NULL)
+	{
+		return false;
+	}
+	base_ = (const unsigned char*)MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+	return base_ != NULL;
+#else
+	fd_ = open(filename, O_RDONLY);
+	if (fd_ < 0)
+	{
+		return false;
+	}
+	struct stat fileStat;
+	if (fstat(fd_, &fileStat) != 0 || fileStat.st_size == 0)
+	{
+		return false;
+	}
+	mappedSize_ = (size_t)fileStat.st_size;
+	void* addr = mmap(NULL, mappedSize_, PROT_READ, MAP_PRIVATE, fd_, 0);
+	if (addr == MAP_FAILED)
+	{
+		return false;
+	}
+	// Pixels are read front to back by the converter and the kernels' upload
+	madvise(addr, mappedSize_, MADV_SEQUENTIAL);
+	base_ = (const unsigned char*)addr;
+	return true;
+#endif
+}
+
+void
+MappedBitMap::unmap()
+{
+#if defined(_WIN32)
+	if (base_ != NULL)
+	{
+		UnmapViewOfFile(base_);
+	}
+	if (mapping_ != NULL)
+	{
+		CloseHandle(mapping_);
+	}
+	if (file_ != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(file_);
+	}
+	mapping_ = NULL;
+	file_ = INVALID_HANDLE_VALUE;
+#else
+	if (base_ != NULL)
+	{
+		munmap((void*)base_, mappedSize_);
+	}
+	if (fd_ >= 0)
+	{
+		::close(fd_);
+	}
+	fd_ = -1;
+#endif
+	base_ = NULL;
+	mappedSize_ = 0;
+}
+
+bool
+MappedBitMap::load(const char* filename, bool keepPacked)
+{
+	close();
+
+	if (!map(filename) || mappedSize_ < sizeof(BitMapHeader) + sizeof(BitMapInfoHeader))
+	{
+		close();
+		return false;
+	}
+
+	memcpy((BitMapHeader*)this, base_, sizeof(BitMapHeader));
+	memcpy((BitMapInfoHeader*)this, base_ + sizeof(BitMapHeader), sizeof(BitMapInfoHeader));
+
+	if (id != bitMapID || compression || width <= 0 || height == 0 ||
+		(bitsPerPixel != 8 && bitsPerPixel != 24 && bitsPerPixel != 32))
+	{
+		close();
+		return false;
+	}
+
+	rows_ = height < 0 ? -height : height;
+	size_t rowBytes = (((size_t)width * bitsPerPixel / 8) + 3) & ~(size_t)3;
+	if (offset < 0 || (size_t)offset + rowBytes * rows_ > mappedSize_)
+	{
+		close();
+		return false;
+	}
+
+	const unsigned char* palette = base_ + sizeof(BitMapHeader) + sizeInfo;
+	if (bitsPerPixel == 8 && palette + 256 * sizeof(ColorPalette) > base_ + mappedSize_)
+	{
+		close();
+		return false;
+	}
+
+	// 32 bit rows are never padded, so a bottom-up file is already width * height uchar4.
+	// The usual 54 byte header leaves them only byte aligned; every consumer reads bytes.
+	if (height > 0 && (bitsPerPixel == 32 ||
+		(keepPacked && rowBytes == (size_t)width * bitsPerPixel / 8)))
+	{
+		pixels_ = base_ + offset;
+		pixelBytes_ = bitsPerPixel / 8;
+		bgra_ = bitsPerPixel == 32;
+		return true;
+	}
+
+	if (!expand())
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool
+MappedBitMap::expand()
+{
+	if (pixelBytes_ == 4 || base_ == NULL)
+	{
+		return pixels_ != NULL;
+	}
+
+	converted_ = new uchar4[(size_t)width * rows_];
+	if (converted_ == NULL)
+	{
+		return false;
+	}
+
+	size_t rowBytes = (((size_t)width * bitsPerPixel / 8) + 3) & ~(size_t)3;
+	const unsigned char* palette = base_ + sizeof(BitMapHeader) + sizeInfo;
+
+	for (int y = 0; y < rows_; y++)
+	{
+		// Top-down files store the last file-order row first
+		int fileRow = height > 0 ? y : rows_ - 1 - y;
+		const unsigned char* in = base_ + offset + (size_t)fileRow * rowBytes;
+		uchar4* out = converted_ + (size_t)y * width;
+
+		if (bitsPerPixel == 24)
+		{
+			for (int x = 0; x < width; x++, in += 3)
+			{
+				out[x].x = in[2];
+				out[x].y = in[1];
+				out[x].z = in[0];
+				out[x].w = 0xff;
+			}
+		}
+		else if (bitsPerPixel == 32)
+		{
+			for (int x = 0; x < width; x++, in += 4)
+			{
+				out[x].x = in[2];
+				out[x].y = in[1];
+				out[x].z = in[0];
+				out[x].w = in[3];
+			}
+		}
+		else
+		{
+			// Palette entries are stored as B, G, R, reserved
+			for (int x = 0; x < width; x++)
+			{
+				const unsigned char* c = palette + 4 * in[x];
+				out[x].x = c[2];
+				out[x].y = c[1];
+				out[x].z = c[0];
+				out[x].w = 0xff;
+			}
+		}
+	}
+
+	pixels_ = (const unsigned char*)converted_;
+	pixelBytes_ = 4;
+	bgra_ = false;
+
+	// Everything needed is copied; the mapping is no longer used
+	unmap();
+	return true;
+}
+
+void
+MappedBitMap::close()
+{
+	unmap();
+	delete[] converted_;
+	converted_ = NULL;
+	pixels_ = NULL;
+	rows_ = 0;
+	bgra_ = false;
+	pixelBytes_ = 0;
+}
+
+#endif // Mapped_BitMap_H_
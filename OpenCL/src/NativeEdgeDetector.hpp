@@ -0,0 +1,1617 @@
+#ifndef Native_Edge_Detector_H_
+#define Native_Edge_Detector_H_
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <CL/opencl.h>
+#include "SDKUtil.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NATIVE_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(__SSSE3__) || defined(__AVX2__)
+#define NATIVE_SSSE3
+#include <tmmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#define NATIVE_AVX2
+#include <immintrin.h>
+#endif
+
+using namespace appsdk;
+
+#define NATIVE_MIN_BAND_ROWS 8
+#define NATIVE_BANDS_PER_THREAD 4
+
+#define HYST_LOW_THRESHOLD 20
+#define HYST_HIGH_THRESHOLD 70
+
+// tan(22.5 degrees) * 2^14, the direction buckets of sobel_direction
+#define TAN_22_5 6786
+
+/**
+* Layout of the pixels given to NativeEdgeDetector::run
+*/
+enum NativeInputFormat
+{
+    NATIVE_INPUT_RGBA,                      /**< uchar4, x = R */
+    NATIVE_INPUT_BGRA,                      /**< uchar4, x = B (32 bit BMP memory) */
+    NATIVE_INPUT_BGR,                       /**< 3 bytes B, G, R (24 bit BMP memory) */
+    NATIVE_INPUT_RGB,                       /**< 3 bytes R, G, B (PPM) */
+    NATIVE_INPUT_INDEX8,                    /**< 1 byte palette index (8 bit BMP memory) */
+    NATIVE_INPUT_LUMA                       /**< 1 byte luminance (PGM, raw planes), no greyscale stage */
+};
+
+/**
+* What the 3x3 stages (gaussian, sobel, max) read outside the image; the ring of
+* pixels whose window leaves the image is where the modes differ
+*/
+enum NativeBorderMode
+{
+    NATIVE_BORDER_LEGACY,                   /**< Ring as the OpenCL buffers hold it after one pass */
+    NATIVE_BORDER_CLAMP,                    /**< Nearest edge pixel */
+    NATIVE_BORDER_MIRROR,                   /**< Reflected about the edge pixel, which is not repeated */
+    NATIVE_BORDER_ZERO,                     /**< 0 */
+    NATIVE_BORDER_SKIP                      /**< No window; the ring outputs are 0 */
+};
+
+/**
+* NativeThreadPool
+* Fixed set of worker threads. Every job is a row range which is cut into
+* bands; workers and the calling thread pull bands until none are left.
+*/
+
+class NativeThreadPool
+{
+        std::vector<std::thread> workers;   /**< Worker threads (caller runs bands too) */
+        std::mutex poolLock;                /**< Guards job publication and shutdown */
+        std::condition_variable wakeCond;   /**< Signalled when a job is published */
+        std::condition_variable doneCond;   /**< Signalled when the last band is done or the last worker leaves */
+        const std::function<void(cl_uint, cl_uint)>* job; /**< Band function of current job */
+        cl_uint jobRows;                    /**< Rows covered by current job */
+        cl_uint bandRows;                   /**< Rows per band */
+        cl_uint bandCount;                  /**< Bands in current job */
+        std::atomic<cl_uint> nextBand;      /**< Next band to hand out */
+        std::atomic<cl_uint> pendingBands;  /**< Bands not finished yet */
+        size_t generation;                  /**< Incremented for every published job */
+        unsigned int activeWorkers;         /**< Workers inside runBands(); a job is only published at 0 */
+        bool stopping;                      /**< Set by the destructor */
+
+        void workerLoop();
+        void runBands();
+
+    public:
+
+        /**
+        * Constructor
+        * @param threadCount total threads including the caller, 0 for all cores
+        */
+        NativeThreadPool(unsigned int threadCount);
+
+        ~NativeThreadPool();
+
+        /**
+        * Run fn(y0, y1) over [0, rows) split into bands and wait for all of them
+        * @param rows number of rows to cover
+        * @param fn band function, called with a half open row range
+        */
+        void parallelRows(cl_uint rows, const std::function<void(cl_uint, cl_uint)>& fn);
+
+        unsigned int threadCount() const { return (unsigned int)workers.size() + 1; }
+};
+
+NativeThreadPool::NativeThreadPool(unsigned int threadCount)
+	: job(NULL), jobRows(0), bandRows(0), bandCount(0), nextBand(0), pendingBands(0),
+	  generation(0), activeWorkers(0), stopping(false)
+{
+	if (threadCount == 0)
+	{
+		threadCount = std::thread::hardware_concurrency();
+	}
+	for (unsigned int i = 1; i < threadCount; i++)
+	{
+		workers.push_back(std::thread(&NativeThreadPool::workerLoop, this));
+	}
+}
+
+NativeThreadPool::~NativeThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> guard(poolLock);
+		stopping = true;
+	}
+	wakeCond.notify_all();
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		workers[i].join();
+	}
+}
+
+void NativeThreadPool::workerLoop()
+{
+	size_t seen = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> guard(poolLock);
+			while (!stopping && generation == seen)
+			{
+				wakeCond.wait(guard);
+			}
+			if (stopping)
+			{
+				return;
+			}
+			seen = generation;
+			activeWorkers++;
+		}
+		runBands();
+		{
+			std::lock_guard<std::mutex> guard(poolLock);
+			if (--activeWorkers == 0)
+			{
+				doneCond.notify_all();
+			}
+		}
+	}
+}
+
+void NativeThreadPool::runBands()
+{
+	for (;;)
+	{
+		cl_uint band = nextBand.fetch_add(1);
+		if (band >= bandCount)
+		{
+			return;
+		}
+		cl_uint y0 = band * bandRows;
+		cl_uint y1 = y0 + bandRows < jobRows ? y0 + bandRows : jobRows;
+		(*job)(y0, y1);
+		if (pendingBands.fetch_sub(1) == 1)
+		{
+			std::lock_guard<std::mutex> guard(poolLock);
+			doneCond.notify_all();
+		}
+	}
+}
+
+void NativeThreadPool::parallelRows(cl_uint rows, const std::function<void(cl_uint, cl_uint)>& fn)
+{
+	if (rows == 0)
+	{
+		return;
+	}
+	cl_uint bands = (cl_uint)threadCount() * NATIVE_BANDS_PER_THREAD;
+	cl_uint rowsPerBand = (rows + bands - 1) / bands;
+	if (rowsPerBand < NATIVE_MIN_BAND_ROWS)
+	{
+		rowsPerBand = NATIVE_MIN_BAND_ROWS;
+	}
+	if (workers.empty() || rows <= rowsPerBand)
+	{
+		fn(0, rows);
+		return;
+	}
+
+	{
+		// A worker still in runBands() for the previous job reads the job without
+		// the lock; rewriting it under that worker could hand out a band twice
+		std::unique_lock<std::mutex> guard(poolLock);
+		while (activeWorkers != 0)
+		{
+			doneCond.wait(guard);
+		}
+		job = &fn;
+		jobRows = rows;
+		bandRows = rowsPerBand;
+		bandCount = (rows + rowsPerBand - 1) / rowsPerBand;
+		pendingBands.store(bandCount);
+		nextBand.store(0);
+		generation++;
+	}
+	wakeCond.notify_all();
+
+	runBands();
+
+	std::unique_lock<std::mutex> guard(poolLock);
+	while (pendingBands.load() != 0)
+	{
+		doneCond.wait(guard);
+	}
+}
+
+
+/**
+* NativeEdgeDetector
+* Host implementation of the greyscale, Gaussian, Sobel, Max and Hysteresis
+* kernels. Only the x channel decides the final edge map, so every stage
+* works on a single byte plane and the result is broadcast to uchar4 at the end.
+* Border pixels reproduce what the OpenCL buffers hold after one pass.
+*/
+
+class NativeEdgeDetector
+{
+        cl_uint width;                      /**< Width of processed region */
+        cl_uint height;                     /**< Rows of the current run */
+        cl_uint capacityRows;               /**< Rows the planes are allocated for */
+        cl_uchar* lumPlane;                 /**< greyscale_filter output */
+        const cl_uchar* lumSource;          /**< Greyscale the later stages read: lumPlane or luminance input */
+        cl_uchar* gausPlane;                /**< gaussian_filter output */
+        cl_uchar* magPlane;                 /**< sobel_filter magnitude */
+        cl_uchar* thetaPlane;               /**< sobel_filter direction (0/45/90/135) */
+        cl_uchar* maxPlane;                 /**< Max_filter output */
+        cl_uint hystThreshold;              /**< Smallest magnitude accepted by Hyst_filter */
+        float gaussianSide;                 /**< Outer weight of the gaussian in each direction, 0.25 for 1-2-1 */
+        bool useSimd;                       /**< false runs the scalar loops only */
+        bool exactLuma;                     /**< Greyscale as (30 R + 59 G + 11 B) / 100 in integers, not the float sum */
+        bool tangentDirection;              /**< Directions of sobel_direction (tan(22.5) buckets), not sobel_filter */
+        bool zeroBorder;                    /**< Border ring of magnitude and max is 0 (sobel_max_filter) */
+        bool l1Magnitude;                   /**< Magnitude is (|Gx| + |Gy|) / 2 (--fast-math l1) */
+        NativeBorderMode borderMode;        /**< Reads outside the image of the 3x3 stages */
+        NativeInputFormat inputFormat;      /**< Layout of the input pixels */
+        cl_uint pixelBytes;                 /**< Bytes per input pixel */
+        cl_uint redByte;                    /**< Byte of the red channel in 3 and 4 byte input */
+        cl_uchar lumTable[256];             /**< Greyscale of each palette entry */
+        cl_uchar redTable[256];             /**< Red channel of each palette entry */
+        float thetaCos[3];                  /**< Direction bucket boundaries, cosine */
+        float thetaSin[3];                  /**< Direction bucket boundaries, sine */
+        NativeThreadPool* pool;             /**< Row band workers */
+
+    public:
+
+        /**
+        * Constructor
+        * Initialize member variables
+        */
+        NativeEdgeDetector()
+            : width(0),
+              height(0),
+              capacityRows(0),
+              lumPlane(NULL),
+              lumSource(NULL),
+              gausPlane(NULL),
+              magPlane(NULL),
+              thetaPlane(NULL),
+              maxPlane(NULL),
+              hystThreshold(0),
+              gaussianSide(0.25f),
+              useSimd(true),
+              exactLuma(false),
+              tangentDirection(false),
+              zeroBorder(false),
+              l1Magnitude(false),
+              borderMode(NATIVE_BORDER_LEGACY),
+              inputFormat(NATIVE_INPUT_RGBA),
+              pixelBytes(4),
+              redByte(0),
+              pool(NULL)
+        {
+        }
+
+        /**
+        * Allocate intermediate planes and start the worker threads
+        * @param imageWidth width of the processed region
+        * @param imageHeight height of the processed region
+        * @param threadCount worker threads, 0 for all cores
+        * @param simd false to run the scalar code only (reference for the SIMD paths)
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int setup(cl_uint imageWidth, cl_uint imageHeight, unsigned int threadCount,
+            bool simd = true);
+
+        /**
+        * Run the whole pipeline
+        * @param input width * height pixels in the layout given to setInputFormat()
+        * @param output edge map, width * height pixels
+        * @param rows rows to process, 0 for the height given to setup()
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int run(const void* input, cl_uchar4* output, cl_uint rows = 0);
+
+        /**
+        * Run only the greyscale and gaussian stages, e.g. to build a coarser
+        * pyramid level from getGaussianPlane()
+        * @param input width * height pixels in the layout given to setInputFormat()
+        * @param rows rows to process, 0 for the height given to setup()
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int smooth(const void* input, cl_uint rows = 0);
+
+        /**
+        * Rerun the pipeline for input rows that changed since the last run();
+        * planes and output rows out of their reach are kept
+        * @param input all rows of the new frame, in the layout given to setInputFormat()
+        * @param output edge map of the last run, updated in place
+        * @param y0 first changed input row
+        * @param y1 end of the changed input rows
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int update(const void* input, cl_uchar4* output, cl_uint y0, cl_uint y1);
+
+        /**
+        * Run the pipeline for some output rows of a frame of the height given
+        * to setup(); the earlier stages cover the rows these depend on
+        * @param input all rows, in the layout given to setInputFormat()
+        * @param output edge map, only rows y0 to y1 are written
+        * @param y0 first output row
+        * @param y1 end of the output rows
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int runRows(const void* input, cl_uchar4* output, cl_uint y0, cl_uint y1);
+
+        /**
+        * Run only the hysteresis stage, on a max plane kept from an earlier run
+        * @param maxInput width * height magnitudes after non-maximum suppression
+        * @param output edge map, width * height pixels
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int threshold(const cl_uchar* maxInput, cl_uchar4* output);
+
+        /**
+        * Stop worker threads and free planes
+        * @return SDK_SUCCESS on success and SDK_FAILURE on failure
+        */
+        int cleanup();
+
+        /**
+        * Select the layout of the input pixels
+        * @param format pixel layout
+        * @param palette 256 R, G, B, A entries for NATIVE_INPUT_INDEX8
+        */
+        void setInputFormat(NativeInputFormat format, const cl_uchar4* palette = NULL);
+
+        /**
+        * Select the greyscale arithmetic of greyscale_filter built with or without
+        * EXACT_LUMA; call before setInputFormat()
+        * @param exact true for integer weights
+        */
+        void setExactLuma(bool exact) { exactLuma = exact; }
+
+        /**
+        * Select the direction buckets of sobel_direction (tangent comparisons at
+        * 22.5 and 67.5 degrees) or of sobel_filter; thetaPlane holds degrees either way
+        * @param tangent true for sobel_direction
+        */
+        void setTangentDirection(bool tangent) { tangentDirection = tangent; }
+
+        /**
+        * Give the pixels sobel_filter skips no magnitude, as sobel_max_filter does,
+        * instead of the greyscale sobel_filter leaves in its output buffer
+        * @param zero true for sobel_max_filter
+        */
+        void setZeroBorder(bool zero) { zeroBorder = zero; }
+
+        /**
+        * Take the magnitude as (|Gx| + |Gy|) / 2, as the kernels built with
+        * --fast-math l1 do, instead of half the Euclidean length
+        * @param l1 true for the L1 magnitude
+        */
+        void setL1Magnitude(bool l1) { l1Magnitude = l1; }
+
+        /**
+        * Select how gaussian, sobel and max treat the pixels outside the image
+        * @param mode NATIVE_BORDER_LEGACY reproduces the OpenCL buffers of the
+        * kernels without border launches
+        */
+        void setBorderMode(NativeBorderMode mode) { borderMode = mode; }
+
+        /**
+        * Weight the gaussian side, 1 - 2 side, side in each direction in float, as
+        * gaussian_weighted does; 0.25 is the integer 1-2-1 filter
+        * @param side outer weight
+        */
+        void setGaussianSide(float side) { gaussianSide = side; }
+
+        /**
+        * Thresholds of Hyst_filter: >= high is an edge, <= low is not, otherwise
+        * the pixel is an edge from (low + high) / 2
+        * @param low lower threshold
+        * @param high upper threshold
+        */
+        void setThresholds(cl_uint low, cl_uint high);
+
+        void GreyScale(const cl_uchar* input, cl_uint y0, cl_uint y1);
+
+        void Gaussian(const cl_uchar* input, cl_uint y0, cl_uint y1);
+
+        void Sobel(cl_uint y0, cl_uint y1);
+
+        void Max(cl_uint y0, cl_uint y1);
+
+        void Hysteresis(const cl_uchar* maxInput, cl_uchar* output, cl_uint y0, cl_uint y1);
+
+        /**
+        * Edge pixels of the last run in raster order
+        * @param points receives x, y, direction and 0 per edge, room for width * height
+        * @return number of edges
+        */
+        cl_uint listEdges(cl_ushort4* points) const;
+
+        unsigned int threadCount() const { return pool ? pool->threadCount() : 0; }
+
+        const cl_uchar* getGreyPlane() const { return lumSource; }
+        const cl_uchar* getGaussianPlane() const { return gausPlane; }
+        const cl_uchar* getMagnitudePlane() const { return magPlane; }
+        const cl_uchar* getThetaPlane() const { return thetaPlane; }
+        const cl_uchar* getMaxPlane() const { return maxPlane; }
+
+    private:
+
+        cl_uchar maxPixel(cl_uint c);
+
+        /**
+        * Magnitude and direction (degrees) of one Sobel response
+        */
+        void sobelPixel(int gx, int gy, cl_uchar& mag, cl_uchar& theta) const;
+
+        /**
+        * Row or column i of a dimension of n pixels, mapped into the image by
+        * borderMode; -1 for a pixel that reads as 0
+        */
+        int borderIndex(int i, int n) const
+        {
+            if (i >= 0 && i < n)
+            {
+                return i;
+            }
+            switch (borderMode)
+            {
+            case NATIVE_BORDER_CLAMP:
+                return i < 0 ? 0 : n - 1;
+            case NATIVE_BORDER_MIRROR:
+                i = i < 0 ? -i : 2 * (n - 1) - i;
+                return i < 0 ? 0 : (i >= n ? n - 1 : i);
+            default:
+                return -1;
+            }
+        }
+
+        /**
+        * Pixel (x, y) of a plane, coordinates outside the image mapped by borderMode
+        */
+        cl_uchar borderPixel(const cl_uchar* plane, int x, int y) const
+        {
+            x = borderIndex(x, (int)width);
+            y = borderIndex(y, (int)height);
+            return (x < 0 || y < 0) ? 0 : plane[(size_t)y * width + x];
+        }
+
+        /**
+        * Gaussian, Sobel and Max of a ring pixel under borderMode
+        */
+        cl_uchar gaussianBorder(cl_uint x, cl_uint y) const;
+
+        void sobelBorder(cl_uint x, cl_uint y);
+
+        cl_uchar maxBorder(cl_uint x, cl_uint y) const;
+
+        /**
+        * Greyscale of one pixel
+        */
+        cl_uchar luma(float r, float g, float b) const
+        {
+            if (exactLuma)
+            {
+                return (cl_uchar)((30 * (cl_uint)r + 59 * (cl_uint)g + 11 * (cl_uint)b) / 100);
+            }
+            return (cl_uchar)(r * 0.30f + g * 0.59f + b * 0.11f);
+        }
+
+        /**
+        * Run every stage over [y0, y1) widened by a per stage number of rows
+        * @param grow rows added on each side for greyscale, gaussian, sobel, max and hysteresis
+        */
+        void runStages(const cl_uchar* pixels, cl_uchar* edges, cl_uint y0, cl_uint y1,
+            const cl_uint grow[5]);
+
+        /**
+        * Red channel of input pixel i, which gaussian_filter leaves on the border
+        */
+        cl_uchar inputRed(const cl_uchar* input, size_t i) const
+        {
+            switch (inputFormat)
+            {
+            case NATIVE_INPUT_BGR:
+            case NATIVE_INPUT_RGB:
+                return input[3 * i + redByte];
+            case NATIVE_INPUT_INDEX8:
+                return redTable[input[i]];
+            case NATIVE_INPUT_LUMA:
+                return input[i];
+            default:
+                return input[4 * i + redByte];
+            }
+        }
+
+#if defined(NATIVE_SSE2)
+        /**
+        * (30 R + 59 G + 11 B) / 100 of four pixels, channels in 32-bit lanes;
+        * x / 100 is (x * 5243) >> 19 for every x up to 25500
+        */
+        static inline __m128i exactLumaQuad(__m128i r, __m128i g, __m128i b)
+        {
+            __m128i sum = _mm_add_epi32(_mm_add_epi32(
+                _mm_madd_epi16(r, _mm_set1_epi32(30)), _mm_madd_epi16(g, _mm_set1_epi32(59))),
+                _mm_madd_epi16(b, _mm_set1_epi32(11)));
+            return _mm_srli_epi32(_mm_madd_epi16(sum, _mm_set1_epi32(5243)), 19);
+        }
+
+        /**
+        * Magnitude of four Sobel responses
+        * @param xy interleaved 16-bit (Gx, Gy) pairs
+        */
+        static inline __m128i sobelMagnitude(__m128i xy)
+        {
+            __m128 len = _mm_sqrt_ps(_mm_cvtepi32_ps(_mm_madd_epi16(xy, xy)));
+            return _mm_cvttps_epi32(_mm_mul_ps(len, _mm_set1_ps(0.5f)));
+        }
+
+        /**
+        * (|Gx| + |Gy|) / 2 of eight Sobel responses
+        * @param gx 16-bit vertical differences
+        * @param gy 16-bit horizontal differences
+        */
+        static inline __m128i l1Magnitudes(__m128i gx, __m128i gy)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            __m128i ax = _mm_max_epi16(gx, _mm_sub_epi16(zero, gx));
+            __m128i ay = _mm_max_epi16(gy, _mm_sub_epi16(zero, gy));
+            return _mm_srli_epi16(_mm_add_epi16(ax, ay), 1);
+        }
+
+        /**
+        * sobel_direction buckets of eight Sobel responses, in degrees
+        * @param gx 16-bit vertical differences
+        * @param gy 16-bit horizontal differences
+        */
+        static inline __m128i tangentDirections(__m128i gx, __m128i gy)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i weights = _mm_setr_epi16(16384, -TAN_22_5, 16384, -TAN_22_5,
+                16384, -TAN_22_5, 16384, -TAN_22_5);
+            __m128i ax = _mm_max_epi16(gx, _mm_sub_epi16(zero, gx));
+            __m128i ay = _mm_max_epi16(gy, _mm_sub_epi16(zero, gy));
+
+            // |a| * 2^14 - |b| * TAN_22_5 for each lane, from interleaved (|a|, |b|) pairs
+            __m128i xyLo = _mm_madd_epi16(_mm_unpacklo_epi16(ax, ay), weights);
+            __m128i xyHi = _mm_madd_epi16(_mm_unpackhi_epi16(ax, ay), weights);
+            __m128i yxLo = _mm_madd_epi16(_mm_unpacklo_epi16(ay, ax), weights);
+            __m128i yxHi = _mm_madd_epi16(_mm_unpackhi_epi16(ay, ax), weights);
+            const __m128i one = _mm_set1_epi32(1);
+            __m128i horizontal = _mm_packs_epi32(_mm_cmplt_epi32(xyLo, one), _mm_cmplt_epi32(xyHi, one));
+            __m128i vertical = _mm_packs_epi32(_mm_cmplt_epi32(yxLo, zero), _mm_cmplt_epi32(yxHi, zero));
+            __m128i sameSign = _mm_cmpgt_epi16(_mm_xor_si128(gx, gy), _mm_set1_epi16(-1));
+
+            __m128i diagonal = _mm_or_si128(_mm_and_si128(sameSign, _mm_set1_epi16(135)),
+                _mm_andnot_si128(sameSign, _mm_set1_epi16(45)));
+            __m128i dir = _mm_or_si128(_mm_and_si128(vertical, _mm_set1_epi16(90)),
+                _mm_andnot_si128(vertical, diagonal));
+            return _mm_andnot_si128(horizontal, dir);
+        }
+
+        /**
+        * Magnitude and direction bucket of four Sobel responses
+        * @param xy interleaved 16-bit (Gx, Gy) pairs
+        * @param gxx Gx in the high half of each 32-bit lane
+        * @param gyy Gy in the high half of each 32-bit lane
+        */
+        static inline void sobelQuad(__m128i xy, __m128i gxx, __m128i gyy,
+            const __m128* cosT, const __m128* sinT, __m128i& mag, __m128i& dir)
+        {
+            const __m128 fzero = _mm_setzero_ps();
+            mag = sobelMagnitude(xy);
+
+            // sin(angle - boundary) >= 0 once the gradient has passed a bucket boundary
+            __m128 fx = _mm_cvtepi32_ps(_mm_srai_epi32(gxx, 16));
+            __m128 fy = _mm_cvtepi32_ps(_mm_srai_epi32(gyy, 16));
+            __m128 below1 = _mm_cmplt_ps(_mm_sub_ps(_mm_mul_ps(fx, cosT[0]), _mm_mul_ps(fy, sinT[0])), fzero);
+            __m128 below3 = _mm_cmplt_ps(_mm_sub_ps(_mm_mul_ps(fx, cosT[1]), _mm_mul_ps(fy, sinT[1])), fzero);
+            __m128 below5 = _mm_cmplt_ps(_mm_sub_ps(_mm_mul_ps(fx, cosT[2]), _mm_mul_ps(fy, sinT[2])), fzero);
+            __m128i in45 = _mm_castps_si128(_mm_andnot_ps(below1, below3));
+            __m128i in90 = _mm_castps_si128(_mm_andnot_ps(below3, below5));
+            __m128i in135 = _mm_castps_si128(_mm_andnot_ps(below5, _mm_cmplt_ps(fx, fzero)));
+            dir = _mm_or_si128(_mm_or_si128(
+                _mm_and_si128(in45, _mm_set1_epi32(45)),
+                _mm_and_si128(in90, _mm_set1_epi32(90))),
+                _mm_and_si128(in135, _mm_set1_epi32(135)));
+        }
+#endif
+};
+
+int
+NativeEdgeDetector::setup(cl_uint imageWidth, cl_uint imageHeight, unsigned int threadCount,
+	bool simd)
+{
+	width = imageWidth;
+	height = imageHeight;
+	capacityRows = imageHeight;
+	useSimd = simd;
+	size_t planeSize = (size_t)width * height;
+
+	lumPlane = (cl_uchar*)malloc(planeSize);
+	CHECK_ALLOCATION(lumPlane, "Failed to allocate memory! (lumPlane)");
+	lumSource = lumPlane;
+	gausPlane = (cl_uchar*)malloc(planeSize);
+	CHECK_ALLOCATION(gausPlane, "Failed to allocate memory! (gausPlane)");
+	magPlane = (cl_uchar*)malloc(planeSize);
+	CHECK_ALLOCATION(magPlane, "Failed to allocate memory! (magPlane)");
+	thetaPlane = (cl_uchar*)malloc(planeSize);
+	CHECK_ALLOCATION(thetaPlane, "Failed to allocate memory! (thetaPlane)");
+	maxPlane = (cl_uchar*)malloc(planeSize);
+	CHECK_ALLOCATION(maxPlane, "Failed to allocate memory! (maxPlane)");
+
+	setThresholds(HYST_LOW_THRESHOLD, HYST_HIGH_THRESHOLD);
+
+	// sobel_filter buckets atan2(Gx, Gy) in [0, 2PI) at 1, 3 and 5 radians (+0.0008/PI)
+	for (int k = 0; k < 3; k++)
+	{
+		double boundary = 2 * k + 1 + 0.0008 / 3.14159265;
+		thetaCos[k] = (float)cos(boundary);
+		thetaSin[k] = (float)sin(boundary);
+	}
+
+	pool = new NativeThreadPool(threadCount);
+	CHECK_ALLOCATION(pool, "Failed to allocate memory! (pool)");
+
+	return SDK_SUCCESS;
+}
+
+void
+NativeEdgeDetector::setInputFormat(NativeInputFormat format, const cl_uchar4* palette)
+{
+	inputFormat = format;
+	switch (format)
+	{
+	case NATIVE_INPUT_BGR:
+	case NATIVE_INPUT_RGB:
+		pixelBytes = 3;
+		break;
+	case NATIVE_INPUT_INDEX8:
+	case NATIVE_INPUT_LUMA:
+		pixelBytes = 1;
+		break;
+	default:
+		pixelBytes = 4;
+		break;
+	}
+	redByte = (format == NATIVE_INPUT_BGRA || format == NATIVE_INPUT_BGR) ? 2 : 0;
+
+	// The greyscale of an indexed pixel is a lookup, computed as greyscale_filter does
+	for (int i = 0; format == NATIVE_INPUT_INDEX8 && palette != NULL && i < 256; i++)
+	{
+		lumTable[i] = luma(palette[i].s[0], palette[i].s[1], palette[i].s[2]);
+		redTable[i] = palette[i].s[0];
+	}
+}
+
+int
+NativeEdgeDetector::run(const void* input, cl_uchar4* output, cl_uint rows)
+{
+	if (rows > capacityRows)
+	{
+		std::cout << "NativeEdgeDetector: " << rows << " rows exceed the " << capacityRows
+			<< " rows set up" << std::endl;
+		return SDK_FAILURE;
+	}
+	height = rows != 0 ? rows : capacityRows;
+
+	const cl_uchar* pixels = (const cl_uchar*)input;
+	cl_uchar* edges = (cl_uchar*)output;
+
+	// Luminance input already is the greyscale plane
+	lumSource = inputFormat == NATIVE_INPUT_LUMA ? pixels : lumPlane;
+	if (inputFormat != NATIVE_INPUT_LUMA)
+	{
+		pool->parallelRows(height, [&](cl_uint y0, cl_uint y1) { GreyScale(pixels, y0, y1); });
+	}
+	pool->parallelRows(height, [&](cl_uint y0, cl_uint y1) { Gaussian(pixels, y0, y1); });
+	pool->parallelRows(height, [&](cl_uint y0, cl_uint y1) { Sobel(y0, y1); });
+	pool->parallelRows(height, [&](cl_uint y0, cl_uint y1) { Max(y0, y1); });
+	pool->parallelRows(height, [&](cl_uint y0, cl_uint y1) { Hysteresis(maxPlane, edges, y0, y1); });
+
+	return SDK_SUCCESS;
+}
+
+int
+NativeEdgeDetector::smooth(const void* input, cl_uint rows)
+{
+	if (rows > capacityRows)
+	{
+		std::cout << "NativeEdgeDetector: " << rows << " rows exceed the " << capacityRows
+			<< " rows set up" << std::endl;
+		return SDK_FAILURE;
+	}
+	height = rows != 0 ? rows : capacityRows;
+
+	const cl_uchar* pixels = (const cl_uchar*)input;
+	lumSource = inputFormat == NATIVE_INPUT_LUMA ? pixels : lumPlane;
+	if (inputFormat != NATIVE_INPUT_LUMA)
+	{
+		pool->parallelRows(height, [&](cl_uint y0, cl_uint y1) { GreyScale(pixels, y0, y1); });
+	}
+	pool->parallelRows(height, [&](cl_uint y0, cl_uint y1) { Gaussian(pixels, y0, y1); });
+
+	return SDK_SUCCESS;
+}
+
+void
+NativeEdgeDetector::runStages(const cl_uchar* pixels, cl_uchar* edges, cl_uint y0, cl_uint y1,
+	const cl_uint grow[5])
+{
+	lumSource = inputFormat == NATIVE_INPUT_LUMA ? pixels : lumPlane;
+
+	auto stage = [&](cl_uint rows, const std::function<void(cl_uint, cl_uint)>& fn)
+	{
+		cl_uint top = y0 > rows ? y0 - rows : 0;
+		cl_uint bottom = y1 + rows < height ? y1 + rows : height;
+		pool->parallelRows(bottom - top, [&](cl_uint a, cl_uint b) { fn(top + a, top + b); });
+	};
+
+	if (inputFormat != NATIVE_INPUT_LUMA)
+	{
+		stage(grow[0], [&](cl_uint a, cl_uint b) { GreyScale(pixels, a, b); });
+	}
+	stage(grow[1], [&](cl_uint a, cl_uint b) { Gaussian(pixels, a, b); });
+	stage(grow[2], [&](cl_uint a, cl_uint b) { Sobel(a, b); });
+	stage(grow[3], [&](cl_uint a, cl_uint b) { Max(a, b); });
+	stage(grow[4], [&](cl_uint a, cl_uint b) { Hysteresis(maxPlane, edges, a, b); });
+}
+
+int
+NativeEdgeDetector::update(const void* input, cl_uchar4* output, cl_uint y0, cl_uint y1)
+{
+	if (y1 > height || y0 > y1)
+	{
+		std::cout << "NativeEdgeDetector: rows " << y0 << " to " << y1 << " are outside the "
+			<< height << " rows of the last run" << std::endl;
+		return SDK_FAILURE;
+	}
+
+	// Every stage reads one row above and below its own, so the rows a stage
+	// has to redo grow by one on each side per stage
+	const cl_uint grow[5] = { 0, 1, 2, 3, 3 };
+	runStages((const cl_uchar*)input, (cl_uchar*)output, y0, y1, grow);
+
+	return SDK_SUCCESS;
+}
+
+int
+NativeEdgeDetector::runRows(const void* input, cl_uchar4* output, cl_uint y0, cl_uint y1)
+{
+	if (y1 > capacityRows || y0 > y1)
+	{
+		std::cout << "NativeEdgeDetector: rows " << y0 << " to " << y1 << " exceed the "
+			<< capacityRows << " rows set up" << std::endl;
+		return SDK_FAILURE;
+	}
+	height = capacityRows;
+
+	// The rows an output row depends on shrink by one on each side per stage
+	const cl_uint grow[5] = { 3, 2, 1, 0, 0 };
+	runStages((const cl_uchar*)input, (cl_uchar*)output, y0, y1, grow);
+
+	return SDK_SUCCESS;
+}
+
+int
+NativeEdgeDetector::threshold(const cl_uchar* maxInput, cl_uchar4* output)
+{
+	cl_uchar* edges = (cl_uchar*)output;
+	pool->parallelRows(height, [&](cl_uint y0, cl_uint y1) { Hysteresis(maxInput, edges, y0, y1); });
+
+	return SDK_SUCCESS;
+}
+
+void
+NativeEdgeDetector::setThresholds(cl_uint low, cl_uint high)
+{
+	// Hyst_filter: >= high is an edge, <= low is not, otherwise >= (low + high) / 2
+	hystThreshold = 256;
+	for (cl_uint m = 0; m < 256; m++)
+	{
+		if (m >= high || (m > low && 2 * m >= low + high))
+		{
+			hystThreshold = m;
+			break;
+		}
+	}
+}
+
+int
+NativeEdgeDetector::cleanup()
+{
+	delete pool;
+	pool = NULL;
+
+	FREE(lumPlane);
+	FREE(gausPlane);
+	FREE(magPlane);
+	FREE(thetaPlane);
+	FREE(maxPlane);
+
+	return SDK_SUCCESS;
+}
+
+void
+NativeEdgeDetector::GreyScale(const cl_uchar* input, cl_uint y0, cl_uint y1)
+{
+	const cl_uchar* in = input + (size_t)y0 * width * pixelBytes;
+	cl_uchar* out = lumPlane + (size_t)y0 * width;
+	size_t n = (size_t)(y1 - y0) * width;
+	size_t i = 0;
+
+	if (inputFormat == NATIVE_INPUT_INDEX8)
+	{
+		for (; i < n; i++)
+		{
+			out[i] = lumTable[in[i]];
+		}
+		return;
+	}
+
+	if (inputFormat == NATIVE_INPUT_LUMA)
+	{
+		memcpy(out, in, n);
+		return;
+	}
+
+	if (pixelBytes == 3)
+	{
+#if defined(NATIVE_SSSE3)
+		const __m128i lowPick = _mm_setr_epi8(0, -1, -1, -1, 3, -1, -1, -1, 6, -1, -1, -1, 9, -1, -1, -1);
+		const __m128i gPick = _mm_setr_epi8(1, -1, -1, -1, 4, -1, -1, -1, 7, -1, -1, -1, 10, -1, -1, -1);
+		const __m128i highPick = _mm_setr_epi8(2, -1, -1, -1, 5, -1, -1, -1, 8, -1, -1, -1, 11, -1, -1, -1);
+		const __m128i rPick = redByte ? highPick : lowPick;
+		const __m128i bPick = redByte ? lowPick : highPick;
+		const __m128 wr3 = _mm_set1_ps(0.30f);
+		const __m128 wg3 = _mm_set1_ps(0.59f);
+		const __m128 wb3 = _mm_set1_ps(0.11f);
+		// Each load covers 4 pixels and 4 spare bytes; stop before reading past the band
+		for (; useSimd && i + 18 <= n; i += 16)
+		{
+			__m128i lum[4];
+			for (int k = 0; k < 4; k++)
+			{
+				__m128i px = _mm_loadu_si128((const __m128i*)(in + 3 * (i + 4 * k)));
+				if (exactLuma)
+				{
+					lum[k] = exactLumaQuad(_mm_shuffle_epi8(px, rPick), _mm_shuffle_epi8(px, gPick),
+						_mm_shuffle_epi8(px, bPick));
+					continue;
+				}
+				__m128 r = _mm_cvtepi32_ps(_mm_shuffle_epi8(px, rPick));
+				__m128 g = _mm_cvtepi32_ps(_mm_shuffle_epi8(px, gPick));
+				__m128 b = _mm_cvtepi32_ps(_mm_shuffle_epi8(px, bPick));
+				__m128 l = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, wr3), _mm_mul_ps(g, wg3)), _mm_mul_ps(b, wb3));
+				lum[k] = _mm_cvttps_epi32(l);
+			}
+			__m128i packed = _mm_packus_epi16(_mm_packs_epi32(lum[0], lum[1]), _mm_packs_epi32(lum[2], lum[3]));
+			_mm_storeu_si128((__m128i*)(out + i), packed);
+		}
+#endif
+		for (; i < n; i++)
+		{
+			out[i] = luma(in[3 * i + redByte], in[3 * i + 1], in[3 * i + 2 - redByte]);
+		}
+		return;
+	}
+
+#if defined(NATIVE_AVX2)
+	const __m256i mask8 = _mm256_set1_epi32(0xff);
+	const __m128i rShift8 = _mm_cvtsi32_si128(8 * redByte);
+	const __m128i bShift8 = _mm_cvtsi32_si128(16 - 8 * redByte);
+	const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	const __m256 wr8 = _mm256_set1_ps(0.30f);
+	const __m256 wg8 = _mm256_set1_ps(0.59f);
+	const __m256 wb8 = _mm256_set1_ps(0.11f);
+	for (; useSimd && i + 32 <= n; i += 32)
+	{
+		__m256i lum[4];
+		for (int k = 0; k < 4; k++)
+		{
+			__m256i px = _mm256_loadu_si256((const __m256i*)(in + 4 * (i + 8 * k)));
+			__m256i ri = _mm256_and_si256(_mm256_srl_epi32(px, rShift8), mask8);
+			__m256i gi = _mm256_and_si256(_mm256_srli_epi32(px, 8), mask8);
+			__m256i bi = _mm256_and_si256(_mm256_srl_epi32(px, bShift8), mask8);
+			if (exactLuma)
+			{
+				// (30 R + 59 G + 11 B) / 100 as in exactLumaQuad
+				__m256i sum = _mm256_add_epi32(_mm256_add_epi32(
+					_mm256_madd_epi16(ri, _mm256_set1_epi32(30)), _mm256_madd_epi16(gi, _mm256_set1_epi32(59))),
+					_mm256_madd_epi16(bi, _mm256_set1_epi32(11)));
+				lum[k] = _mm256_srli_epi32(_mm256_madd_epi16(sum, _mm256_set1_epi32(5243)), 19);
+				continue;
+			}
+			__m256 r = _mm256_cvtepi32_ps(ri);
+			__m256 g = _mm256_cvtepi32_ps(gi);
+			__m256 b = _mm256_cvtepi32_ps(bi);
+			__m256 l = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(r, wr8), _mm256_mul_ps(g, wg8)),
+				_mm256_mul_ps(b, wb8));
+			lum[k] = _mm256_cvttps_epi32(l);
+		}
+		__m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(lum[0], lum[1]),
+			_mm256_packs_epi32(lum[2], lum[3]));
+		_mm256_storeu_si256((__m256i*)(out + i), _mm256_permutevar8x32_epi32(packed, order));
+	}
+#endif
+#if defined(NATIVE_SSE2)
+	const __m128i mask = _mm_set1_epi32(0xff);
+	const __m128i rShift = _mm_cvtsi32_si128(8 * redByte);
+	const __m128i bShift = _mm_cvtsi32_si128(16 - 8 * redByte);
+	const __m128 wr = _mm_set1_ps(0.30f);
+	const __m128 wg = _mm_set1_ps(0.59f);
+	const __m128 wb = _mm_set1_ps(0.11f);
+	for (; useSimd && i + 16 <= n; i += 16)
+	{
+		__m128i lum[4];
+		for (int k = 0; k < 4; k++)
+		{
+			__m128i px = _mm_loadu_si128((const __m128i*)(in + 4 * (i + 4 * k)));
+			__m128i ri = _mm_and_si128(_mm_srl_epi32(px, rShift), mask);
+			__m128i gi = _mm_and_si128(_mm_srli_epi32(px, 8), mask);
+			__m128i bi = _mm_and_si128(_mm_srl_epi32(px, bShift), mask);
+			if (exactLuma)
+			{
+				lum[k] = exactLumaQuad(ri, gi, bi);
+				continue;
+			}
+			__m128 r = _mm_cvtepi32_ps(ri);
+			__m128 g = _mm_cvtepi32_ps(gi);
+			__m128 b = _mm_cvtepi32_ps(bi);
+			__m128 l = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, wr), _mm_mul_ps(g, wg)), _mm_mul_ps(b, wb));
+			lum[k] = _mm_cvttps_epi32(l);
+		}
+		__m128i packed = _mm_packus_epi16(_mm_packs_epi32(lum[0], lum[1]), _mm_packs_epi32(lum[2], lum[3]));
+		_mm_storeu_si128((__m128i*)(out + i), packed);
+	}
+#endif
+	for (; i < n; i++)
+	{
+		out[i] = luma(in[4 * i + redByte], in[4 * i + 1], in[4 * i + 2 - redByte]);
+	}
+}
+
+void
+NativeEdgeDetector::Gaussian(const cl_uchar* input, cl_uint y0, cl_uint y1)
+{
+	for (cl_uint y = y0; y < y1; y++)
+	{
+		cl_uchar* out = gausPlane + (size_t)y * width;
+		size_t row = (size_t)y * width;
+
+		// gaussian_filter leaves the border of nextImageBuffer (the input, as R, G, B, A) untouched
+		if (y == 0 || y + 1 >= height || width < 3)
+		{
+			for (cl_uint x = 0; x < width; x++)
+			{
+				out[x] = borderMode != NATIVE_BORDER_LEGACY ? gaussianBorder(x, y) : inputRed(input, row + x);
+			}
+			continue;
+		}
+		out[0] = borderMode != NATIVE_BORDER_LEGACY ? gaussianBorder(0, y) : inputRed(input, row);
+		out[width - 1] = borderMode != NATIVE_BORDER_LEGACY ? gaussianBorder(width - 1, y) :
+			inputRed(input, row + width - 1);
+
+		const cl_uchar* a = lumSource + (size_t)(y - 1) * width;
+		const cl_uchar* b = a + width;
+		const cl_uchar* c = b + width;
+		cl_uint x = 1;
+
+		if (gaussianSide != 0.25f)
+		{
+			// gaussian_weighted, in its order of float operations
+			float side = gaussianSide;
+			float centre = 1 - 2 * side;
+			for (; x + 1 < width; x++)
+			{
+				float top = side * ((float)a[x - 1] + (float)a[x + 1]) + centre * (float)a[x];
+				float middle = side * ((float)b[x - 1] + (float)b[x + 1]) + centre * (float)b[x];
+				float bottom = side * ((float)c[x - 1] + (float)c[x + 1]) + centre * (float)c[x];
+				float sum = side * (top + bottom) + centre * middle;
+				out[x] = sum >= 255 ? 255 : (cl_uchar)sum;
+			}
+			continue;
+		}
+
+#if defined(NATIVE_AVX2)
+		for (; useSimd && x + 16 < width; x += 16)
+		{
+			__m256i sum = _mm256_setzero_si256();
+			const cl_uchar* rows[3] = { a, b, c };
+			for (int k = 0; k < 3; k++)
+			{
+				__m256i l = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(rows[k] + x - 1)));
+				__m256i m = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(rows[k] + x)));
+				__m256i r = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(rows[k] + x + 1)));
+				__m256i h = _mm256_add_epi16(_mm256_add_epi16(l, r), _mm256_slli_epi16(m, 1));
+				sum = _mm256_add_epi16(sum, k == 1 ? _mm256_slli_epi16(h, 1) : h);
+			}
+			__m256i packed = _mm256_packus_epi16(_mm256_srli_epi16(sum, 4), _mm256_setzero_si256());
+			packed = _mm256_permute4x64_epi64(packed, 0xD8);
+			_mm_storeu_si128((__m128i*)(out + x), _mm256_castsi256_si128(packed));
+		}
+#endif
+#if defined(NATIVE_SSE2)
+		const __m128i zero = _mm_setzero_si128();
+		for (; useSimd && x + 8 < width; x += 8)
+		{
+			__m128i sum = zero;
+			const cl_uchar* rows[3] = { a, b, c };
+			for (int k = 0; k < 3; k++)
+			{
+				__m128i l = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(rows[k] + x - 1)), zero);
+				__m128i m = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(rows[k] + x)), zero);
+				__m128i r = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(rows[k] + x + 1)), zero);
+				__m128i h = _mm_add_epi16(_mm_add_epi16(l, r), _mm_slli_epi16(m, 1));
+				sum = _mm_add_epi16(sum, k == 1 ? _mm_slli_epi16(h, 1) : h);
+			}
+			_mm_storel_epi64((__m128i*)(out + x), _mm_packus_epi16(_mm_srli_epi16(sum, 4), zero));
+		}
+#endif
+		// 1-2-1 weights over 16 are exact in float, so the integer sum matches
+		for (; x + 1 < width; x++)
+		{
+			int sum = a[x - 1] + 2 * a[x] + a[x + 1]
+				+ 2 * (b[x - 1] + 2 * b[x] + b[x + 1])
+				+ c[x - 1] + 2 * c[x] + c[x + 1];
+			out[x] = (cl_uchar)(sum >> 4);
+		}
+	}
+}
+
+void
+NativeEdgeDetector::Sobel(cl_uint y0, cl_uint y1)
+{
+	for (cl_uint y = y0; y < y1; y++)
+	{
+		cl_uchar* mag = magPlane + (size_t)y * width;
+		cl_uchar* theta = thetaPlane + (size_t)y * width;
+		const cl_uchar* lum = lumSource + (size_t)y * width;
+
+		// sobel_filter leaves the border of prevImageBuffer (greyscale output) untouched;
+		// the border of thetaBuffer is never written, treat it as direction 0
+		if (borderMode != NATIVE_BORDER_LEGACY && (y == 0 || y + 1 >= height || width < 3))
+		{
+			for (cl_uint x = 0; x < width; x++)
+			{
+				sobelBorder(x, y);
+			}
+			continue;
+		}
+		if (y == 0 || y + 1 >= height || width < 3)
+		{
+			if (zeroBorder)
+			{
+				memset(mag, 0, width);
+			}
+			else
+			{
+				memcpy(mag, lum, width);
+			}
+			memset(theta, 0, width);
+			continue;
+		}
+		if (borderMode != NATIVE_BORDER_LEGACY)
+		{
+			sobelBorder(0, y);
+			sobelBorder(width - 1, y);
+		}
+		else
+		{
+			mag[0] = zeroBorder ? 0 : lum[0];
+			mag[width - 1] = zeroBorder ? 0 : lum[width - 1];
+			theta[0] = 0;
+			theta[width - 1] = 0;
+		}
+
+		const cl_uchar* a = gausPlane + (size_t)(y - 1) * width;
+		const cl_uchar* b = a + width;
+		const cl_uchar* c = b + width;
+		cl_uint x = 1;
+
+#if defined(NATIVE_SSE2)
+		const __m128i zero = _mm_setzero_si128();
+		__m128 cosT[3], sinT[3];
+		for (int k = 0; k < 3; k++)
+		{
+			cosT[k] = _mm_set1_ps(thetaCos[k]);
+			sinT[k] = _mm_set1_ps(thetaSin[k]);
+		}
+		for (; useSimd && x + 8 < width; x += 8)
+		{
+			__m128i a0 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(a + x - 1)), zero);
+			__m128i a1 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(a + x)), zero);
+			__m128i a2 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(a + x + 1)), zero);
+			__m128i b0 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(b + x - 1)), zero);
+			__m128i b2 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(b + x + 1)), zero);
+			__m128i c0 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(c + x - 1)), zero);
+			__m128i c1 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(c + x)), zero);
+			__m128i c2 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(c + x + 1)), zero);
+
+			__m128i gx = _mm_sub_epi16(
+				_mm_add_epi16(_mm_add_epi16(a0, a2), _mm_slli_epi16(a1, 1)),
+				_mm_add_epi16(_mm_add_epi16(c0, c2), _mm_slli_epi16(c1, 1)));
+			__m128i gy = _mm_sub_epi16(
+				_mm_add_epi16(_mm_add_epi16(a0, c0), _mm_slli_epi16(b0, 1)),
+				_mm_add_epi16(_mm_add_epi16(a2, c2), _mm_slli_epi16(b2, 1)));
+
+			if (tangentDirection)
+			{
+				__m128i mag16 = l1Magnitude ? l1Magnitudes(gx, gy) :
+					_mm_packs_epi32(sobelMagnitude(_mm_unpacklo_epi16(gx, gy)),
+					sobelMagnitude(_mm_unpackhi_epi16(gx, gy)));
+				_mm_storel_epi64((__m128i*)(mag + x), _mm_packus_epi16(mag16, zero));
+				_mm_storel_epi64((__m128i*)(theta + x), _mm_packus_epi16(tangentDirections(gx, gy), zero));
+				continue;
+			}
+
+			__m128i magLo, magHi, dirLo, dirHi;
+			sobelQuad(_mm_unpacklo_epi16(gx, gy), _mm_unpacklo_epi16(gx, gx), _mm_unpacklo_epi16(gy, gy),
+				cosT, sinT, magLo, dirLo);
+			sobelQuad(_mm_unpackhi_epi16(gx, gy), _mm_unpackhi_epi16(gx, gx), _mm_unpackhi_epi16(gy, gy),
+				cosT, sinT, magHi, dirHi);
+			__m128i mag16 = l1Magnitude ? l1Magnitudes(gx, gy) : _mm_packs_epi32(magLo, magHi);
+			__m128i dir16 = _mm_packs_epi32(dirLo, dirHi);
+			_mm_storel_epi64((__m128i*)(mag + x), _mm_packus_epi16(mag16, zero));
+			_mm_storel_epi64((__m128i*)(theta + x), _mm_packus_epi16(dir16, zero));
+		}
+#endif
+		for (; x + 1 < width; x++)
+		{
+			int gx = a[x - 1] + 2 * a[x] + a[x + 1] - c[x - 1] - 2 * c[x] - c[x + 1];
+			int gy = a[x - 1] - a[x + 1] + 2 * b[x - 1] - 2 * b[x + 1] + c[x - 1] - c[x + 1];
+			sobelPixel(gx, gy, mag[x], theta[x]);
+		}
+	}
+}
+
+void
+NativeEdgeDetector::sobelPixel(int gx, int gy, cl_uchar& mag, cl_uchar& theta) const
+{
+	int m = l1Magnitude ? ((gx < 0 ? -gx : gx) + (gy < 0 ? -gy : gy)) >> 1 :
+		(int)(sqrtf((float)(gx * gx + gy * gy)) * 0.5f);
+	mag = (cl_uchar)(m > 255 ? 255 : m);
+
+	if (tangentDirection)
+	{
+		int ax = gx < 0 ? -gx : gx;
+		int ay = gy < 0 ? -gy : gy;
+		if (ax * 16384 <= ay * TAN_22_5)
+		{
+			theta = 0;
+		}
+		else if (ay * 16384 < ax * TAN_22_5)
+		{
+			theta = 90;
+		}
+		else
+		{
+			theta = (gx ^ gy) >= 0 ? 135 : 45;
+		}
+		return;
+	}
+
+	float fx = (float)gx;
+	float fy = (float)gy;
+	float cross0 = fx * thetaCos[0] - fy * thetaSin[0];
+	float cross1 = fx * thetaCos[1] - fy * thetaSin[1];
+	float cross2 = fx * thetaCos[2] - fy * thetaSin[2];
+	cl_uchar dir = 0;
+	if (cross0 >= 0 && cross1 < 0)
+	{
+		dir = 45;
+	}
+	else if (cross1 >= 0 && cross2 < 0)
+	{
+		dir = 90;
+	}
+	else if (cross2 >= 0 && fx < 0)
+	{
+		dir = 135;
+	}
+	theta = dir;
+}
+
+cl_uchar
+NativeEdgeDetector::gaussianBorder(cl_uint x, cl_uint y) const
+{
+	if (borderMode == NATIVE_BORDER_SKIP)
+	{
+		return 0;
+	}
+	int sum = 0;
+	for (int dy = -1; dy <= 1; dy++)
+	{
+		for (int dx = -1; dx <= 1; dx++)
+		{
+			sum += borderPixel(lumSource, (int)x + dx, (int)y + dy) << ((dx == 0) + (dy == 0));
+		}
+	}
+	return (cl_uchar)(sum >> 4);
+}
+
+void
+NativeEdgeDetector::sobelBorder(cl_uint x, cl_uint y)
+{
+	size_t c = (size_t)y * width + x;
+	if (borderMode == NATIVE_BORDER_SKIP)
+	{
+		magPlane[c] = 0;
+		thetaPlane[c] = 0;
+		return;
+	}
+	int i00 = borderPixel(gausPlane, (int)x - 1, (int)y - 1);
+	int i10 = borderPixel(gausPlane, (int)x, (int)y - 1);
+	int i20 = borderPixel(gausPlane, (int)x + 1, (int)y - 1);
+	int i01 = borderPixel(gausPlane, (int)x - 1, (int)y);
+	int i21 = borderPixel(gausPlane, (int)x + 1, (int)y);
+	int i02 = borderPixel(gausPlane, (int)x - 1, (int)y + 1);
+	int i12 = borderPixel(gausPlane, (int)x, (int)y + 1);
+	int i22 = borderPixel(gausPlane, (int)x + 1, (int)y + 1);
+	sobelPixel(i00 + 2 * i10 + i20 - i02 - 2 * i12 - i22,
+		i00 - i20 + 2 * i01 - 2 * i21 + i02 - i22, magPlane[c], thetaPlane[c]);
+}
+
+cl_uchar
+NativeEdgeDetector::maxBorder(cl_uint x, cl_uint y) const
+{
+	if (borderMode == NATIVE_BORDER_SKIP)
+	{
+		return 0;
+	}
+	// Neighbour pair of each direction, as in Max_filter
+	int dx = -1, dy = 0;
+	switch (thetaPlane[(size_t)y * width + x])
+	{
+	case 45:
+		dx = 1;
+		dy = -1;
+		break;
+	case 90:
+		dx = 0;
+		dy = -1;
+		break;
+	case 135:
+		dx = -1;
+		dy = -1;
+		break;
+	}
+	cl_uchar m = magPlane[(size_t)y * width + x];
+	cl_uchar v1 = borderPixel(magPlane, (int)x + dx, (int)y + dy);
+	cl_uchar v2 = borderPixel(magPlane, (int)x - dx, (int)y - dy);
+	return (m <= v1 || m <= v2) ? 0 : m;
+}
+
+cl_uchar
+NativeEdgeDetector::maxPixel(cl_uint c)
+{
+	// Max_filter reads linear neighbours; reads outside the buffer count as 0
+	long long size = (long long)width * height;
+	long long w = width;
+	long long n1 = -1, n2 = -1;
+	switch (thetaPlane[c])
+	{
+	case 0:
+		n1 = (long long)c - 1;
+		n2 = (long long)c + 1;
+		break;
+	case 45:
+		n1 = (long long)c + 1 - w;
+		n2 = (long long)c - 1 + w;
+		break;
+	case 90:
+		n1 = (long long)c - w;
+		n2 = (long long)c + w;
+		break;
+	case 135:
+		n1 = (long long)c - 1 - w;
+		n2 = (long long)c + 1 + w;
+		break;
+	default:
+		return gausPlane[c];
+	}
+	cl_uchar m = magPlane[c];
+	cl_uchar v1 = (n1 >= 0 && n1 < size) ? magPlane[n1] : 0;
+	cl_uchar v2 = (n2 >= 0 && n2 < size) ? magPlane[n2] : 0;
+	return (m <= v1 || m <= v2) ? 0 : m;
+}
+
+void
+NativeEdgeDetector::Max(cl_uint y0, cl_uint y1)
+{
+	for (cl_uint y = y0; y < y1; y++)
+	{
+		cl_uint row = y * width;
+		cl_uchar* out = maxPlane + row;
+
+		if (y == 0 || y + 1 >= height || width < 3)
+		{
+			for (cl_uint x = 0; x < width; x++)
+			{
+				out[x] = borderMode != NATIVE_BORDER_LEGACY ? maxBorder(x, y) : zeroBorder ? 0 : maxPixel(row + x);
+			}
+			continue;
+		}
+		if (borderMode != NATIVE_BORDER_LEGACY)
+		{
+			out[0] = maxBorder(0, y);
+			out[width - 1] = maxBorder(width - 1, y);
+		}
+		else
+		{
+			out[0] = zeroBorder ? 0 : maxPixel(row);
+			out[width - 1] = zeroBorder ? 0 : maxPixel(row + width - 1);
+		}
+
+		const cl_uchar* m = magPlane + row;
+		const cl_uchar* t = thetaPlane + row;
+		const cl_uchar* up = m - width;
+		const cl_uchar* down = m + width;
+		cl_uint x = 1;
+
+#if defined(NATIVE_SSE2)
+		const __m128i d45 = _mm_set1_epi8(45);
+		const __m128i d90 = _mm_set1_epi8(90);
+		const __m128i d135 = _mm_set1_epi8((char)135);
+		for (; useSimd && x + 16 < width; x += 16)
+		{
+			__m128i mc = _mm_loadu_si128((const __m128i*)(m + x));
+			__m128i th = _mm_loadu_si128((const __m128i*)(t + x));
+			__m128i e0 = _mm_cmpeq_epi8(th, _mm_setzero_si128());
+			__m128i e45 = _mm_cmpeq_epi8(th, d45);
+			__m128i e90 = _mm_cmpeq_epi8(th, d90);
+			__m128i e135 = _mm_cmpeq_epi8(th, d135);
+
+			__m128i n1 = _mm_or_si128(
+				_mm_or_si128(_mm_and_si128(e0, _mm_loadu_si128((const __m128i*)(m + x - 1))),
+					_mm_and_si128(e45, _mm_loadu_si128((const __m128i*)(up + x + 1)))),
+				_mm_or_si128(_mm_and_si128(e90, _mm_loadu_si128((const __m128i*)(up + x))),
+					_mm_and_si128(e135, _mm_loadu_si128((const __m128i*)(up + x - 1)))));
+			__m128i n2 = _mm_or_si128(
+				_mm_or_si128(_mm_and_si128(e0, _mm_loadu_si128((const __m128i*)(m + x + 1))),
+					_mm_and_si128(e45, _mm_loadu_si128((const __m128i*)(down + x - 1)))),
+				_mm_or_si128(_mm_and_si128(e90, _mm_loadu_si128((const __m128i*)(down + x))),
+					_mm_and_si128(e135, _mm_loadu_si128((const __m128i*)(down + x + 1)))));
+
+			// m <= n  <=>  min(m, n) == m
+			__m128i suppress = _mm_or_si128(
+				_mm_cmpeq_epi8(_mm_min_epu8(mc, n1), mc),
+				_mm_cmpeq_epi8(_mm_min_epu8(mc, n2), mc));
+			_mm_storeu_si128((__m128i*)(out + x), _mm_andnot_si128(suppress, mc));
+		}
+#endif
+		for (; x + 1 < width; x++)
+		{
+			out[x] = maxPixel(row + x);
+		}
+	}
+}
+
+void
+NativeEdgeDetector::Hysteresis(const cl_uchar* maxInput, cl_uchar* output, cl_uint y0, cl_uint y1)
+{
+	const cl_uchar* in = maxInput + (size_t)y0 * width;
+	cl_uint* out = (cl_uint*)output + (size_t)y0 * width;
+	size_t n = (size_t)(y1 - y0) * width;
+	size_t i = 0;
+
+#if defined(NATIVE_SSE2)
+	if (hystThreshold < 256)
+	{
+		const __m128i threshold = _mm_set1_epi8((char)hystThreshold);
+		for (; useSimd && i + 16 <= n; i += 16)
+		{
+			__m128i m = _mm_loadu_si128((const __m128i*)(in + i));
+			__m128i edge = _mm_cmpeq_epi8(_mm_max_epu8(m, threshold), m);
+			__m128i lo = _mm_unpacklo_epi8(edge, edge);
+			__m128i hi = _mm_unpackhi_epi8(edge, edge);
+			_mm_storeu_si128((__m128i*)(out + i), _mm_unpacklo_epi16(lo, lo));
+			_mm_storeu_si128((__m128i*)(out + i + 4), _mm_unpackhi_epi16(lo, lo));
+			_mm_storeu_si128((__m128i*)(out + i + 8), _mm_unpacklo_epi16(hi, hi));
+			_mm_storeu_si128((__m128i*)(out + i + 12), _mm_unpackhi_epi16(hi, hi));
+		}
+	}
+#endif
+	for (; i < n; i++)
+	{
+		out[i] = in[i] >= hystThreshold ? 0xffffffffu : 0u;
+	}
+}
+
+cl_uint
+NativeEdgeDetector::listEdges(cl_ushort4* points) const
+{
+	cl_uint count = 0;
+	auto add = [&](cl_uint x, cl_uint y)
+	{
+		cl_ushort4& point = points[count++];
+		point.s[0] = (cl_ushort)x;
+		point.s[1] = (cl_ushort)y;
+		point.s[2] = thetaPlane[(size_t)y * width + x];
+		point.s[3] = 0;
+	};
+
+	for (cl_uint y = 0; y < height; y++)
+	{
+		const cl_uchar* row = maxPlane + (size_t)y * width;
+		cl_uint x = 0;
+
+#if defined(NATIVE_SSE2)
+		// Most blocks of 16 pixels hold no edge at all
+		if (hystThreshold < 256)
+		{
+			const __m128i threshold = _mm_set1_epi8((char)hystThreshold);
+			for (; useSimd && x + 16 <= width; x += 16)
+			{
+				__m128i m = _mm_loadu_si128((const __m128i*)(row + x));
+				int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(m, threshold), m));
+				for (cl_uint lane = 0; mask != 0; lane++, mask >>= 1)
+				{
+					if (mask & 1)
+					{
+						add(x + lane, y);
+					}
+				}
+			}
+		}
+#endif
+		for (; x < width; x++)
+		{
+			if (row[x] >= hystThreshold)
+			{
+				add(x, y);
+			}
+		}
+	}
+	return count;
+}
+
+
+/**
+* NativeCompareResult
+* Outcome of comparing a stage against the native reference
+*/
+
+struct NativeCompareResult
+{
+    size_t mismatches;                  /**< Elements differing by more than the tolerance */
+    cl_uint maxAbsError;                /**< Largest absolute difference seen */
+    long long firstBad;                 /**< Index of the first mismatch, -1 if none */
+};
+
+/**
+* Compare a byte plane against a reference plane
+* @param reference reference plane, one byte per element
+* @param test plane under test, testStride bytes per element (first byte is compared)
+* @param count number of elements
+* @param testStride 1 for byte planes, 4 for the x channel of uchar4 buffers
+* @param tolerance largest absolute difference still accepted
+* @return mismatch count, max abs error and first mismatch
+*/
+static NativeCompareResult
+nativeCompare(const cl_uchar* reference, const cl_uchar* test, size_t count,
+	cl_uint testStride, cl_uchar tolerance)
+{
+	NativeCompareResult result = { 0, 0, -1 };
+	size_t i = 0;
+
+#if defined(NATIVE_SSE2)
+	if (testStride == 1 || testStride == 4)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i lowByte = _mm_set1_epi32(0xff);
+		const __m128i tol = _mm_set1_epi8((char)tolerance);
+		__m128i maxErr = zero;
+		for (; i + 16 <= count; i += 16)
+		{
+			__m128i r = _mm_loadu_si128((const __m128i*)(reference + i));
+			__m128i t;
+			if (testStride == 4)
+			{
+				const __m128i* p = (const __m128i*)(test + 4 * i);
+				__m128i t0 = _mm_and_si128(_mm_loadu_si128(p), lowByte);
+				__m128i t1 = _mm_and_si128(_mm_loadu_si128(p + 1), lowByte);
+				__m128i t2 = _mm_and_si128(_mm_loadu_si128(p + 2), lowByte);
+				__m128i t3 = _mm_and_si128(_mm_loadu_si128(p + 3), lowByte);
+				t = _mm_packus_epi16(_mm_packs_epi32(t0, t1), _mm_packs_epi32(t2, t3));
+			}
+			else
+			{
+				t = _mm_loadu_si128((const __m128i*)(test + i));
+			}
+			__m128i diff = _mm_or_si128(_mm_subs_epu8(r, t), _mm_subs_epu8(t, r));
+			maxErr = _mm_max_epu8(maxErr, diff);
+
+			unsigned int bad = ~_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(diff, tol), zero)) & 0xffff;
+			if (bad == 0)
+			{
+				continue;
+			}
+			for (cl_uint lane = 0; lane < 16; lane++)
+			{
+				if (bad & (1u << lane))
+				{
+					if (result.firstBad < 0)
+					{
+						result.firstBad = (long long)(i + lane);
+					}
+					result.mismatches++;
+				}
+			}
+		}
+		cl_uchar lanes[16];
+		_mm_storeu_si128((__m128i*)lanes, maxErr);
+		for (int lane = 0; lane < 16; lane++)
+		{
+			if (lanes[lane] > result.maxAbsError)
+			{
+				result.maxAbsError = lanes[lane];
+			}
+		}
+	}
+#endif
+	for (; i < count; i++)
+	{
+		int diff = abs((int)reference[i] - (int)test[i * testStride]);
+		if ((cl_uint)diff > result.maxAbsError)
+		{
+			result.maxAbsError = diff;
+		}
+		if (diff > tolerance)
+		{
+			if (result.firstBad < 0)
+			{
+				result.firstBad = (long long)i;
+			}
+			result.mismatches++;
+		}
+	}
+	return result;
+}
+
+/**
+* Every second pixel of every second row of a plane (one pyramid level down)
+* @param input source plane
+* @param inputWidth bytes per source row
+* @param output destination plane, outputWidth * outputHeight bytes
+* @param outputWidth columns to produce, at most inputWidth / 2
+* @param outputHeight rows to produce, at most source rows / 2
+*/
+static void
+nativeDecimate(const cl_uchar* input, cl_uint inputWidth, cl_uchar* output,
+	cl_uint outputWidth, cl_uint outputHeight)
+{
+	for (cl_uint y = 0; y < outputHeight; y++)
+	{
+		const cl_uchar* in = input + (size_t)2 * y * inputWidth;
+		cl_uchar* out = output + (size_t)y * outputWidth;
+		cl_uint x = 0;
+
+#if defined(NATIVE_SSE2)
+		// Even bytes are the low halves of the 16-bit lanes
+		const __m128i lowByte = _mm_set1_epi16(0xff);
+		for (; x + 16 <= outputWidth; x += 16)
+		{
+			__m128i a = _mm_and_si128(_mm_loadu_si128((const __m128i*)(in + 2 * x)), lowByte);
+			__m128i b = _mm_and_si128(_mm_loadu_si128((const __m128i*)(in + 2 * x + 16)), lowByte);
+			_mm_storeu_si128((__m128i*)(out + x), _mm_packus_epi16(a, b));
+		}
+#endif
+		for (; x < outputWidth; x++)
+		{
+			out[x] = in[2 * x];
+		}
+	}
+}
+
+#endif // Native_Edge_Detector_H_
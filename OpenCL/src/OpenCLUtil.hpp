@@ -693,7 +693,7 @@ class CLContext : public SDKCmdArgsParser
         bool multiDevice;              /**< Cmd Line Option- if MultiGPU */
         unsigned int deviceId;         /**< Cmd Line Option- device number */
         unsigned int platformId;       /**< Cmd Line Option- platform number */
-        std::string deviceType;        /**< Cmd Line Option- set device type(cpu|gpu) */
+        std::string deviceType;        /**< Cmd Line Option- set device type(cpu|gpu|native) */
         std::string dumpBinary;        /**< Cmd Line Option- Dump Binary with name */
         std::string loadBinary;        /**< Cmd Line Option- Load Binary with name */
         std::string flags;             /**< Cmd Line Option- compiler flags */
@@ -809,6 +809,16 @@ class CLContext : public SDKCmdArgsParser
             return amdPlatform;
         }
 
+        /**
+         * isNativeDevice
+         * Checks if the host (non OpenCL) backend is selected
+         * @return true if --device native else false
+         */
+        bool isNativeDevice()
+        {
+            return deviceType.compare("native") == 0;
+        }
+
 
         /**
         * parseCommandLine
@@ -862,10 +872,11 @@ class CLContext : public SDKCmdArgsParser
             }
             else
             {
-                if(!((deviceType.compare("cpu") == 0 ) || (deviceType.compare("gpu") ==0)))
+                if(!((deviceType.compare("cpu") == 0 ) || (deviceType.compare("gpu") ==0)
+                        || isNativeDevice()))
                 {
                     std::cout << "Error. Invalid device options. "
-                              << "only \"cpu\" or \"gpu\" or \"all\" supported\n";
+                              << "only \"cpu\" or \"gpu\" or \"native\" supported\n";
                     usage();
                     return SDK_FAILURE;
                 }
@@ -882,6 +893,17 @@ class CLContext : public SDKCmdArgsParser
                 usage();
                 return SDK_FAILURE;
             }
+            if(isNativeDevice())
+            {
+                if(dumpBinary.size() != 0 || loadBinary.size() != 0 || flags.size() != 0)
+                {
+                    std::cout << "Error. --dump, --load and --flags need an OpenCL device\n";
+                    usage();
+                    return SDK_FAILURE;
+                }
+                // No OpenCL platform is needed for the host backend
+                return SDK_SUCCESS;
+            }
             if(validatePlatformAndDeviceOptions() != SDK_SUCCESS)
             {
                 std::cout << "validatePlatfromAndDeviceOptions failed.\n ";
@@ -1077,7 +1099,7 @@ class CLContext : public SDKCmdArgsParser
             else
             {
                 optionList[0]._description = "Execute the openCL kernel on a device";
-                optionList[0]._usage = "[cpu|gpu]";
+                optionList[0]._usage = "[cpu|gpu|native]";
             }
             optionList[0]._type = CA_ARG_STRING;
             optionList[0]._value = &deviceType;
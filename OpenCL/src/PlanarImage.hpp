@@ -0,0 +1,403 @@
+#ifndef Planar_Image_H_
+#define Planar_Image_H_
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <string>
+#include "SDKUtil.hpp"
+#include "BitMapStream.hpp"
+
+using namespace appsdk;
+
+/**
+* File types readInputImage and writeOutputImage tell apart by extension
+*/
+enum ImageFileType
+{
+    IMAGE_FILE_BMP,                         /**< .bmp and anything unknown */
+    IMAGE_FILE_PGM,                         /**< Binary PGM (P5), .pgm */
+    IMAGE_FILE_PPM,                         /**< Binary PPM (P6), .ppm and .pnm */
+    IMAGE_FILE_PBM,                         /**< Binary PBM (P4), .pbm; written only */
+    IMAGE_FILE_RAW                          /**< Headerless 8 bit plane, .raw, .y and .gray */
+};
+
+/**
+* Type of an image file from its extension
+*/
+static ImageFileType
+imageFileType(const std::string& filename)
+{
+	size_t dot = filename.find_last_of('.');
+	if (dot == std::string::npos)
+	{
+		return IMAGE_FILE_BMP;
+	}
+
+	std::string ext = filename.substr(dot + 1);
+	for (size_t i = 0; i < ext.size(); i++)
+	{
+		ext[i] = (char)tolower((unsigned char)ext[i]);
+	}
+
+	if (ext == "pgm")
+	{
+		return IMAGE_FILE_PGM;
+	}
+	if (ext == "ppm" || ext == "pnm")
+	{
+		return IMAGE_FILE_PPM;
+	}
+	if (ext == "pbm")
+	{
+		return IMAGE_FILE_PBM;
+	}
+	if (ext == "raw" || ext == "y" || ext == "gray")
+	{
+		return IMAGE_FILE_RAW;
+	}
+	return IMAGE_FILE_BMP;
+}
+
+/**
+* PlanarImage
+* Binary PGM/PPM and headerless 8 bit planes. Pixels are kept packed, one
+* byte (luminance) or three bytes (R, G, B) each, with rows top to bottom.
+*/
+
+class PlanarImage
+{
+        unsigned char* data_;           /**< width * height * channels bytes */
+        int width_;                     /**< Image width */
+        int height_;                    /**< Image height */
+        int channels_;                  /**< 1 (luminance) or 3 (R, G, B) */
+
+        bool readHeaderValue(FILE* fd, int& value);
+
+    public:
+
+        PlanarImage()
+            : data_(NULL),
+              width_(0),
+              height_(0),
+              channels_(0)
+        {}
+
+        ~PlanarImage()
+        {
+            close();
+        }
+
+        /**
+        * Read a binary PGM (P5) or PPM (P6) with a maximum value up to 255
+        * @param filename path of the image
+        * @return true on success
+        */
+        bool loadPnm(const char* filename);
+
+        /**
+        * Read a headerless 8 bit plane
+        * @param filename path of the plane
+        * @param width pixels per row
+        * @param height rows
+        * @param stride bytes from one row to the next, 0 for width
+        * @return true on success
+        */
+        bool loadRaw(const char* filename, int width, int height, int stride);
+
+        /**
+        * Drop the columns right of width, so rows are width pixels apart
+        * @param width pixels to keep per row, at most getWidth()
+        */
+        void cropColumns(int width);
+
+        /**
+        * Release the pixels
+        */
+        void close();
+
+        int getWidth() const { return width_; }
+
+        int getHeight() const { return height_; }
+
+        int getChannels() const { return channels_; }
+
+        const unsigned char* getData() const { return data_; }
+};
+
+bool
+PlanarImage::readHeaderValue(FILE* fd, int& value)
+{
+	int c = fgetc(fd);
+
+	// Whitespace and comment lines may separate the header fields
+	while (c != EOF && (isspace(c) || c == '#'))
+	{
+		if (c == '#')
+		{
+			while (c != EOF && c != '\n')
+			{
+				c = fgetc(fd);
+			}
+		}
+		c = fgetc(fd);
+	}
+
+	if (c == EOF || !isdigit(c))
+	{
+		return false;
+	}
+
+	value = 0;
+	while (c != EOF && isdigit(c))
+	{
+		value = value * 10 + (c - '0');
+		if (value > (1 << 24))
+		{
+			return false;
+		}
+		c = fgetc(fd);
+	}
+
+	// Exactly one whitespace character ends the field
+	return c != EOF && isspace(c);
+}
+
+bool
+PlanarImage::loadPnm(const char* filename)
+{
+	close();
+
+	FILE* fd = fopen(filename, "rb");
+	if (fd == NULL)
+	{
+		return false;
+	}
+
+	char magic[2];
+	int maxValue = 0;
+	bool ok = fread(magic, 1, 2, fd) == 2 && magic[0] == 'P' && (magic[1] == '5' || magic[1] == '6') &&
+		readHeaderValue(fd, width_) && readHeaderValue(fd, height_) && readHeaderValue(fd, maxValue) &&
+		width_ > 0 && height_ > 0 && maxValue > 0 && maxValue < 256;
+
+	if (ok)
+	{
+		channels_ = magic[1] == '5' ? 1 : 3;
+		size_t size = (size_t)width_ * height_ * channels_;
+		data_ = (unsigned char*)malloc(size);
+		ok = data_ != NULL && fread(data_, 1, size, fd) == size;
+	}
+
+	fclose(fd);
+	if (!ok)
+	{
+		close();
+	}
+	return ok;
+}
+
+bool
+PlanarImage::loadRaw(const char* filename, int width, int height, int stride)
+{
+	close();
+
+	if (stride == 0)
+	{
+		stride = width;
+	}
+	if (width <= 0 || height <= 0 || stride < width)
+	{
+		std::cout << "Raw input needs --width and --height (and --stride >= width)" << std::endl;
+		return false;
+	}
+
+	FILE* fd = fopen(filename, "rb");
+	if (fd == NULL)
+	{
+		return false;
+	}
+
+	width_ = width;
+	height_ = height;
+	channels_ = 1;
+	data_ = (unsigned char*)malloc((size_t)width * height);
+	bool ok = data_ != NULL;
+
+	if (ok && stride == width)
+	{
+		ok = fread(data_, (size_t)width * height, 1, fd) == 1;
+	}
+	else
+	{
+		// Read each row in place and skip the padding; the last row may lack it
+		for (int y = 0; ok && y < height; y++)
+		{
+			ok = fread(data_ + (size_t)y * width, width, 1, fd) == 1 &&
+				(y + 1 == height || fseek(fd, stride - width, SEEK_CUR) == 0);
+		}
+	}
+
+	fclose(fd);
+	if (!ok)
+	{
+		close();
+	}
+	return ok;
+}
+
+void
+PlanarImage::cropColumns(int width)
+{
+	if (data_ == NULL || width <= 0 || width >= width_)
+	{
+		return;
+	}
+
+	// Rows only move towards the start, so they can be packed in place
+	size_t rowBytes = (size_t)width * channels_;
+	for (int y = 1; y < height_; y++)
+	{
+		memmove(data_ + y * rowBytes, data_ + (size_t)y * width_ * channels_, rowBytes);
+	}
+	width_ = width;
+}
+
+void
+PlanarImage::close()
+{
+	free(data_);
+	data_ = NULL;
+	width_ = 0;
+	height_ = 0;
+	channels_ = 0;
+}
+
+/**
+* Write uchar4 pixels as a binary PGM (x only), PPM (x, y, z as R, G, B), PBM
+* (set, black, where x is not 0) or raw plane (x only)
+* @param filename path of the image
+* @param type IMAGE_FILE_PGM, IMAGE_FILE_PPM, IMAGE_FILE_PBM or IMAGE_FILE_RAW
+* @param pixels height rows of rowPitch pixels
+* @param width image width
+* @param height image height
+* @param rowPitch pixels per source row; missing columns are written black
+* @param bottomUp pixels hold the bottom row first (BMP order); the file is written top to bottom
+* @return true on success
+*/
+static bool
+writePlanarImage(const char* filename, ImageFileType type, const uchar4* pixels, int width, int height,
+	int rowPitch, bool bottomUp)
+{
+	FILE* fd = fopen(filename, "wb");
+	if (fd == NULL)
+	{
+		return false;
+	}
+
+	bool ok = true;
+	if (type == IMAGE_FILE_PGM || type == IMAGE_FILE_PPM)
+	{
+		ok = fprintf(fd, "P%c\n%d %d\n255\n", type == IMAGE_FILE_PGM ? '5' : '6', width, height) > 0;
+	}
+	else if (type == IMAGE_FILE_PBM)
+	{
+		ok = fprintf(fd, "P4\n%d %d\n", width, height) > 0;
+	}
+
+	int channels = type == IMAGE_FILE_PPM ? 3 : 1;
+	size_t rowBytes = type == IMAGE_FILE_PBM ? ((size_t)width + 7) / 8 : (size_t)width * channels;
+	size_t chunkRows = BITMAP_WRITE_BYTES / rowBytes;
+	if (chunkRows == 0)
+	{
+		chunkRows = 1;
+	}
+	if (chunkRows > (size_t)height)
+	{
+		chunkRows = height;
+	}
+	unsigned char* buffer = new unsigned char[chunkRows * rowBytes];
+	int copy = rowPitch < width ? rowPitch : width;
+
+	for (size_t y0 = 0; ok && y0 < (size_t)height; y0 += chunkRows)
+	{
+		size_t n = (size_t)height - y0 < chunkRows ? (size_t)height - y0 : chunkRows;
+		for (size_t y = 0; y < n; y++)
+		{
+			size_t row = bottomUp ? height - 1 - (y0 + y) : y0 + y;
+			const uchar4* in = pixels + row * rowPitch;
+			unsigned char* out = buffer + y * rowBytes;
+			if (copy < width)
+			{
+				memset(out, 0, rowBytes);
+			}
+			if (type == IMAGE_FILE_PBM)
+			{
+				bitMapPackBits(in, out, copy);
+				continue;
+			}
+			if (channels == 1)
+			{
+				bitMapPackRow(in, out, copy, 8);
+				continue;
+			}
+			for (int x = 0; x < copy; x++, out += 3)
+			{
+				out[0] = in[x].x;
+				out[1] = in[x].y;
+				out[2] = in[x].z;
+			}
+		}
+		ok = fwrite(buffer, n * rowBytes, 1, fd) == 1;
+	}
+
+	delete[] buffer;
+	return (fclose(fd) == 0) && ok;
+}
+
+/**
+* Write a 1 bit image packed like bitMapPackBits as a binary PBM
+* @param filename path of the image
+* @param bits packed rows, rows * rowBytes bytes
+* @param width image width
+* @param height image height
+* @param rows rows in bits; the rows after them are written blank
+* @param rowBytes bytes from one packed row to the next; missing bytes are written blank
+* @param bottomUp bits hold the bottom row first (BMP order); the file is written top to bottom
+* @return true on success
+*/
+static bool
+writePackedPbm(const char* filename, const unsigned char* bits, int width, int height, int rows,
+	size_t rowBytes, bool bottomUp)
+{
+	FILE* fd = fopen(filename, "wb");
+	if (fd == NULL)
+	{
+		return false;
+	}
+
+	bool ok = fprintf(fd, "P4\n%d %d\n", width, height) > 0;
+	size_t fileRowBytes = ((size_t)width + 7) / 8;
+	if (ok && !bottomUp && rowBytes == fileRowBytes && rows == height)
+	{
+		ok = fwrite(bits, fileRowBytes * height, 1, fd) == 1;
+		return (fclose(fd) == 0) && ok;
+	}
+
+	size_t copyBytes = rowBytes < fileRowBytes ? rowBytes : fileRowBytes;
+	unsigned char* buffer = new unsigned char[fileRowBytes];
+	for (int y = 0; ok && y < height; y++)
+	{
+		int row = bottomUp ? height - 1 - y : y;
+		memset(buffer, 0, fileRowBytes);
+		if (row < rows)
+		{
+			memcpy(buffer, bits + (size_t)row * rowBytes, copyBytes);
+		}
+		ok = fwrite(buffer, fileRowBytes, 1, fd) == 1;
+	}
+
+	delete[] buffer;
+	return (fclose(fd) == 0) && ok;
+}
+
+#endif // Planar_Image_H_
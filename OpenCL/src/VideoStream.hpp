@@ -0,0 +1,424 @@
+#ifndef Video_Stream_H_
+#define Video_Stream_H_
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#if defined(_WIN32)
+#include <io.h>
+#include <fcntl.h>
+#endif
+#include "SDKUtil.hpp"
+#include "BitMapStream.hpp"
+
+using namespace appsdk;
+
+#define Y4M_MAGIC "YUV4MPEG2"
+#define Y4M_FRAME "FRAME"
+#define Y4M_MAX_HEADER 1024
+
+/**
+* Frame layouts of --video
+*/
+enum VideoFormat
+{
+    VIDEO_Y4M,                              /**< YUV4MPEG2 stream, geometry from its header */
+    VIDEO_I420,                             /**< Raw planar 4:2:0 frames, --width and --height */
+    VIDEO_NV12                              /**< Raw 4:2:0 frames with interleaved chroma */
+};
+
+/**
+* Parse the --video argument
+* @return false for an unknown format
+*/
+static bool
+parseVideoFormat(const std::string& name, VideoFormat& format)
+{
+	if (name == "y4m")
+	{
+		format = VIDEO_Y4M;
+	}
+	else if (name == "i420")
+	{
+		format = VIDEO_I420;
+	}
+	else if (name == "nv12")
+	{
+		format = VIDEO_NV12;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+/**
+* Switch a standard stream to binary mode (no newline translation on Windows)
+*/
+static void
+videoBinaryMode(FILE* fd)
+{
+#if defined(_WIN32)
+	_setmode(_fileno(fd), _O_BINARY);
+#else
+	(void)fd;
+#endif
+}
+
+/**
+* VideoFrameReader
+* Reads the luminance plane of each frame of a Y4M or raw 4:2:0 stream and
+* skips the chroma planes
+*/
+
+class VideoFrameReader
+{
+        FILE* fd_;                      /**< Input stream */
+        VideoFormat format_;            /**< Frame layout */
+        int width_;                     /**< Frame width */
+        int height_;                    /**< Frame height */
+        size_t chromaBytes_;            /**< Bytes after the luminance plane of each frame */
+        unsigned char* chroma_;         /**< Scratch for the skipped chroma (pipes cannot seek) */
+        unsigned char* row_;            /**< Scratch for the cropped end of a luminance row */
+        std::string header_;            /**< Y4M stream header line, without the newline */
+
+        bool readLine(std::string& line);
+
+    public:
+
+        VideoFrameReader()
+            : fd_(NULL),
+              format_(VIDEO_Y4M),
+              width_(0),
+              height_(0),
+              chromaBytes_(0),
+              chroma_(NULL),
+              row_(NULL)
+        {}
+
+        ~VideoFrameReader()
+        {
+            close();
+        }
+
+        /**
+        * Start reading a stream; reads the Y4M header
+        * @param fd input stream
+        * @param format frame layout
+        * @param width frame width of raw streams
+        * @param height frame height of raw streams
+        * @return true on success
+        */
+        bool open(FILE* fd, VideoFormat format, int width, int height);
+
+        /**
+        * Read the next frame
+        * @param luma destination, lumaWidth * height bytes
+        * @param lumaWidth bytes per destination row; wider rows are cropped
+        * @param endOfStream set if the stream ended before the frame
+        * @return true if a frame was read or the stream ended cleanly
+        */
+        bool readFrame(unsigned char* luma, int lumaWidth, bool& endOfStream);
+
+        /**
+        * Release the chroma scratch
+        */
+        void close();
+
+        int getWidth() const { return width_; }
+
+        int getHeight() const { return height_; }
+
+        size_t getChromaBytes() const { return chromaBytes_; }
+
+        const std::string& getHeader() const { return header_; }
+};
+
+bool
+VideoFrameReader::readLine(std::string& line)
+{
+	line.clear();
+	int c;
+	while ((c = fgetc(fd_)) != EOF && c != '\n')
+	{
+		if (line.size() >= Y4M_MAX_HEADER)
+		{
+			return false;
+		}
+		line.push_back((char)c);
+	}
+	return c == '\n';
+}
+
+bool
+VideoFrameReader::open(FILE* fd, VideoFormat format, int width, int height)
+{
+	close();
+
+	fd_ = fd;
+	format_ = format;
+	width_ = width;
+	height_ = height;
+	std::string colorSpace = "420";
+
+	if (format == VIDEO_Y4M)
+	{
+		if (!readLine(header_) || header_.compare(0, strlen(Y4M_MAGIC), Y4M_MAGIC) != 0)
+		{
+			std::cout << "Input is not a YUV4MPEG2 stream" << std::endl;
+			return false;
+		}
+
+		// Parameters are single letters followed by their value, separated by spaces
+		size_t pos = strlen(Y4M_MAGIC);
+		while (pos < header_.size())
+		{
+			size_t end = header_.find(' ', pos + 1);
+			std::string token = header_.substr(pos + 1, end == std::string::npos ? std::string::npos : end - pos - 1);
+			if (!token.empty() && token[0] == 'W')
+			{
+				width_ = atoi(token.c_str() + 1);
+			}
+			else if (!token.empty() && token[0] == 'H')
+			{
+				height_ = atoi(token.c_str() + 1);
+			}
+			else if (!token.empty() && token[0] == 'C')
+			{
+				colorSpace = token.substr(1);
+			}
+			pos = end == std::string::npos ? header_.size() : end;
+		}
+	}
+
+	if (width_ <= 0 || height_ <= 0)
+	{
+		std::cout << "Video frames need a width and a height" << std::endl;
+		return false;
+	}
+
+	size_t chromaWidth = (width_ + 1) / 2;
+	size_t chromaHeight = (height_ + 1) / 2;
+	if (colorSpace.compare(0, 3, "420") == 0)
+	{
+		chromaBytes_ = 2 * chromaWidth * chromaHeight;
+	}
+	else if (colorSpace == "422")
+	{
+		chromaBytes_ = 2 * chromaWidth * height_;
+	}
+	else if (colorSpace == "444")
+	{
+		chromaBytes_ = 2 * (size_t)width_ * height_;
+	}
+	else if (colorSpace == "mono")
+	{
+		chromaBytes_ = 0;
+	}
+	else
+	{
+		std::cout << "Unsupported Y4M colour space C" << colorSpace << std::endl;
+		return false;
+	}
+
+	if (chromaBytes_ != 0)
+	{
+		chroma_ = new unsigned char[chromaBytes_];
+	}
+	row_ = new unsigned char[width_];
+
+	return true;
+}
+
+bool
+VideoFrameReader::readFrame(unsigned char* luma, int lumaWidth, bool& endOfStream)
+{
+	endOfStream = false;
+
+	if (format_ == VIDEO_Y4M)
+	{
+		std::string frameHeader;
+		if (!readLine(frameHeader))
+		{
+			endOfStream = frameHeader.empty() && feof(fd_);
+			return endOfStream;
+		}
+		if (frameHeader.compare(0, strlen(Y4M_FRAME), Y4M_FRAME) != 0)
+		{
+			std::cout << "Bad Y4M frame header" << std::endl;
+			return false;
+		}
+	}
+	else
+	{
+		// Raw streams end between frames
+		int c = fgetc(fd_);
+		if (c == EOF)
+		{
+			endOfStream = true;
+			return true;
+		}
+		ungetc(c, fd_);
+	}
+
+	if (lumaWidth >= width_)
+	{
+		for (int y = 0; y < height_; y++)
+		{
+			if (fread(luma + (size_t)y * lumaWidth, width_, 1, fd_) != 1)
+			{
+				return false;
+			}
+		}
+	}
+	else
+	{
+		for (int y = 0; y < height_; y++)
+		{
+			if (fread(luma + (size_t)y * lumaWidth, lumaWidth, 1, fd_) != 1 ||
+				fread(row_, width_ - lumaWidth, 1, fd_) != 1)
+			{
+				return false;
+			}
+		}
+	}
+
+	return chromaBytes_ == 0 || fread(chroma_, chromaBytes_, 1, fd_) == 1;
+}
+
+void
+VideoFrameReader::close()
+{
+	delete[] chroma_;
+	chroma_ = NULL;
+	delete[] row_;
+	row_ = NULL;
+	chromaBytes_ = 0;
+}
+
+/**
+* VideoFrameWriter
+* Writes edge maps as the luminance of a stream laid out like the input,
+* with neutral (128) chroma
+*/
+
+class VideoFrameWriter
+{
+        FILE* fd_;                      /**< Output stream */
+        VideoFormat format_;            /**< Frame layout */
+        int width_;                     /**< Frame width */
+        int height_;                    /**< Frame height */
+        size_t chromaBytes_;            /**< Neutral chroma bytes after each luminance plane */
+        unsigned char* frame_;          /**< Packed luminance and chroma of one frame */
+
+    public:
+
+        VideoFrameWriter()
+            : fd_(NULL),
+              format_(VIDEO_Y4M),
+              width_(0),
+              height_(0),
+              chromaBytes_(0),
+              frame_(NULL)
+        {}
+
+        ~VideoFrameWriter()
+        {
+            close();
+        }
+
+        /**
+        * Start writing a stream; writes the Y4M header
+        * @param fd output stream
+        * @param format frame layout
+        * @param width frame width
+        * @param height frame height
+        * @param chromaBytes bytes of chroma after each luminance plane
+        * @param header Y4M stream header line to repeat
+        * @return true on success
+        */
+        bool open(FILE* fd, VideoFormat format, int width, int height, size_t chromaBytes,
+            const std::string& header);
+
+        /**
+        * Write one frame
+        * @param pixels edge map, pixelsWidth * height pixels (x is used)
+        * @param pixelsWidth pixels per source row; missing columns are written black
+        * @return true on success
+        */
+        bool writeFrame(const uchar4* pixels, int pixelsWidth);
+
+        /**
+        * Flush the stream and release the frame buffer
+        * @return true if everything was written
+        */
+        bool close();
+};
+
+bool
+VideoFrameWriter::open(FILE* fd, VideoFormat format, int width, int height, size_t chromaBytes,
+	const std::string& header)
+{
+	close();
+
+	fd_ = fd;
+	format_ = format;
+	width_ = width;
+	height_ = height;
+	chromaBytes_ = chromaBytes;
+
+	// Chroma never changes; only the luminance part is rewritten per frame
+	size_t lumaBytes = (size_t)width * height;
+	frame_ = new unsigned char[lumaBytes + chromaBytes];
+	memset(frame_ + lumaBytes, 128, chromaBytes);
+
+	if (format == VIDEO_Y4M && fprintf(fd_, "%s\n", header.c_str()) < 0)
+	{
+		return false;
+	}
+	return true;
+}
+
+bool
+VideoFrameWriter::writeFrame(const uchar4* pixels, int pixelsWidth)
+{
+	if (frame_ == NULL)
+	{
+		return false;
+	}
+
+	if (format_ == VIDEO_Y4M && fputs(Y4M_FRAME "\n", fd_) < 0)
+	{
+		return false;
+	}
+
+	size_t lumaBytes = (size_t)width_ * height_;
+	if (pixelsWidth == width_)
+	{
+		bitMapPackRow(pixels, frame_, (int)lumaBytes, 8);
+	}
+	else
+	{
+		int copy = pixelsWidth < width_ ? pixelsWidth : width_;
+		for (int y = 0; y < height_; y++)
+		{
+			unsigned char* row = frame_ + (size_t)y * width_;
+			bitMapPackRow(pixels + (size_t)y * pixelsWidth, row, copy, 8);
+			memset(row + copy, 0, width_ - copy);
+		}
+	}
+	return fwrite(frame_, lumaBytes + chromaBytes_, 1, fd_) == 1;
+}
+
+bool
+VideoFrameWriter::close()
+{
+	bool ok = fd_ == NULL || fflush(fd_) == 0;
+	fd_ = NULL;
+	delete[] frame_;
+	frame_ = NULL;
+	return ok;
+}
+
+#endif // Video_Stream_H_
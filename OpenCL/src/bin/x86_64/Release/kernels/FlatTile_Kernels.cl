@@ -0,0 +1,108 @@
+/* --flat-threshold: tiles of TILE_LIST x TILE_LIST pixels with no edges are skipped.
+   An output pixel is an edge only if its own sobel magnitude reaches the hysteresis
+   threshold, and that magnitude depends on the greyscale up to two pixels away. When
+   those pixels span a range r, no gradient exceeds 4 r, so the magnitude stays below
+   2.83 r: a tile whose range, with a two pixel halo, is at most 15 has no edges.
+
+   tile_range finds the range of every tile, tile_lists turns the ranges into the list
+   of tiles the stages run over and the list written as zero, and tile_zero clears the
+   flat tiles after Hyst_filter. Tiles are identified by column | row << 16. */
+
+/* Luminance range of each tile and its halo; one work-group per tile, scratch holds two
+   bytes per work-item, which is a power of two */
+__kernel void tile_range(__global uchar4* greyImage, uint width, uint height, uint tileColumns,
+	__global uchar* ranges, __local uchar* scratch)
+{
+	uint tile = get_group_id(0);
+	uint l = get_local_id(0);
+	uint size = get_local_size(0);
+	__local uchar* low = scratch;
+	__local uchar* high = scratch + size;
+
+	int x0 = (int)(tile % tileColumns) * TILE_LIST - 2;
+	int y0 = (int)(tile / tileColumns) * TILE_LIST - 2;
+	uint span = TILE_LIST + 4;
+
+	/* The halo past the image border repeats the border pixels */
+	uchar lo = 255;
+	uchar hi = 0;
+	for (uint i = l; i < span * span; i += size)
+	{
+		int x = clamp(x0 + (int)(i % span), 0, (int)width - 1);
+		int y = clamp(y0 + (int)(i / span), 0, (int)height - 1);
+		uchar v = greyImage[x + y * width].x;
+		lo = min(lo, v);
+		hi = max(hi, v);
+	}
+	low[l] = lo;
+	high[l] = hi;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (uint stride = size / 2; stride > 0; stride >>= 1)
+	{
+		if (l < stride)
+		{
+			low[l] = min(low[l], low[l + stride]);
+			high[l] = max(high[l], high[l + stride]);
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	if (l == 0)
+	{
+		ranges[tile] = high[0] - low[0];
+	}
+}
+
+/* One work-item per tile. Tiles with a range above the threshold are active, and so
+   are the tiles of the image border, whose ring the stages copy instead of filter. A
+   tile runs when it or one of its eight neighbours is active: sobel and max of an active
+   tile read the gaussian and magnitude of the pixels around it. Tiles that are not
+   active are flat and written as zero, including those that run for a neighbour.
+   counts holds the number of tiles in runList and in flatList. */
+__kernel void tile_lists(__global uchar* ranges, uint tileColumns, uint tileRows, uint threshold,
+	__global uint* counts, __global uint* runList, __global uint* flatList)
+{
+	uint tile = get_global_id(0);
+	int tx = (int)(tile % tileColumns);
+	int ty = (int)(tile / tileColumns);
+	uint id = (uint)tx | ((uint)ty << 16);
+
+	bool run = false;
+	bool active = false;
+	for (int dy = -1; dy <= 1; dy++)
+	{
+		for (int dx = -1; dx <= 1; dx++)
+		{
+			int nx = tx + dx;
+			int ny = ty + dy;
+			if (nx < 0 || ny < 0 || nx >= (int)tileColumns || ny >= (int)tileRows)
+			{
+				continue;
+			}
+			bool border = nx == 0 || ny == 0 || nx == (int)tileColumns - 1 || ny == (int)tileRows - 1;
+			bool neighbourActive = border || ranges[nx + ny * tileColumns] > threshold;
+			run = run || neighbourActive;
+			active = active || (neighbourActive && dx == 0 && dy == 0);
+		}
+	}
+
+	if (run)
+	{
+		runList[atomic_inc(&counts[0])] = id;
+	}
+	if (!active)
+	{
+		flatList[atomic_inc(&counts[1])] = id;
+	}
+}
+
+/* Zero every pixel of the tiles in tileList */
+__kernel void tile_zero(__global uchar4* outputImage, uint width, __global const uint* tileList)
+{
+	uint tile = tileList[get_global_id(1) / TILE_LIST];
+	uint x = (tile & 0xffff) * TILE_LIST + get_global_id(0);
+	uint y = (tile >> 16) * TILE_LIST + get_global_id(1) % TILE_LIST;
+
+	outputImage[x + y * width] = (uchar4)(0);
+}
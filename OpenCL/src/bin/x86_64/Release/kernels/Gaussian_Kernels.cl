@@ -0,0 +1,170 @@
+#include "Stage_Common.h"
+
+#if defined(FIXED_POINT_FILTERS)
+
+/* 1-2-1 weights over 16 in integers; the float weights are exact binary fractions,
+   so the result is the same bit for bit */
+__kernel void gaussian_filter(__global uchar4* inputImage, __global uchar4* outputImage TILE_ARGS)
+{
+	uint x = PIXEL_X;
+	uint y = PIXEL_Y;
+
+	uint width = IMAGE_WIDTH;
+	uint height = IMAGE_HEIGHT;
+
+	int c = x + y * width;
+
+	if (INTERIOR(x, y, width, height))
+	{
+		ushort4 top = convert_ushort4(inputImage[c - 1 - width]) + (convert_ushort4(inputImage[c - width]) << 1) +
+			convert_ushort4(inputImage[c + 1 - width]);
+		ushort4 middle = convert_ushort4(inputImage[c - 1]) + (convert_ushort4(inputImage[c]) << 1) +
+			convert_ushort4(inputImage[c + 1]);
+		ushort4 bottom = convert_ushort4(inputImage[c - 1 + width]) + (convert_ushort4(inputImage[c + width]) << 1) +
+			convert_ushort4(inputImage[c + 1 + width]);
+
+		outputImage[c] = convert_uchar4((top + (middle << 1) + bottom) >> 4);
+	}
+}
+
+#elif defined(HALF_PRECISION_FILTERS)
+
+#pragma OPENCL EXTENSION cl_khr_fp16 : enable
+
+/* Half arithmetic (cl_khr_fp16). The taps are bytes times powers of two and their
+   partial sums stay below 2048, all exact; only the last two additions round, which
+   can move a result of 128 or more up to the next integer */
+__kernel void gaussian_filter(__global uchar4* inputImage, __global uchar4* outputImage TILE_ARGS)
+{
+	uint x = PIXEL_X;
+	uint y = PIXEL_Y;
+
+	uint width = IMAGE_WIDTH;
+	uint height = IMAGE_HEIGHT;
+
+	int c = x + y * width;
+
+	if (INTERIOR(x, y, width, height))
+	{
+		half4 corners = convert_half4(inputImage[c - 1 - width]) + convert_half4(inputImage[c + 1 - width]) +
+			convert_half4(inputImage[c - 1 + width]) + convert_half4(inputImage[c + 1 + width]);
+		half4 edges = convert_half4(inputImage[c - width]) + convert_half4(inputImage[c - 1]) +
+			convert_half4(inputImage[c + 1]) + convert_half4(inputImage[c + width]);
+		half4 centre = convert_half4(inputImage[c]);
+
+		outputImage[c] = convert_uchar4(corners * (half4)(0.0625f) + edges * (half4)(0.125f) +
+			centre * (half4)(0.25f));
+	}
+}
+
+#else
+
+__constant float gaus[3][3] = { { 0.0625, 0.125, 0.0625 },
+{ 0.1250, 0.250, 0.1250 },
+{ 0.0625, 0.125, 0.0625 } };
+
+__kernel void gaussian_filter(__global uchar4* inputImage, __global uchar4* outputImage TILE_ARGS)
+{
+	uint x = PIXEL_X;
+	uint y = PIXEL_Y;
+
+	uint width = IMAGE_WIDTH;
+	uint height = IMAGE_HEIGHT;
+
+	float4 Gx = (float4)(0);
+	//float4 Gy = Gx;
+
+	int c = x + y * width;
+
+	
+	/* Read each texel component and calculate the filtered value using neighbouring texel components */
+	if (INTERIOR(x, y, width, height))
+	{
+		float4 i00 = convert_float4(inputImage[c - 1 - width]);
+		float4 i10 = convert_float4(inputImage[c - width]);
+		float4 i20 = convert_float4(inputImage[c + 1 - width]);
+		float4 i01 = convert_float4(inputImage[c - 1]);
+		float4 i11 = convert_float4(inputImage[c]);
+		float4 i21 = convert_float4(inputImage[c + 1]);
+		float4 i02 = convert_float4(inputImage[c - 1 + width]);
+		float4 i12 = convert_float4(inputImage[c + width]);
+		float4 i22 = convert_float4(inputImage[c + 1 + width]);
+
+		Gx = i00*gaus[0][0] + i10*gaus[1][0] + i20*gaus[2][0] + i01*gaus[0][1] +i11*gaus[1][1] + i21*gaus[2][1] + i02*gaus[0][2] + i12*gaus[1][2] + i22*gaus[2][2];
+
+
+		outputImage[c] = convert_uchar4(Gx);
+
+	}
+
+
+
+}
+
+#endif
+
+/* gaussian_filter with the weights of a --sweep-sigma: side, 1 - 2 side, side in each
+   direction, always in float. A side of 0.25 is the 1-2-1 filter. */
+__kernel void gaussian_weighted(__global uchar4* inputImage, __global uchar4* outputImage, float side)
+{
+	uint x = get_global_id(0);
+	uint y = get_global_id(1);
+
+	uint width = IMAGE_WIDTH;
+	uint height = IMAGE_HEIGHT;
+
+	int c = x + y * width;
+
+	if (INTERIOR(x, y, width, height))
+	{
+		float centre = 1 - 2 * side;
+		float4 top = side * (convert_float4(inputImage[c - 1 - width]) + convert_float4(inputImage[c + 1 - width])) +
+			centre * convert_float4(inputImage[c - width]);
+		float4 middle = side * (convert_float4(inputImage[c - 1]) + convert_float4(inputImage[c + 1])) +
+			centre * convert_float4(inputImage[c]);
+		float4 bottom = side * (convert_float4(inputImage[c - 1 + width]) + convert_float4(inputImage[c + 1 + width])) +
+			centre * convert_float4(inputImage[c + width]);
+
+		outputImage[c] = convert_uchar4_sat(side * (top + bottom) + centre * middle);
+	}
+}
+
+/* Next pyramid level: every second pixel of every second row of the gaussian output.
+   The level is its own greyscale, so it goes to both buffers the level's gaussian_filter uses */
+__kernel void gaussian_decimate(__global uchar4* inputImage, uint inputWidth,
+	__global uchar4* nextImage, __global uchar4* prevImage)
+{
+	uint x = get_global_id(0);
+	uint y = get_global_id(1);
+
+	uint width = get_global_size(0);
+
+	int c = x + y * width;
+
+	uchar4 value = inputImage[2 * x + 2 * y * inputWidth];
+	nextImage[c] = value;
+	prevImage[c] = value;
+}
+
+/* gaussian_filter of the ring pixels under a --border mode, in integers like the
+   FIXED_POINT_FILTERS kernel (the same results as the float weights) */
+__kernel void gaussian_border(__global uchar4* inputImage, __global uchar4* outputImage, uint width,
+	uint height, uint mode)
+{
+	int2 p = ring_pixel(get_global_id(0), width, height);
+	uint4 sum = (uint4)(0);
+
+	if (mode != BORDER_SKIP)
+	{
+		for (int dy = -1; dy <= 1; dy++)
+		{
+			for (int dx = -1; dx <= 1; dx++)
+			{
+				uint4 pixel = convert_uint4(border_pixel(inputImage, p.x + dx, p.y + dy, width, height, mode));
+				sum += pixel << (uint)((dx == 0) + (dy == 0));
+			}
+		}
+	}
+
+	outputImage[p.x + p.y * width] = convert_uchar4(sum >> 4);
+}
@@ -0,0 +1,45 @@
+#include "Stage_Common.h"
+
+/* >= high is an edge, <= low is not, otherwise the pixel is an edge from (low + high) / 2 */
+uchar hysteresis(uchar magnitude, float lowThresh, float highThresh)
+{
+	const uchar EDGE = 255;
+
+	if (magnitude >= highThresh)
+		return EDGE;
+	else if (magnitude <= lowThresh)
+		return 0;
+
+	float med = (highThresh + lowThresh) / 2;
+	return magnitude >= med ? EDGE : 0;
+}
+
+__kernel void Hyst_filter(__global uchar4* inputImage, __global uchar4* outputImage TILE_ARGS)
+{
+	uint x = PIXEL_X;
+	uint y = PIXEL_Y;
+
+	uint width = IMAGE_WIDTH;
+	uint height = IMAGE_HEIGHT;
+
+	float lowThresh = 20;
+	float highThresh = 70;
+
+	int c = x + y * width;
+
+	outputImage[c] = hysteresis(inputImage[c].x, lowThresh, highThresh);
+}
+
+/* Hyst_filter with the thresholds of one --sweep-thresholds pair, from a kept max output */
+__kernel void Hyst_threshold_filter(__global uchar4* inputImage, __global uchar4* outputImage,
+	float lowThresh, float highThresh)
+{
+	uint x = get_global_id(0);
+	uint y = get_global_id(1);
+
+	uint width = IMAGE_WIDTH;
+
+	int c = x + y * width;
+
+	outputImage[c] = hysteresis(inputImage[c].x, lowThresh, highThresh);
+}
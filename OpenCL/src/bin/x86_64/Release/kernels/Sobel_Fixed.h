@@ -0,0 +1,46 @@
+/* Integer magnitude and direction of the sobel kernels. Only C that OpenCL C shares with
+   C++, so tests/FixedPointTest.cpp checks this code against the float kernels. */
+
+#ifndef SOBEL_FIXED_H
+#define SOBEL_FIXED_H
+
+/* sin and cos of the direction bucket boundaries (1, 3 and 5 radians, + 0.0008 / PI) scaled
+   by 2^19. For every Gx, Gy in [-1020, 1020] the signs of the cross products give the bucket
+   of the exact atan2, and equal those of the float sobel_filter except on five gradients
+   (multiples of (-179, 53)) within float rounding of the 5 radian boundary. The products
+   stay within int. */
+#define THETA_COS1 283162
+#define THETA_SIN1 441245
+#define THETA_COS3 (-519060)
+#define THETA_SIN3 73855
+#define THETA_COS5 148849
+#define THETA_SIN5 (-502715)
+
+/* Integer square root of n, the float root corrected by one where it rounded */
+int sobel_root(int n)
+{
+	int root = (int)sqrt((float)n);
+	root -= root * root > n ? 1 : 0;
+	root += (root + 1) * (root + 1) <= n ? 1 : 0;
+	return root;
+}
+
+/* Direction (degrees) of sobel_filter without trig: the bucket is found from which side
+   of each boundary the gradient lies on */
+int fixed_theta(int gx, int gy)
+{
+	int cross1 = gx * THETA_COS1 - gy * THETA_SIN1;
+	int cross3 = gx * THETA_COS3 - gy * THETA_SIN3;
+	int cross5 = gx * THETA_COS5 - gy * THETA_SIN5;
+	if (cross1 >= 0 && cross3 < 0)
+	{
+		return 45;
+	}
+	if (cross3 >= 0 && cross5 < 0)
+	{
+		return 90;
+	}
+	return (cross5 >= 0 && gx < 0) ? 135 : 0;
+}
+
+#endif
@@ -0,0 +1,83 @@
+/* Definitions shared by the stage kernels (gaussian, sobel, max and hysteresis), included
+   with -I from the kernels directory */
+
+#ifndef STAGE_COMMON_H
+#define STAGE_COMMON_H
+
+/* --specialize builds with -D WIDTH and -D HEIGHT, making the image size a constant */
+#if defined(WIDTH)
+#define IMAGE_WIDTH WIDTH
+#define IMAGE_HEIGHT HEIGHT
+#elif defined(BORDER_RING)
+/* --border launches the interior with a global offset of (1, 1) and the ring apart */
+#define IMAGE_WIDTH (get_global_size(0) + 2 * get_global_offset(0))
+#define IMAGE_HEIGHT (get_global_size(1) + 2 * get_global_offset(1))
+#else
+#define IMAGE_WIDTH get_global_size(0)
+#define IMAGE_HEIGHT get_global_size(1)
+#endif
+
+/* --flat-threshold launches TILE_LIST x TILE_LIST pixels for each entry of tileList (the
+   column | row << 16 of an active tile); it always builds with -D WIDTH and -D HEIGHT */
+#if defined(TILE_LIST)
+#define TILE_ARGS , __global const uint* tileList
+#define PIXEL_X ((tileList[get_global_id(1) / TILE_LIST] & 0xffff) * TILE_LIST + get_global_id(0))
+#define PIXEL_Y ((tileList[get_global_id(1) / TILE_LIST] >> 16) * TILE_LIST + get_global_id(1) % TILE_LIST)
+#else
+#define TILE_ARGS
+#define PIXEL_X get_global_id(0)
+#define PIXEL_Y get_global_id(1)
+#endif
+
+/* --border modes, as NativeBorderMode on the host */
+#define BORDER_CLAMP 1
+#define BORDER_MIRROR 2
+#define BORDER_ZERO 3
+#define BORDER_SKIP 4
+
+/* Pixel i of the ring whose 3x3 window leaves the image: the top row, the bottom row,
+   then the first and last pixel of each row between */
+int2 ring_pixel(uint i, uint width, uint height)
+{
+	if (i < width)
+	{
+		return (int2)((int)i, 0);
+	}
+	i -= width;
+	if (i < width)
+	{
+		return (int2)((int)i, (int)height - 1);
+	}
+	i -= width;
+	return (int2)((i & 1) ? (int)width - 1 : 0, 1 + (int)(i / 2));
+}
+
+/* Pixel (x, y), one step outside the image at most, read under a border mode */
+uchar4 border_pixel(__global uchar4* image, int x, int y, uint width, uint height, uint mode)
+{
+	if (x < 0 || x >= (int)width || y < 0 || y >= (int)height)
+	{
+		if (mode == BORDER_ZERO)
+		{
+			return (uchar4)(0);
+		}
+		if (mode == BORDER_MIRROR)
+		{
+			x = x < 0 ? -x : (x >= (int)width ? 2 * ((int)width - 1) - x : x);
+			y = y < 0 ? -y : (y >= (int)height ? 2 * ((int)height - 1) - y : y);
+		}
+		x = clamp(x, 0, (int)width - 1);
+		y = clamp(y, 0, (int)height - 1);
+	}
+	return image[x + y * width];
+}
+
+/* Pixel (x, y) has its whole 3x3 window in the image. --border launches only such pixels
+   in the interior launch, so the check compiles out there */
+#if defined(BORDER_RING)
+#define INTERIOR(x, y, width, height) 1
+#else
+#define INTERIOR(x, y, width, height) ((x) >= 1 && (x) < (width) - 1 && (y) >= 1 && (y) < (height) - 1)
+#endif
+
+#endif
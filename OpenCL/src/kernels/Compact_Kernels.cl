@@ -0,0 +1,119 @@
+/* Compact outputs of Hyst_filter. edge_count, edge_scan and edge_scatter
+   turn the edge map into (x, y, direction, 0) records in raster order;
+   all three run with the same power of two work-group size. edge_pack
+   packs the edge map 1 bit per pixel. */
+
+/* Inclusive prefix sum of scratch[0 .. get_local_size(0)) */
+void local_scan(__local uint* scratch)
+{
+	uint l = get_local_id(0);
+	for (uint offset = 1; offset < get_local_size(0); offset <<= 1)
+	{
+		uint add = l >= offset ? scratch[l - offset] : 0;
+		barrier(CLK_LOCAL_MEM_FENCE);
+		scratch[l] += add;
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+}
+
+/* Edges in each work-group's pixels */
+__kernel void edge_count(__global uchar4* edges, uint pixels, __global uint* groupCounts,
+	__local uint* scratch)
+{
+	uint i = get_global_id(0);
+	uint l = get_local_id(0);
+
+	scratch[l] = (i < pixels && edges[i].x != 0) ? 1 : 0;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (uint stride = get_local_size(0) / 2; stride > 0; stride >>= 1)
+	{
+		if (l < stride)
+		{
+			scratch[l] += scratch[l + stride];
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	if (l == 0)
+	{
+		groupCounts[get_group_id(0)] = scratch[0];
+	}
+}
+
+/* One work-group: turn the counts into exclusive offsets, the total goes to groupCounts[groups] */
+__kernel void edge_scan(__global uint* groupCounts, uint groups, __local uint* scratch)
+{
+	uint l = get_local_id(0);
+	uint size = get_local_size(0);
+	uint carry = 0;
+
+	for (uint base = 0; base < groups; base += size)
+	{
+		uint i = base + l;
+		uint count = i < groups ? groupCounts[i] : 0;
+		scratch[l] = count;
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		local_scan(scratch);
+		if (i < groups)
+		{
+			groupCounts[i] = carry + scratch[l] - count;
+		}
+		carry += scratch[size - 1];
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	if (l == 0)
+	{
+		groupCounts[groups] = carry;
+	}
+}
+
+/* Write each edge at its group's offset plus its rank in the group; directionScale turns
+   theta into degrees (1 for sobel_filter, 45 for the codes of sobel_direction) */
+__kernel void edge_scatter(__global uchar4* edges, __global uchar* theta, uint width, uint height,
+	uint directionScale, __global uint* groupOffsets, __global ushort4* points, __local uint* scratch)
+{
+	uint i = get_global_id(0);
+	uint l = get_local_id(0);
+	uint pixels = width * height;
+
+	uint edge = (i < pixels && edges[i].x != 0) ? 1 : 0;
+	scratch[l] = edge;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	local_scan(scratch);
+
+	if (edge)
+	{
+		uint x = i % width;
+		uint y = i / width;
+
+		/* sobel_filter never writes the direction of border pixels */
+		ushort direction = (x >= 1 && x < width - 1 && y >= 1 && y < height - 1) ? theta[i] * directionScale : 0;
+		points[groupOffsets[get_group_id(0)] + scratch[l] - 1] = (ushort4)(x, y, direction, 0);
+	}
+}
+
+/* One work-item per 32 pixels of a row. The bytes of each uint are in file order (first
+   pixel in the most significant bit of the first byte on little endian devices), so the
+   rows are 1 bit BMP rows, padded to 32 bits. */
+__kernel void edge_pack(__global uchar4* edges, uint width, __global uint* bits)
+{
+	uint w = get_global_id(0);
+	uint y = get_global_id(1);
+	uint x0 = w * 32;
+	__global uchar4* row = edges + y * width;
+	uint word = 0;
+
+	for (uint b = 0; b < 32; b++)
+	{
+		if (x0 + b < width && row[x0 + b].x != 0)
+		{
+			word |= 1u << ((b & ~7u) + 7 - (b & 7));
+		}
+	}
+
+	bits[w + y * get_global_size(0)] = word;
+}
@@ -1,16 +1,125 @@
+#include "Stage_Common.h"
+
+/* With -D EXACT_LUMA the weights are applied in integers. The float sum rounds
+   0.17% of colours (48 of the 256 grey levels) one lower than (30 R + 59 G + 11 B) / 100. */
+#if defined(EXACT_LUMA)
+#define LUMA(color) (uchar)((30 * (uint)(color).x + 59 * (uint)(color).y + 11 * (uint)(color).z) / 100)
+#else
+#define LUMA(color) (uchar)(0.30 *(color).x + 0.59 *(color).y + 0.11 *(color).z)
+#endif
+
 
 __kernel void greyscale_filter(__global uchar4* inputImage, __global uchar4* outputImage)
 {
 	uint x = get_global_id(0);
 	uint y = get_global_id(1);
 
-	uint width = get_global_size(0);
-	uint height = get_global_size(1);
+	uint width = IMAGE_WIDTH;
+	uint height = IMAGE_HEIGHT;
 
 
 	int c = x + y * width;
 	uchar4 color = inputImage[c];
-	uchar lum = (uchar)(0.30 *color.x + 0.59 *color.y + 0.11 *color.z);
+	uchar lum = LUMA(color);
 	outputImage[c] = lum;//convert_uchar4(lum);
 
-}
\ No newline at end of file
+}
+
+/* 32 bit BMP pixels used in place are B, G, R, A; the input is rewritten as
+   R, G, B, A so later stages (the Gaussian border) see the same data */
+__kernel void greyscale_filter_bgra(__global uchar4* inputImage, __global uchar4* outputImage)
+{
+	uint x = get_global_id(0);
+	uint y = get_global_id(1);
+
+	uint width = IMAGE_WIDTH;
+	uint height = IMAGE_HEIGHT;
+
+
+	int c = x + y * width;
+	uchar4 color = inputImage[c].zyxw;
+	inputImage[c] = color;
+	uchar lum = LUMA(color);
+	outputImage[c] = lum;
+
+}
+
+
+/* Packed 24 bit BMP pixels (B, G, R); the R, G, B, A input later stages read is
+   written to inputImage, so only 3 bytes per pixel cross the bus */
+__kernel void greyscale_filter_bgr(__global const uchar* packedImage, __global uchar4* inputImage,
+	__global uchar4* outputImage)
+{
+	uint x = get_global_id(0);
+	uint y = get_global_id(1);
+
+	uint width = IMAGE_WIDTH;
+	uint height = IMAGE_HEIGHT;
+
+
+	int c = x + y * width;
+	uchar4 color = (uchar4)(packedImage[3 * c + 2], packedImage[3 * c + 1], packedImage[3 * c], 255);
+	inputImage[c] = color;
+	uchar lum = LUMA(color);
+	outputImage[c] = lum;
+
+}
+
+
+/* Packed 8 bit BMP palette indices; palette holds R, G, B, A entries */
+__kernel void greyscale_filter_index8(__global const uchar* packedImage, __constant uchar4* palette,
+	__global uchar4* inputImage, __global uchar4* outputImage)
+{
+	uint x = get_global_id(0);
+	uint y = get_global_id(1);
+
+	uint width = IMAGE_WIDTH;
+	uint height = IMAGE_HEIGHT;
+
+
+	int c = x + y * width;
+	uchar4 color = palette[packedImage[c]];
+	inputImage[c] = color;
+	uchar lum = LUMA(color);
+	outputImage[c] = lum;
+
+}
+
+
+/* Packed PPM pixels (R, G, B) */
+__kernel void greyscale_filter_rgb(__global const uchar* packedImage, __global uchar4* inputImage,
+	__global uchar4* outputImage)
+{
+	uint x = get_global_id(0);
+	uint y = get_global_id(1);
+
+	uint width = IMAGE_WIDTH;
+	uint height = IMAGE_HEIGHT;
+
+
+	int c = x + y * width;
+	uchar4 color = (uchar4)(packedImage[3 * c], packedImage[3 * c + 1], packedImage[3 * c + 2], 255);
+	inputImage[c] = color;
+	uchar lum = LUMA(color);
+	outputImage[c] = lum;
+
+}
+
+
+/* Luminance planes (PGM, raw) are the greyscale already; only widen them to uchar4 */
+__kernel void greyscale_filter_luma(__global const uchar* packedImage, __global uchar4* inputImage,
+	__global uchar4* outputImage)
+{
+	uint x = get_global_id(0);
+	uint y = get_global_id(1);
+
+	uint width = IMAGE_WIDTH;
+	uint height = IMAGE_HEIGHT;
+
+
+	int c = x + y * width;
+	uchar lum = packedImage[c];
+	inputImage[c] = (uchar4)(lum, lum, lum, 255);
+	outputImage[c] = lum;
+
+}
@@ -1,35 +1,45 @@
+#include "Stage_Common.h"
 
-__kernel void Hyst_filter(__global uchar4* inputImage, __global uchar4* outputImage)
+/* >= high is an edge, <= low is not, otherwise the pixel is an edge from (low + high) / 2 */
+uchar hysteresis(uchar magnitude, float lowThresh, float highThresh)
 {
-	uint x = get_global_id(0);
-	uint y = get_global_id(1);
+	const uchar EDGE = 255;
+
+	if (magnitude >= highThresh)
+		return EDGE;
+	else if (magnitude <= lowThresh)
+		return 0;
+
+	float med = (highThresh + lowThresh) / 2;
+	return magnitude >= med ? EDGE : 0;
+}
+
+__kernel void Hyst_filter(__global uchar4* inputImage, __global uchar4* outputImage TILE_ARGS)
+{
+	uint x = PIXEL_X;
+	uint y = PIXEL_Y;
 
-	uint width = get_global_size(0);
-	uint height = get_global_size(1);
+	uint width = IMAGE_WIDTH;
+	uint height = IMAGE_HEIGHT;
 
 	float lowThresh = 20;
 	float highThresh = 70;
-	//float4 Gy = Gx;
 
 	int c = x + y * width;
 
+	outputImage[c] = hysteresis(inputImage[c].x, lowThresh, highThresh);
+}
 
-	const uchar EDGE = 255;
-
-	uchar4 magnitude = inputImage[c];
+/* Hyst_filter with the thresholds of one --sweep-thresholds pair, from a kept max output */
+__kernel void Hyst_threshold_filter(__global uchar4* inputImage, __global uchar4* outputImage,
+	float lowThresh, float highThresh)
+{
+	uint x = get_global_id(0);
+	uint y = get_global_id(1);
 
-	if (magnitude.x >= highThresh)
-		outputImage[c] = EDGE;//convert_uchar4(EDGE);
-	else if (magnitude.x <= lowThresh)
-		outputImage[c] = 0;//convert_uchar4(0);
-	else
-	{
-		float med = (highThresh + lowThresh) / 2;
+	uint width = IMAGE_WIDTH;
 
-		if (magnitude.x >= med)
-			outputImage[c] = EDGE;//convert_uchar4(EDGE);
-		else
-			outputImage[c] = 0;//convert_uchar4(0);
-	}
+	int c = x + y * width;
 
-}
\ No newline at end of file
+	outputImage[c] = hysteresis(inputImage[c].x, lowThresh, highThresh);
+}
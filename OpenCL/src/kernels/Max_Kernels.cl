@@ -1,10 +1,12 @@
-__kernel void Max_filter(__global uchar4* inputImage, __global uchar4* outputImage, __global uchar* theta)
+#include "Stage_Common.h"
+
+__kernel void Max_filter(__global uchar4* inputImage, __global uchar4* outputImage, __global uchar* theta TILE_ARGS)
 {
-	uint x = get_global_id(0);
-	uint y = get_global_id(1);
+	uint x = PIXEL_X;
+	uint y = PIXEL_Y;
 
-	uint width = get_global_size(0);
-	uint height = get_global_size(1);
+	uint width = IMAGE_WIDTH;
+	uint height = IMAGE_HEIGHT;
 
 
 	int c = x + y * width;
@@ -61,3 +63,78 @@ __kernel void Max_filter(__global uchar4* inputImage, __global uchar4* outputIma
 
 
 }
+
+/* Non-maximum suppression of sobel_direction output: the 2-bit code picks the neighbour
+   pair from a table instead of a switch; neighbours outside the buffer count as 0 */
+__constant int codeStepX[4] = { -1, 1, 0, -1 };
+__constant int codeStepY[4] = { 0, -1, -1, -1 };
+
+__kernel void Max_code_filter(__global uchar4* inputImage, __global uchar4* outputImage, __global uchar* theta TILE_ARGS)
+{
+	uint x = PIXEL_X;
+	uint y = PIXEL_Y;
+
+	uint width = IMAGE_WIDTH;
+	uint height = IMAGE_HEIGHT;
+
+	int c = x + y * width;
+	int size = width * height;
+
+	uchar code = theta[c] & 3;
+	int step = codeStepX[code] + codeStepY[code] * (int)width;
+	int n1 = c + step;
+	int n2 = c - step;
+
+	uchar4 magnitude = inputImage[c];
+#if defined(BORDER_RING)
+	/* The interior launch of --border has both neighbours in the image */
+	uchar m1 = inputImage[n1].x;
+	uchar m2 = inputImage[n2].x;
+#else
+	uchar m1 = (n1 >= 0 && n1 < size) ? inputImage[n1].x : 0;
+	uchar m2 = (n2 >= 0 && n2 < size) ? inputImage[n2].x : 0;
+#endif
+
+	outputImage[c] = (magnitude.x <= m1 || magnitude.x <= m2) ? (uchar4)(0) : magnitude;
+}
+
+/* Non-maximum suppression of the packed layout of sobel_packed_filter: magnitude << 2 | code,
+   one load per pixel instead of a magnitude and a theta load */
+__kernel void Max_packed_filter(__global ushort* gradient, __global uchar4* outputImage)
+{
+	uint x = get_global_id(0);
+	uint y = get_global_id(1);
+
+	uint width = IMAGE_WIDTH;
+	uint height = IMAGE_HEIGHT;
+
+	int c = x + y * width;
+	int size = width * height;
+
+	ushort g = gradient[c];
+	uchar code = g & 3;
+	int step = codeStepX[code] + codeStepY[code] * (int)width;
+	int n1 = c + step;
+	int n2 = c - step;
+
+	uchar magnitude = g >> 2;
+	uchar m1 = (n1 >= 0 && n1 < size) ? gradient[n1] >> 2 : 0;
+	uchar m2 = (n2 >= 0 && n2 < size) ? gradient[n2] >> 2 : 0;
+
+	outputImage[c] = (magnitude <= m1 || magnitude <= m2) ? (uchar4)(0) : (uchar4)(magnitude);
+}
+
+/* Max_filter (or with codes, Max_code_filter) of the ring pixels under a --border mode */
+__kernel void max_border(__global uchar4* inputImage, __global uchar4* outputImage, __global uchar* theta,
+	uint width, uint height, uint mode, uint codes)
+{
+	int2 p = ring_pixel(get_global_id(0), width, height);
+	int c = p.x + p.y * width;
+
+	uchar code = codes ? theta[c] & 3 : theta[c] / 45;
+	uchar4 magnitude = inputImage[c];
+	uchar m1 = border_pixel(inputImage, p.x + codeStepX[code], p.y + codeStepY[code], width, height, mode).x;
+	uchar m2 = border_pixel(inputImage, p.x - codeStepX[code], p.y - codeStepY[code], width, height, mode).x;
+
+	outputImage[c] = (mode == BORDER_SKIP || magnitude.x <= m1 || magnitude.x <= m2) ? (uchar4)(0) : magnitude;
+}
@@ -1,10 +1,143 @@
-__kernel void sobel_filter(__global uchar4* inputImage, __global uchar4* outputImage,__global uchar* theta)
+#include "Stage_Common.h"
+#include "Sobel_Fixed.h"
+
+/* Magnitude of the trig-free kernels; --fast-math l1 takes (|Gx| + |Gy|) / 2 */
+uchar root_magnitude(int gx, int gy)
 {
-	uint x = get_global_id(0);
-    uint y = get_global_id(1);
+#if defined(FAST_MAGNITUDE_L1)
+	return (uchar)min((abs(gx) + abs(gy)) >> 1, 255u);
+#else
+	return (uchar)min(sobel_root(gx * gx + gy * gy) >> 1, 255);
+#endif
+}
+
+#if !defined(FIXED_POINT_FILTERS)
+
+/* Direction (degrees) of sobel_filter for the luminance gradient, bucketed in float */
+uchar sobel_theta(int gx, int gy)
+{
+	const float PI = 3.14159265;
+	float angle = atan2((float)gx, (float)gy);
+
+	if (angle < 0)
+	{
+		angle = fmod((angle + 2 * PI), (2 * PI));
+	}
+
+	return ((int)(degrees(angle * (PI / 8) + PI / 8 - 0.0001) / 45) * 45) % 180;
+}
+
+#endif
+
+#if defined(FIXED_POINT_FILTERS)
+
+__kernel void sobel_filter(__global uchar4* inputImage, __global uchar4* outputImage, __global uchar* theta TILE_ARGS)
+{
+	uint x = PIXEL_X;
+	uint y = PIXEL_Y;
+
+	uint width = IMAGE_WIDTH;
+	uint height = IMAGE_HEIGHT;
+
+	int c = x + y * width;
+
+	if (INTERIOR(x, y, width, height))
+	{
+		short4 i00 = convert_short4(inputImage[c - 1 - width]);
+		short4 i10 = convert_short4(inputImage[c - width]);
+		short4 i20 = convert_short4(inputImage[c + 1 - width]);
+		short4 i01 = convert_short4(inputImage[c - 1]);
+		short4 i21 = convert_short4(inputImage[c + 1]);
+		short4 i02 = convert_short4(inputImage[c - 1 + width]);
+		short4 i12 = convert_short4(inputImage[c + width]);
+		short4 i22 = convert_short4(inputImage[c + 1 + width]);
+
+		short4 Gx = i00 + (i10 << 1) + i20 - i02 - (i12 << 1) - i22;
+		short4 Gy = i00 - i20 + (i01 << 1) - (i21 << 1) + i02 - i22;
+
+		/* Integer square root of the exact sum of squares: the float root, corrected by one where it rounded */
+		int4 gx = convert_int4(Gx);
+		int4 gy = convert_int4(Gy);
+		int4 n = gx * gx + gy * gy;
+		int4 root = convert_int4(sqrt(convert_float4(n)));
+		root = select(root, root - 1, root * root > n);
+		root = select(root, root + 1, (root + 1) * (root + 1) <= n);
+		outputImage[c] = convert_uchar4_sat(root >> 1);
+
+		theta[c] = fixed_theta(gx.x, gy.x);
+	}
+}
+
+/* Luminance magnitude and direction (degrees) of sobel_filter, for the fused and packed kernels */
+uchar sobel_magnitude(int gx, int gy)
+{
+	return (uchar)min(sobel_root(gx * gx + gy * gy) >> 1, 255);
+}
+
+uchar sobel_theta(int gx, int gy)
+{
+	return (uchar)fixed_theta(gx, gy);
+}
+
+#elif defined(HALF_PRECISION_FILTERS)
+
+#pragma OPENCL EXTENSION cl_khr_fp16 : enable
+
+/* Half arithmetic (cl_khr_fp16). Gx and Gy are sums of bytes times 1 or 2, exact in half,
+   so the direction is that of the float kernel; only the magnitude rounds. */
+__kernel void sobel_filter(__global uchar4* inputImage, __global uchar4* outputImage, __global uchar* theta TILE_ARGS)
+{
+	uint x = PIXEL_X;
+	uint y = PIXEL_Y;
+
+	uint width = IMAGE_WIDTH;
+	uint height = IMAGE_HEIGHT;
+
+	int c = x + y * width;
+
+	if (INTERIOR(x, y, width, height))
+	{
+		half4 i00 = convert_half4(inputImage[c - 1 - width]);
+		half4 i10 = convert_half4(inputImage[c - width]);
+		half4 i20 = convert_half4(inputImage[c + 1 - width]);
+		half4 i01 = convert_half4(inputImage[c - 1]);
+		half4 i21 = convert_half4(inputImage[c + 1]);
+		half4 i02 = convert_half4(inputImage[c - 1 + width]);
+		half4 i12 = convert_half4(inputImage[c + width]);
+		half4 i22 = convert_half4(inputImage[c + 1 + width]);
+
+		half4 Gx = i00 + (half4)(2) * i10 + i20 - i02 - (half4)(2) * i12 - i22;
+		half4 Gy = i00 - i20 + (half4)(2) * i01 - (half4)(2) * i21 + i02 - i22;
+
+		outputImage[c] = convert_uchar4_sat(hypot(Gx, Gy) / (half4)(2));
+		theta[c] = sobel_theta((int)Gx.x, (int)Gy.x);
+	}
+}
+
+uchar sobel_magnitude(int gx, int gy)
+{
+	return convert_uchar_sat(hypot((half)gx, (half)gy) / (half)2);
+}
+
+#else
 
-	uint width = get_global_size(0);
-	uint height = get_global_size(1);
+/* --fast-math replaces hypot by native_sqrt of the sum of squares or by |Gx| + |Gy|,
+   which is up to 41% longer on the diagonals */
+#if defined(FAST_MAGNITUDE_L1)
+#define GRADIENT_LENGTH(gx, gy) (fabs(gx) + fabs(gy))
+#elif defined(FAST_MAGNITUDE_SQRT)
+#define GRADIENT_LENGTH(gx, gy) native_sqrt((gx) * (gx) + (gy) * (gy))
+#else
+#define GRADIENT_LENGTH(gx, gy) hypot(gx, gy)
+#endif
+
+__kernel void sobel_filter(__global uchar4* inputImage, __global uchar4* outputImage,__global uchar* theta TILE_ARGS)
+{
+	uint x = PIXEL_X;
+    uint y = PIXEL_Y;
+
+	uint width = IMAGE_WIDTH;
+	uint height = IMAGE_HEIGHT;
 
 	float4 Gx = (float4)(0);
 	float4 Gy = Gx;
@@ -15,7 +148,7 @@ __kernel void sobel_filter(__global uchar4* inputImage, __global uchar4* outputI
 
 
 	/* Read each texel component and calculate the filtered value using neighbouring texel components */
-	if( x >= 1 && x < (width-1) && y >= 1 && y < height - 1)
+	if (INTERIOR(x, y, width, height))
 	{
 
 		float4 i00 = convert_float4(inputImage[c - 1 - width]);
@@ -33,10 +166,11 @@ __kernel void sobel_filter(__global uchar4* inputImage, __global uchar4* outputI
 		Gy =   i00 - i20  + (float4)(2)*i01 - (float4)(2)*i21 + i02  -  i22;
 
 		/* taking root of sums of squares of Gx and Gy */
+#if defined(FAST_MAGNITUDE_L1) || defined(FAST_MAGNITUDE_SQRT)
+		outputImage[c] = convert_uchar4_sat(GRADIENT_LENGTH(Gx, Gy) / (float4)(2));
+#else
 		outputImage[c] = convert_uchar4(hypot(Gx, Gy)/(float4)(2));
-		//outputImage[c] = convert_uchar4(100)
-		//barrier(CLK_LOCAL_MEM_FENCE);
-		barrier(CLK_GLOBAL_MEM_FENCE);
+#endif
 		angle = atan2(Gx.x, Gy.x);
 
 		if (angle < 0)
@@ -50,3 +184,270 @@ __kernel void sobel_filter(__global uchar4* inputImage, __global uchar4* outputI
 
 
 }
+
+uchar sobel_magnitude(int gx, int gy)
+{
+	return convert_uchar_sat(GRADIENT_LENGTH((float)gx, (float)gy) / 2);
+}
+
+#endif
+
+/* tan(22.5 degrees) scaled by 2^14: a gradient is horizontal when |Gx| * 2^14 <= |Gy| * TAN_22_5
+   and vertical when |Gy| * 2^14 < |Gx| * TAN_22_5 (tan(67.5) is 1 / tan(22.5)) */
+#define TAN_22_5 6786
+
+/* 2-bit direction code of a gradient: 0 compares the left and right neighbours,
+   1 up-right and down-left, 2 up and down, 3 up-left and down-right */
+uchar direction_code(int gx, int gy)
+{
+	int ax = abs(gx);
+	int ay = abs(gy);
+	if (ax * 16384 <= ay * TAN_22_5)
+	{
+		return 0;
+	}
+	if (ay * 16384 < ax * TAN_22_5)
+	{
+		return 2;
+	}
+	return (gx ^ gy) >= 0 ? 3 : 1;
+}
+
+/* Sobel gradient of the luminance (x) around pixel c: Gx is the vertical (top - bottom),
+   Gy the horizontal (left - right) difference */
+int2 luma_gradient(__global uchar4* inputImage, int c, int width)
+{
+	int i00 = inputImage[c - 1 - width].x;
+	int i10 = inputImage[c - width].x;
+	int i20 = inputImage[c + 1 - width].x;
+	int i01 = inputImage[c - 1].x;
+	int i21 = inputImage[c + 1].x;
+	int i02 = inputImage[c - 1 + width].x;
+	int i12 = inputImage[c + width].x;
+	int i22 = inputImage[c + 1 + width].x;
+
+	return (int2)(i00 + 2 * i10 + i20 - i02 - 2 * i12 - i22,
+		i00 - i20 + 2 * i01 - 2 * i21 + i02 - i22);
+}
+
+/* Magnitude of the luminance (x) only and the direction_code of its gradient, quantized
+   without trig. Border pixels get code 0. */
+__kernel void sobel_direction(__global uchar4* inputImage, __global uchar4* outputImage, __global uchar* theta TILE_ARGS)
+{
+	uint x = PIXEL_X;
+	uint y = PIXEL_Y;
+
+	uint width = IMAGE_WIDTH;
+	uint height = IMAGE_HEIGHT;
+
+	int c = x + y * width;
+
+	if (!INTERIOR(x, y, width, height))
+	{
+		theta[c] = 0;
+		return;
+	}
+
+	int2 g = luma_gradient(inputImage, c, width);
+	outputImage[c] = (uchar4)(root_magnitude(g.x, g.y));
+	theta[c] = direction_code(g.x, g.y);
+}
+
+/* Magnitude and direction code packed in one ushort per pixel, magnitude << 2 | code, so
+   Max_packed_filter gets both with one load. The border keeps the greyscale sobel_filter
+   leaves in its output, with code 0. */
+void sobel_pack(__global uchar4* inputImage, __global uchar4* greyImage, __global ushort* gradient,
+	bool tangent)
+{
+	uint x = get_global_id(0);
+	uint y = get_global_id(1);
+
+	uint width = IMAGE_WIDTH;
+	uint height = IMAGE_HEIGHT;
+
+	int c = x + y * width;
+
+	if (x < 1 || x >= width - 1 || y < 1 || y >= height - 1)
+	{
+		gradient[c] = (ushort)(greyImage[c].x << 2);
+		return;
+	}
+
+	int2 g = luma_gradient(inputImage, c, width);
+	uchar m;
+	uchar code;
+	if (tangent)
+	{
+		m = root_magnitude(g.x, g.y);
+		code = direction_code(g.x, g.y);
+	}
+	else
+	{
+		m = sobel_magnitude(g.x, g.y);
+		code = sobel_theta(g.x, g.y) / 45;
+	}
+	gradient[c] = (ushort)((m << 2) | code);
+}
+
+/* sobel_filter into the packed layout */
+__kernel void sobel_packed_filter(__global uchar4* inputImage, __global uchar4* greyImage, __global ushort* gradient)
+{
+	sobel_pack(inputImage, greyImage, gradient, false);
+}
+
+/* sobel_direction into the packed layout */
+__kernel void sobel_packed_code_filter(__global uchar4* inputImage, __global uchar4* greyImage, __global ushort* gradient)
+{
+	sobel_pack(inputImage, greyImage, gradient, true);
+}
+
+/* Work-group of sobel_max_filter; the host enqueues it with the same local size */
+#define FUSED_GROUP_X 16
+#define FUSED_GROUP_Y 16
+#define FUSED_GAUS_X (FUSED_GROUP_X + 4)
+#define FUSED_GAUS_Y (FUSED_GROUP_Y + 4)
+#define FUSED_MAG_X (FUSED_GROUP_X + 2)
+#define FUSED_MAG_Y (FUSED_GROUP_Y + 2)
+
+/* Neighbour step of each direction code, as in Max_code_filter */
+__constant int codeStepX[4] = { -1, 1, 0, -1 };
+__constant int codeStepY[4] = { 0, -1, -1, -1 };
+
+/* Sobel and non-maximum suppression of one work-group tile. The gaussian luminance of the
+   tile and two pixels around it is loaded once; magnitude and direction of the tile and
+   one pixel around it stay in local memory, so neither reaches global memory. The pixels
+   sobel_filter skips have no gradient, which makes the border ring of the output 0. */
+void sobel_max_tile(__global uchar4* inputImage, __global uchar4* outputImage, uint width, uint height,
+	bool tangent, __local uchar* gaus, __local uchar* mag, __local uchar* code)
+{
+#if defined(WIDTH)
+	/* The arguments hold the same size; the constants let the compiler fold it */
+	width = WIDTH;
+	height = HEIGHT;
+#endif
+	int lx = get_local_id(0);
+	int ly = get_local_id(1);
+	int x0 = get_group_id(0) * FUSED_GROUP_X;
+	int y0 = get_group_id(1) * FUSED_GROUP_Y;
+	int l = lx + ly * FUSED_GROUP_X;
+
+	/* Reads outside the image are clamped; they only feed pixels without a gradient */
+	for (int i = l; i < FUSED_GAUS_X * FUSED_GAUS_Y; i += FUSED_GROUP_X * FUSED_GROUP_Y)
+	{
+		int x = clamp(x0 - 2 + i % FUSED_GAUS_X, 0, (int)width - 1);
+		int y = clamp(y0 - 2 + i / FUSED_GAUS_X, 0, (int)height - 1);
+		gaus[i] = inputImage[x + y * width].x;
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (int i = l; i < FUSED_MAG_X * FUSED_MAG_Y; i += FUSED_GROUP_X * FUSED_GROUP_Y)
+	{
+		int tx = i % FUSED_MAG_X;
+		int ty = i / FUSED_MAG_X;
+		int x = x0 - 1 + tx;
+		int y = y0 - 1 + ty;
+		uchar m = 0;
+		uchar d = 0;
+
+		if (x >= 1 && x < (int)width - 1 && y >= 1 && y < (int)height - 1)
+		{
+			__local uchar* g = gaus + (tx + 1) + (ty + 1) * FUSED_GAUS_X;
+			int i00 = g[-1 - FUSED_GAUS_X];
+			int i10 = g[-FUSED_GAUS_X];
+			int i20 = g[1 - FUSED_GAUS_X];
+			int i01 = g[-1];
+			int i21 = g[1];
+			int i02 = g[-1 + FUSED_GAUS_X];
+			int i12 = g[FUSED_GAUS_X];
+			int i22 = g[1 + FUSED_GAUS_X];
+
+			int gx = i00 + 2 * i10 + i20 - i02 - 2 * i12 - i22;
+			int gy = i00 - i20 + 2 * i01 - 2 * i21 + i02 - i22;
+
+			if (tangent)
+			{
+				m = root_magnitude(gx, gy);
+				d = direction_code(gx, gy);
+			}
+			else
+			{
+				m = sobel_magnitude(gx, gy);
+				d = sobel_theta(gx, gy) / 45;
+			}
+		}
+		mag[i] = m;
+		code[i] = d;
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	int x = x0 + lx;
+	int y = y0 + ly;
+	if (x >= (int)width || y >= (int)height)
+	{
+		return;
+	}
+
+	int t = (lx + 1) + (ly + 1) * FUSED_MAG_X;
+	int step = codeStepX[code[t]] + codeStepY[code[t]] * FUSED_MAG_X;
+	uchar m = mag[t];
+	outputImage[x + y * width] = (m <= mag[t + step] || m <= mag[t - step]) ? (uchar4)(0) : (uchar4)(m);
+}
+
+/* sobel_filter and Max_filter in one pass. The global size is rounded up to whole
+   work-groups, so the image size comes in width and height. */
+__kernel void sobel_max_filter(__global uchar4* inputImage, __global uchar4* outputImage, uint width, uint height)
+{
+	__local uchar gaus[FUSED_GAUS_X * FUSED_GAUS_Y];
+	__local uchar mag[FUSED_MAG_X * FUSED_MAG_Y];
+	__local uchar code[FUSED_MAG_X * FUSED_MAG_Y];
+
+	sobel_max_tile(inputImage, outputImage, width, height, false, gaus, mag, code);
+}
+
+/* sobel_direction and Max_code_filter in one pass */
+__kernel void sobel_max_code_filter(__global uchar4* inputImage, __global uchar4* outputImage, uint width, uint height)
+{
+	__local uchar gaus[FUSED_GAUS_X * FUSED_GAUS_Y];
+	__local uchar mag[FUSED_MAG_X * FUSED_MAG_Y];
+	__local uchar code[FUSED_MAG_X * FUSED_MAG_Y];
+
+	sobel_max_tile(inputImage, outputImage, width, height, true, gaus, mag, code);
+}
+
+/* sobel_filter (or with codes, sobel_direction) of the ring pixels under a --border mode */
+__kernel void sobel_border(__global uchar4* inputImage, __global uchar4* outputImage, __global uchar* theta,
+	uint width, uint height, uint mode, uint codes)
+{
+	int2 p = ring_pixel(get_global_id(0), width, height);
+	int c = p.x + p.y * width;
+	uchar m = 0;
+	uchar d = 0;
+
+	if (mode != BORDER_SKIP)
+	{
+		int i00 = border_pixel(inputImage, p.x - 1, p.y - 1, width, height, mode).x;
+		int i10 = border_pixel(inputImage, p.x, p.y - 1, width, height, mode).x;
+		int i20 = border_pixel(inputImage, p.x + 1, p.y - 1, width, height, mode).x;
+		int i01 = border_pixel(inputImage, p.x - 1, p.y, width, height, mode).x;
+		int i21 = border_pixel(inputImage, p.x + 1, p.y, width, height, mode).x;
+		int i02 = border_pixel(inputImage, p.x - 1, p.y + 1, width, height, mode).x;
+		int i12 = border_pixel(inputImage, p.x, p.y + 1, width, height, mode).x;
+		int i22 = border_pixel(inputImage, p.x + 1, p.y + 1, width, height, mode).x;
+
+		int gx = i00 + 2 * i10 + i20 - i02 - 2 * i12 - i22;
+		int gy = i00 - i20 + 2 * i01 - 2 * i21 + i02 - i22;
+		if (codes)
+		{
+			m = root_magnitude(gx, gy);
+			d = direction_code(gx, gy);
+		}
+		else
+		{
+			m = sobel_magnitude(gx, gy);
+			d = sobel_theta(gx, gy);
+		}
+	}
+
+	outputImage[c] = (uchar4)(m);
+	theta[c] = d;
+}
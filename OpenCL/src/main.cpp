@@ -21,8 +21,39 @@ main(int argc, char * argv[])
 		return clEdgeDetector.genBinaryImage();
 	}
 
-	std::string filePath = getPath() + std::string(INPUT_IMAGE);
+	if (clEdgeDetector.isVideo())
+	{
+		// stdout carries the frames; everything printed goes to stderr
+		std::cout.rdbuf(std::cerr.rdbuf());
+
+		status = clEdgeDetector.runVideo();
+		CHECK_ERROR(status, SDK_SUCCESS, "Video edge detection failed");
+
+		if (clEdgeDetector.cleanup() != SDK_SUCCESS)
+		{
+			return SDK_FAILURE;
+		}
+
+		clEdgeDetector.printStats();
+		return SDK_SUCCESS;
+	}
+
+	std::string filePath = clEdgeDetector.getInputPath();
 	std::cout << "Input File:  " << filePath << std::endl;
+
+	if (clEdgeDetector.isStreaming())
+	{
+		status = clEdgeDetector.runStream(filePath, clEdgeDetector.getOutputPath());
+		CHECK_ERROR(status, SDK_SUCCESS, "Streaming edge detection failed");
+
+		if (clEdgeDetector.cleanup() != SDK_SUCCESS)
+		{
+			return SDK_FAILURE;
+		}
+
+		clEdgeDetector.printStats();
+		return SDK_SUCCESS;
+	}
 	status = clEdgeDetector.readInputImage(filePath);
 	CHECK_ERROR(status, SDK_SUCCESS, "Read InputImage failed");
 	
@@ -32,19 +63,33 @@ main(int argc, char * argv[])
 		return status;
 	}
 
+	if (clEdgeDetector.isSweep())
+	{
+		if (clEdgeDetector.runSweep(clEdgeDetector.getOutputPath()) != SDK_SUCCESS)
+		{
+			return SDK_FAILURE;
+		}
+		if (clEdgeDetector.cleanup() != SDK_SUCCESS)
+		{
+			return SDK_FAILURE;
+		}
+		clEdgeDetector.printStats();
+		return SDK_SUCCESS;
+	}
+
 	if (clEdgeDetector.run() != SDK_SUCCESS)
 	{
 		return SDK_FAILURE;
 	}
 
 	// write the output image to bitmap file
-	status = clEdgeDetector.writeOutputImage(OUTPUT_IMAGE);
+	status = clEdgeDetector.writeOutputImage(clEdgeDetector.getOutputPath());
 	CHECK_ERROR(status, SDK_SUCCESS, "write Output Image Failed");
 
-	/*if (clEdgeDetector.verifyResults() != SDK_SUCCESS)
+	if (clEdgeDetector.verifyResults() != SDK_SUCCESS)
 	{
 		return SDK_FAILURE;
-	}*/
+	}
 
 	if (clEdgeDetector.cleanup() != SDK_SUCCESS)
 	{
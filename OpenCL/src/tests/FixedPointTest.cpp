@@ -0,0 +1,129 @@
+/* Exhaustive checks of the integer sobel (--arithmetic fixed) against the float kernels.
+   Builds kernels/Sobel_Fixed.h as C++ and compares it over every input it can get:
+   - fixed_theta against the atan2 bucketing of sobel_filter for every Gx, Gy in [-1020, 1020],
+     exactly (in double) and as the float kernel rounds it; the float kernel may only
+     differ where its rounding error reaches a bucket boundary
+   - sobel_root against the exact integer root, and the magnitude it gives against the
+     float root, for every sum of squares up to 2 * 1020^2
+   Returns 0 when everything matches. */
+
+#include <math.h>
+#include <stdio.h>
+#include "../kernels/Sobel_Fixed.h"
+
+// Largest |Gx| or |Gy| of a 3x3 window of bytes: 255 * (1 + 2 + 1)
+#define GRADIENT_MAX 1020
+
+// Float rounding of atan2, the 2 PI wrap and the bucket arithmetic, in buckets; a few ulp at 5 radians
+#define FLOAT_BOUNDARY_MARGIN 2e-6
+
+// Direction of sobel_filter in exact arithmetic (double), with the constants of the kernel;
+// *distance receives how far the bucket value is from the nearest boundary
+static int exactTheta(int gx, int gy, double* distance)
+{
+	const double PI = 3.14159265;
+	double angle = atan2((double)gx, (double)gy);
+
+	if (angle < 0)
+	{
+		angle = fmod((angle + 2 * PI), (2 * PI));
+	}
+
+	double bucket = (angle * (PI / 8) + PI / 8 - 0.0001) * (180.0 / 3.14159265358979323846) / 45;
+	*distance = fabs(bucket - floor(bucket + 0.5));
+	return ((int)bucket * 45) % 180;
+}
+
+// Direction of the float sobel_filter, as the kernel computes it in float
+static int floatTheta(int gx, int gy)
+{
+	const float PI = 3.14159265f;
+	float angle = atan2f((float)gx, (float)gy);
+
+	if (angle < 0)
+	{
+		angle = fmodf((angle + 2 * PI), (2 * PI));
+	}
+
+	// degrees() of OpenCL C
+	float bucket = (angle * (PI / 8) + PI / 8 - 0.0001f) * (180.0f / 3.14159265358979f);
+	return ((int)(bucket / 45) * 45) % 180;
+}
+
+// Magnitude byte of the float sobel_filter, convert_uchar4 of hypot / 2
+static int floatMagnitude(int n)
+{
+	int m = (int)(sqrtf((float)n) / 2);
+	return m > 255 ? 255 : m;
+}
+
+int main()
+{
+	long thetaMismatches = 0;
+	long floatMismatches = 0;
+	long roundedMismatches = 0;
+	for (int gx = -GRADIENT_MAX; gx <= GRADIENT_MAX; gx++)
+	{
+		for (int gy = -GRADIENT_MAX; gy <= GRADIENT_MAX; gy++)
+		{
+			double distance;
+			int theta = fixed_theta(gx, gy);
+			int exact = exactTheta(gx, gy, &distance);
+			if (theta != exact)
+			{
+				if (thetaMismatches++ < 10)
+				{
+					printf("theta Gx %d Gy %d: fixed %d, exact %d\n", gx, gy, theta, exact);
+				}
+			}
+			if (theta != floatTheta(gx, gy))
+			{
+				if (distance < FLOAT_BOUNDARY_MARGIN)
+				{
+					// The float kernel rounded across the boundary; atan2 is not correctly rounded on devices either
+					roundedMismatches++;
+				}
+				else if (floatMismatches++ < 10)
+				{
+					printf("theta Gx %d Gy %d: fixed %d, float %d\n", gx, gy, theta, floatTheta(gx, gy));
+				}
+			}
+		}
+	}
+	printf("theta: %ld mismatches with exact, %ld with float (%ld more within float rounding of a boundary) "
+		"over %d gradients\n", thetaMismatches, floatMismatches, roundedMismatches,
+		(2 * GRADIENT_MAX + 1) * (2 * GRADIENT_MAX + 1));
+
+	long rootMismatches = 0;
+	long magnitudeMismatches = 0;
+	const int sumMax = 2 * GRADIENT_MAX * GRADIENT_MAX;
+	for (int n = 0; n <= sumMax; n++)
+	{
+		int root = sobel_root(n);
+		if (root < 0 || (long)root * root > n || (long)(root + 1) * (root + 1) <= n)
+		{
+			if (rootMismatches++ < 10)
+			{
+				printf("sobel_root(%d) = %d is not the integer root\n", n, root);
+			}
+		}
+		int magnitude = (root >> 1) > 255 ? 255 : root >> 1;
+		if (magnitude != floatMagnitude(n))
+		{
+			if (magnitudeMismatches++ < 10)
+			{
+				printf("magnitude of %d: fixed %d, float %d\n", n, magnitude, floatMagnitude(n));
+			}
+		}
+	}
+	printf("sobel_root: %ld mismatches, magnitude: %ld mismatches over %d sums\n", rootMismatches,
+		magnitudeMismatches, sumMax + 1);
+
+	if (thetaMismatches != 0 || floatMismatches != 0 || rootMismatches != 0 || magnitudeMismatches != 0)
+	{
+		printf("Failed\n");
+		return 1;
+	}
+	printf("Passed!\n");
+	return 0;
+}